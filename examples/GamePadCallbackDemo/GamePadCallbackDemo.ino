@@ -0,0 +1,48 @@
+/*
+ * GamePadCallbackDemo: React to the BitBus App as soon as each message arrives.
+ *
+ * Instead of polling the GamePad getters after every BitBus.processInput(),
+ * register functions to be called when a button is pressed or the joystick
+ * moves. There is no need to slow down loop() with delay().
+ *
+ * To run this demo:
+ *   - Connect your Bluetooth Module to digital pins 2 & 3 on the Arduino.
+ *   - Install the BitBlue BitBus app on your phone.
+ *   - Press "Scan" to connect to the Bluetooth device
+ *   - Choose "Controller" when the device is recognized
+ *   - Click the "Mode" button in the app to switch into analog joystick mode.
+ */
+#include <BitBus.h>
+#include <GamePad.h>
+
+// Called once for every action button press
+void buttonPressed(uint8_t button) {
+  static const char names[] = "SCABXY";  // Indexed by enum GAMEPAD_BUTTON
+  Serial.print("Button: ");
+  Serial.println(names[button]);
+}
+
+// Called every time the app sends the joystick position
+void joystickMoved(uint8_t left, uint8_t right, uint8_t up, uint8_t down) {
+  Serial.print("Left: ");
+  Serial.print(left);
+  Serial.print(" Right: ");
+  Serial.print(right);
+  Serial.print(" Up: ");
+  Serial.print(up);
+  Serial.print(" Down: ");
+  Serial.println(down);
+}
+
+void setup() {
+  Serial.begin(57600);     // Make sure your Serial Monitor is also set at this baud rate.
+  BitBus.begin(9600);      // Enter baudrate of your bluetooth.
+  GamePad.onButtonPressed(buttonPressed);
+  GamePad.onAnalogUpdate(joystickMoved);
+}
+
+void loop() {
+  BitBus.processInput();   // Calls buttonPressed() and joystickMoved() as messages arrive
+
+  // Do the rest of your work here
+}
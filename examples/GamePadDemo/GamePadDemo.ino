@@ -65,6 +65,7 @@ void loop() {
     Serial.print("Y ");
   }
 
+#if GAMEPAD_DABBLE_COMPAT
   // Dabble Compatibility mode functions
   if (GamePad.isSquarePressed())
   {
@@ -85,6 +86,7 @@ void loop() {
   {
     Serial.print("Triangle ");
   }
+#endif
 
   if (GamePad.isStartPressed())
   {
@@ -97,8 +99,8 @@ void loop() {
   }
   Serial.print('\t');
 
-  // Unimplemented Dabble compatibility mode functions
-#if 0
+  // Dabble compatibility mode joystick functions
+#if GAMEPAD_DABBLE_COMPAT
   int a = GamePad.getAngle();
   Serial.print("Angle: ");
   Serial.print(a);
@@ -114,6 +116,7 @@ void loop() {
   float d = GamePad.getYaxisData();
   Serial.print("y_axis: ");
   Serial.print(d);
+  Serial.print('\t');
 #endif
 
   Serial.print(" Left: ");
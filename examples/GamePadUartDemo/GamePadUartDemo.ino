@@ -0,0 +1,41 @@
+/*
+ * GamePadUartDemo: Receive from the BitBus App on the hardware serial port.
+ *
+ * SoftwareSerial blocks interrupts while it receives, which makes servos
+ * jitter. BitBusUart receives with the USART interrupt instead.
+ *
+ * To run this demo:
+ *   - Connect your Bluetooth Module to the hardware serial port: module TX to
+ *     RX (pin 0) and module RX to TX (pin 1) on an Uno or Nano. Disconnect it
+ *     while uploading a sketch.
+ *   - Set BLUETOOTH_BAUD to the baud rate of your Bluetooth module.
+ *   - Install the BitBlue BitBus app on your phone and connect in Controller mode.
+ *
+ * Serial can't be used for printing because it shares USART0, so this demo
+ * lights the built in LED while the A button or the joystick is pressed up.
+ */
+#include <BitBus.h>
+#include <BitBusUart.h>
+#include <GamePad.h>
+
+#define BLUETOOTH_BAUD 9600
+
+// Defines bbUart on USART0 and its receive interrupt handler
+BITBUS_UART(bbUart, 0)
+
+void setup() {
+  pinMode(LED_BUILTIN, OUTPUT);
+  bbUart.begin(BLUETOOTH_BAUD);
+  BitBus.begin(bbUart);
+}
+
+void loop() {
+  BitBus.processInput();
+
+  if (GamePad.isAPressed() || GamePad.isUpPressed()) {
+    digitalWrite(LED_BUILTIN, HIGH);
+  } else {
+    digitalWrite(LED_BUILTIN, LOW);
+  }
+  delay(50);
+}
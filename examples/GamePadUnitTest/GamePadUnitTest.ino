@@ -12,6 +12,9 @@
 // Testing and Debugging Routines
 #include <BitBusUtil.h>
 
+// Timer 1 overflow handler for the benchmarks
+BITBUS_BENCH_TIMER()
+
 void setup() {
   // put your setup code here, to run once:
   Serial.begin(57600);    // Make sure your Serial Monitor is also set at this baud rate.
@@ -20,27 +23,27 @@ void setup() {
 
 _MessageBuffer mb;
 
-void printTest(char *msg) {
-  Serial.println("--------------------------------------------------------");
-  Serial.print("Starting Test ");
-  Serial.println(msg);
+void printTest(PGM_P msg) {
+  DebugPrintln("--------------------------------------------------------");
+  DebugPrint("Starting Test ");
+  SerialPrintln_P(msg);
 }
 
 void testMessageBufferInternals() {
-  printTest("MessageBufferInternals");
+  printTest(PSTR("MessageBufferInternals"));
 
-  Serial.println(" State Table:");
+  DebugPrintln(" State Table:");
   mb._printStateTable();
   Serial.println();
 
-  Serial.println(" Test isDecDigit");
+  DebugPrintln(" Test isDecDigit");
 
   ASSERT(mb._isDecDigit('0'), "expected 0 to be Dec Digit");
   ASSERT(mb._isDecDigit('0'), "expected 9 to be Dec Digit");
   ASSERT(!mb._isDecDigit('A'), "expected A to not be Dec Digit");
   ASSERT(!mb._isDecDigit('0'-1), "expected non Dec Digit");
 
-  Serial.println(" Test isHexDigit");
+  DebugPrintln(" Test isHexDigit");
   ASSERT(mb._isHexDigit('0'), "expected 0 to be hex digit");
   ASSERT(mb._isHexDigit('1'), "expected 1 to be hex digit");
   ASSERT(mb._isHexDigit('A'), "expected A to be hex digit");
@@ -50,9 +53,9 @@ void testMessageBufferInternals() {
 }
 
 void testMessageBufferActionButtons() {
-  printTest("MessageBufferActions");
+  printTest(PSTR("MessageBufferActions"));
 
-  Serial.println(" Test MT_BUTTON_B");
+  DebugPrintln(" Test MT_BUTTON_B");
   mb.clear();
   ASSERTV(mb.messageType == MT_UNKNOWN, "expected MT_UNKNOWN", mb.messageType);
   ASSERTV(mb.inputState == IS_START, "expected IS_START", mb.inputState);
@@ -60,31 +63,31 @@ void testMessageBufferActionButtons() {
   ASSERTV(mb.messageType == MT_BUTTON_B, "expected MT_BUTTON_B", mb.messageType);
   ASSERTV(mb.inputState == IS_MESSAGE_READY, "expected IS_MESSAGE_READY", mb.inputState);
 
-  Serial.println(" Test MT_BUTTON_Y");
+  DebugPrintln(" Test MT_BUTTON_Y");
   mb.clear();
   mb.processInput('Y');
   ASSERTV(mb.messageType == MT_BUTTON_Y, "expected MT_BUTTON_Y", mb.messageType);
   ASSERTV(mb.inputState == IS_MESSAGE_READY, "expected IS_MESSAGE_READY", mb.inputState);
 
-  Serial.println(" Test MT_BUTTON_X");
+  DebugPrintln(" Test MT_BUTTON_X");
   mb.clear();
   mb.processInput('X');
   ASSERTV(mb.messageType == MT_BUTTON_X, "expected MT_BUTTON_X", mb.messageType);
   ASSERTV(mb.inputState == IS_MESSAGE_READY, "expected IS_MESSAGE_READY", mb.inputState);
 
-  Serial.println(" Test MT_BUTTON_A");
+  DebugPrintln(" Test MT_BUTTON_A");
   mb.clear();
   mb.processInput('A');
   ASSERTV(mb.messageType == MT_BUTTON_A, "expected MT_BUTTON_A", mb.messageType);
   ASSERTV(mb.inputState == IS_MESSAGE_READY, "expected IS_MESSAGE_READY", mb.inputState);
 
-  Serial.println(" Test MT_SELECT");
+  DebugPrintln(" Test MT_SELECT");
   mb.clear();
   mb.processInput('C');
   ASSERTV(mb.messageType == MT_SELECT, "expected MT_SELECT", mb.messageType);
   ASSERTV(mb.inputState == IS_MESSAGE_READY, "expected IS_MESSAGE_READY", mb.inputState);
 
-  Serial.println(" Test MT_START");
+  DebugPrintln(" Test MT_START");
   mb.clear();
   mb.processInput('S');
   ASSERTV(mb.messageType == MT_START_BUTTON, "expected MT_START_BUTTON", mb.messageType);
@@ -92,7 +95,7 @@ void testMessageBufferActionButtons() {
 }
 
 void testMessageBufferAnalogPositionDec() {
-  printTest("MessageBufferAnalogPositionDec");
+  printTest(PSTR("MessageBufferAnalogPositionDec"));
 
   mb.clear();
 
@@ -120,7 +123,7 @@ void testMessageBufferAnalogPositionDec() {
   ASSERTV(mb.inputState == IS_WAITING_FOR_R_DIGIT_2, "expected IS_WAITING_FOR_R_DIGIT_2", mb.inputState);
 
   mb.processInput('0');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_R_DIGIT_3_OR_F, "expected IS_WAITING_FOR_R_DIGIT_3_OR_F", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_R_DIGIT_3, "expected IS_WAITING_FOR_R_DIGIT_3", mb.inputState);
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('0');
@@ -136,7 +139,7 @@ void testMessageBufferAnalogPositionDec() {
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('3');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_F_DIGIT_3_OR_B, "expected IS_WAITING_FOR_F_DIGIT_3_OR_B", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_F_DIGIT_3, "expected IS_WAITING_FOR_F_DIGIT_3", mb.inputState);
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('0');
@@ -152,7 +155,7 @@ void testMessageBufferAnalogPositionDec() {
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('0');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_B_DIGIT_3, "expected IS_WAITING_FOR_F_DIGIT_3", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_B_DIGIT_3, "expected IS_WAITING_FOR_B_DIGIT_3", mb.inputState);
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('2');
@@ -166,7 +169,7 @@ void testMessageBufferAnalogPositionDec() {
 }
 
 void testMessageBufferAnalogPositionHex() {
-  printTest("MessageBufferAnalogPositionHex");
+  printTest(PSTR("MessageBufferAnalogPositionHex"));
 
   mb.clear();
 
@@ -184,34 +187,34 @@ void testMessageBufferAnalogPositionHex() {
   ASSERTV(mb.inputState == IS_WAITING_FOR_L_DIGIT_3_OR_R, "expected IS_WAITING_FOR_L_DIGIT_3_OR_F", mb.inputState);
 
   mb.processInput('R');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_R_DIGIT_1, "expected IS_WAITING_FOR_R_DIGIT_1", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_HEX_R_DIGIT_1, "expected IS_WAITING_FOR_HEX_R_DIGIT_1", mb.inputState);
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('2');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_R_DIGIT_2, "expected IS_WAITING_FOR_R_DIGIT_2", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_HEX_R_DIGIT_2, "expected IS_WAITING_FOR_HEX_R_DIGIT_2", mb.inputState);
 
   mb.processInput('0');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_R_DIGIT_3_OR_F, "expected IS_WAITING_FOR_R_DIGIT_3_OR_F", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_HEX_F, "expected IS_WAITING_FOR_HEX_F", mb.inputState);
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('F');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_F_DIGIT_1, "expected IS_WAITING_FOR_F_DIGIT_1", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_HEX_F_DIGIT_1, "expected IS_WAITING_FOR_HEX_F_DIGIT_1", mb.inputState);
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('3');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_F_DIGIT_2, "expected IS_WAITING_FOR_F_DIGIT_2", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_HEX_F_DIGIT_2, "expected IS_WAITING_FOR_HEX_F_DIGIT_2", mb.inputState);
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('F');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_F_DIGIT_3_OR_B, "expected IS_WAITING_FOR_F_DIGIT_3_OR_B", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_HEX_B, "expected IS_WAITING_FOR_HEX_B", mb.inputState);
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('B');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_B_DIGIT_1, "expected IS_WAITING_FOR_B_DIGIT_1", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_HEX_B_DIGIT_1, "expected IS_WAITING_FOR_HEX_B_DIGIT_1", mb.inputState);
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('0');
-  ASSERTV(mb.inputState == IS_WAITING_FOR_B_DIGIT_2, "expected IS_WAITING_FOR_B_DIGIT_2", mb.inputState);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_HEX_B_DIGIT_2, "expected IS_WAITING_FOR_HEX_B_DIGIT_2", mb.inputState);
   ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
 
   mb.processInput('A');
@@ -225,19 +228,19 @@ void testMessageBufferAnalogPositionHex() {
 }
 
 void testMessageBufferInvalidInput() {
-  printTest("MessageBufferInvalidInput");
+  printTest(PSTR("MessageBufferInvalidInput"));
   mb.clear();
 
   ASSERTV(mb.messageType == MT_UNKNOWN, "expected MT_UNKNOWN", mb.messageType);
   ASSERTV(mb.inputState == IS_START, "expected IS_START", mb.inputState);
 
-  Serial.println(" Test unexpected constant in start");
+  DebugPrintln(" Test unexpected constant in start");
   int result = mb.processInput('?');
   ASSERTV(result == GP_ERROR_NO_STATE_ENTRY, "expected error on ?", result);
   ASSERTV(mb.messageType == MT_UNKNOWN, "? expected MT_UNKNOWN", mb.messageType);
   ASSERTV(mb.inputState == IS_START, "expected IS_START", mb.inputState);
 
-  Serial.println(" Test unexpected value in Analog Position");
+  DebugPrintln(" Test unexpected value in Analog Position");
   mb.clear();
   result = mb.processInput('L');
   ASSERTV(result == 1, "expected incomplete message", result);
@@ -247,7 +250,7 @@ void testMessageBufferInvalidInput() {
   ASSERTV(mb.messageType == MT_UNKNOWN, "X expected MT_UNKNOWN", mb.messageType);
   ASSERTV(mb.inputState == IS_START, "expected IS_START", mb.inputState);
 
-  Serial.println(" Test unexpected constant in Analog Position");
+  DebugPrintln(" Test unexpected constant in Analog Position");
   mb.clear();
   result = mb.processInput('L');
   ASSERTV(result == 1, "expected incomplete message", result);
@@ -263,7 +266,7 @@ void testMessageBufferInvalidInput() {
   ASSERTV(mb.messageType == MT_UNKNOWN, "A expected MT_UNKNOWN", mb.messageType);
   ASSERTV(mb.inputState == IS_START, "expected IS_START", mb.inputState);
 
-  Serial.println(" Test hex in dec Analog Position");
+  DebugPrintln(" Test hex in dec Analog Position");
   mb.clear();
   result = mb.processInput('L');
   ASSERTV(result == 1, "expected incomplete message", result);
@@ -290,7 +293,7 @@ void testMessageBufferInvalidInput() {
   ASSERTV(mb.messageType == MT_UNKNOWN, "F expected MT_UNKNOWN", mb.messageType);
   ASSERTV(mb.inputState == IS_START, "expected IS_START", mb.inputState);
 
-  Serial.println(" Test dec in hex Analog Position");
+  DebugPrintln(" Test dec in hex Analog Position");
   mb.clear();
   result = mb.processInput('L');
   ASSERTV(result == 1, "expected incomplete message", result);
@@ -316,17 +319,258 @@ void testMessageBufferInvalidInput() {
   ASSERTV(mb.inputState == IS_START, "expected IS_START", mb.inputState);
 }
 
+/**
+ * Feed a buffer through both _MessageBuffer::processInput() APIs.
+ *
+ * Returns: true if the buffer API saw the same messages and errors as
+ * processing one character at a time.
+ */
+bool bufferMatchesBytes(const uint8_t *buf, size_t len) {
+  _MessageBuffer byByte;
+  _MessageBuffer byBuffer;
+  unsigned int byteChecksum = 0, bufferChecksum = 0;
+  int byteMessages = 0, bufferMessages = 0;
+  int byteErrors = 0, bufferErrors = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    int result = byByte.processInput(buf[i]);
+    if (result == 0) {
+      byteMessages++;
+      byteChecksum = byteChecksum * 31 + byByte.messageType + byByte.leftValue
+        + (byByte.rightValue << 2) + (byByte.upValue << 4) + (byByte.downValue << 6);
+    } else if (result != 1) {
+      byteErrors++;
+    }
+  }
+
+  size_t pos = 0;
+  while (pos < len) {
+    size_t consumed = 0;
+    int result = byBuffer.processInput(buf + pos, len - pos, &consumed);
+    pos += consumed;
+    if (result == 0) {
+      bufferMessages++;
+      bufferChecksum = bufferChecksum * 31 + byBuffer.messageType + byBuffer.leftValue
+        + (byBuffer.rightValue << 2) + (byBuffer.upValue << 4) + (byBuffer.downValue << 6);
+    } else if (result != 1) {
+      bufferErrors++;
+    }
+  }
+
+  return byteMessages == bufferMessages && byteChecksum == bufferChecksum
+    && byteErrors == bufferErrors && byByte.inputState == byBuffer.inputState;
+}
+
+/**
+ * Substitute every possible character at every position of a message and
+ * check the fast path against the state machine.
+ */
+void checkAllSubstitutions(const char *message) {
+  uint8_t buf[24];
+  size_t len = strlen(message);
+  memcpy(buf, message, len);
+  // A trailing button press checks that the fast path consumes exactly one message
+  buf[len] = 'A';
+  for (size_t pos = 0; pos < len; pos++) {
+    for (int c = 0; c <= 0xFF; c++) {
+      buf[pos] = c;
+      if (ASSERTV(bufferMatchesBytes(buf, len + 1), "buffer API differs from byte API at", pos)) {
+        DebugPrint(" Input: ");
+        Serial.println(c);
+      }
+    }
+    buf[pos] = message[pos];
+  }
+}
+
+void testMessageBufferAnalogFastPath() {
+  printTest(PSTR("MessageBufferAnalogFastPath"));
+  size_t consumed;
+  int result;
+
+  DebugPrintln(" Test hex message");
+  mb.clear();
+  result = mb.processInput((const uint8_t *)"L01R20F3FB0AS", 13, &consumed);
+  ASSERTV(result == 0, "expected complete message", result);
+  ASSERTV(consumed == ANALOG_HEX_MESSAGE_LEN, "expected hex message length", consumed);
+  ASSERTV(mb.messageType == MT_ANALOG_POSITION, "expected MT_ANALOG_POSITION", mb.messageType);
+  ASSERTV(mb.inputState == IS_MESSAGE_READY, "expected IS_MESSAGE_READY", mb.inputState);
+  ASSERTV(mb.leftValue == 0x01, "expected left == 0x01", mb.leftValue);
+  ASSERTV(mb.rightValue == 0x20, "expected right == 0x20", mb.rightValue);
+  ASSERTV(mb.upValue == 0x3F, "expected up == 0x3F", mb.upValue);
+  ASSERTV(mb.downValue == 0x0A, "expected down == 0x0A", mb.downValue);
+
+  DebugPrintln(" Test dec message");
+  result = mb.processInput((const uint8_t *)"L001R200F030B255", 16, &consumed);
+  ASSERTV(result == 0, "expected complete message", result);
+  ASSERTV(consumed == ANALOG_DEC_MESSAGE_LEN, "expected dec message length", consumed);
+  ASSERTV(mb.leftValue == 1, "expected left == 1", mb.leftValue);
+  ASSERTV(mb.rightValue == 200, "expected right == 200", mb.rightValue);
+  ASSERTV(mb.upValue == 30, "expected up == 30", mb.upValue);
+  ASSERTV(mb.downValue == 255, "expected down == 255", mb.downValue);
+
+  DebugPrintln(" Test partial message falls back to state machine");
+  mb.clear();
+  ASSERT(mb.processAnalogMessage((const uint8_t *)"L01R20", 6) == 0, "expected no fast path for partial message");
+  result = mb.processInput((const uint8_t *)"L01R20", 6, &consumed);
+  ASSERTV(result == 1, "expected incomplete message", result);
+  ASSERTV(consumed == 6, "expected all input consumed", consumed);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_HEX_F, "expected IS_WAITING_FOR_HEX_F", mb.inputState);
+  result = mb.processInput((const uint8_t *)"F3FB0A", 6, &consumed);
+  ASSERTV(result == 0, "expected complete message", result);
+  ASSERTV(mb.upValue == 0x3F, "expected up == 0x3F", mb.upValue);
+  ASSERTV(mb.downValue == 0x0A, "expected down == 0x0A", mb.downValue);
+
+  DebugPrintln(" Test action button before message");
+  mb.clear();
+  result = mb.processInput((const uint8_t *)"BL01R20F3FB0A", 13, &consumed);
+  ASSERTV(result == 0, "expected complete message", result);
+  ASSERTV(consumed == 1, "expected one character consumed", consumed);
+  ASSERTV(mb.messageType == MT_BUTTON_B, "expected MT_BUTTON_B", mb.messageType);
+
+  DebugPrintln(" Test every substitution in hex and dec messages");
+  checkAllSubstitutions("L01R20F3FB0A");
+  checkAllSubstitutions("LFFR9AF00BC7");
+  checkAllSubstitutions("L001R200F030B002");
+  checkAllSubstitutions("L255R099F100B999");
+}
+
 /**
  * Send characters to GamePad._processInput()
  */
-void sendToGamePadProcessInput(char *inputStr) {
+// Returns: the result for the last character
+int sendToMessageBufferProcessInput(const char *inputStr) {
+  int result = 1;
+  while (*inputStr) {
+    result = mb.processInput(*inputStr++);
+  }
+  return result;
+}
+
+void testParserTables() {
+  printTest(PSTR("ParserTables"));
+
+  DebugPrintln(" Test every state can be reached");
+  bool reached[IS_MESSAGE_READY + 1] = { true };
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int state = IS_START; state < IS_MESSAGE_READY; state++) {
+      for (int c = 0; reached[state] && c <= 0xFF; c++) {
+        uint8_t next = TRANSITION_STATE(mb._transition(state, c));
+        if (next == IS_ERROR) {
+          continue;
+        }
+        if (ASSERTV(next > IS_START && next <= IS_MESSAGE_READY, "transition to invalid state", next)) {
+          DebugPrint(" State: ");
+          Serial.println(state);
+        } else if (!reached[next]) {
+          reached[next] = changed = true;
+        }
+      }
+    }
+  }
+  for (int state = IS_START; state <= IS_MESSAGE_READY; state++) {
+    ASSERTV(reached[state], "expected state to be reachable", state);
+  }
+
+  DebugPrintln(" Test only message letters and hex digits are accepted");
+  for (int c = 0; c <= 0xFF; c++) {
+    bool starts = TRANSITION_STATE(mb._transition(IS_START, c)) != IS_ERROR;
+    ASSERTV(starts == (c != 0 && strchr(MESSAGE_BUTTON_LETTERS "L", c) != NULL), "unexpected message start", c);
+    if (mb._isHexDigit(c) || strchr(MESSAGE_BUTTON_LETTERS MESSAGE_FIELD_LETTERS, c)) {
+      continue;
+    }
+    for (int state = IS_START; state < IS_MESSAGE_READY; state++) {
+      ASSERTV(mb._transition(state, c) == IS_ERROR, "expected GP_ERROR_NO_STATE_ENTRY", c);
+    }
+  }
+  ASSERT(mb._transition(IS_START, -1) == IS_ERROR, "expected no transition for -1");
+  ASSERT(mb._transition(IS_MESSAGE_READY, 'L') == IS_ERROR, "expected no transition for IS_MESSAGE_READY");
+
+  DebugPrintln(" Test errors are caught at the first character that rules out a message");
+  mb.clear();
+  ASSERT(sendToMessageBufferProcessInput("L001R0") == 1, "expected incomplete message");
+  ASSERTV(mb.processInput('A') == GP_ERROR_INVALID_DEC_DIGIT, "expected hex letter in decimal rejected", mb.inputState);
+  ASSERT(sendToMessageBufferProcessInput("L01R20") == 1, "expected incomplete message");
+  ASSERTV(mb.processInput('D') == GP_ERROR_NO_STATE_ENTRY, "expected third hex digit rejected", mb.inputState);
+  ASSERT(sendToMessageBufferProcessInput("L0A") == 1, "expected incomplete message");
+  ASSERTV(mb.inputState == IS_WAITING_FOR_HEX_R, "expected IS_WAITING_FOR_HEX_R", mb.inputState);
+  ASSERTV(mb.processInput('5') == GP_ERROR_INVALID_DEC_DIGIT, "expected decimal after hex letter rejected", mb.inputState);
+  ASSERT(sendToMessageBufferProcessInput("LA0R0BF00BFF") == 0, "expected complete message");
+  ASSERTV(mb.leftValue == 0xA0, "expected left == 0xA0", mb.leftValue);
+  ASSERTV(mb.rightValue == 0x0B, "expected right == 0x0B", mb.rightValue);
+  ASSERTV(mb.downValue == 0xFF, "expected down == 0xFF", mb.downValue);
+  mb.clear();
+}
+
+void testMessageBufferResync() {
+  printTest(PSTR("MessageBufferResync"));
+  size_t consumed;
+  int result;
+
+  mb.clear();
+  mb.resync = true;
+
+  DebugPrintln(" Test the character that breaks a message starts the next one");
+  // The B message is cut short by the L of the next message
+  result = sendToMessageBufferProcessInput("L00R00F00B0");
+  ASSERTV(result == 1, "expected incomplete message", result);
+  result = mb.processInput('L');
+  ASSERTV(result == GP_ERROR_NO_STATE_ENTRY, "expected error on L", result);
+  ASSERTV(mb.inputState == IS_WAITING_FOR_L_DIGIT_1, "expected L kept", mb.inputState);
+  result = sendToMessageBufferProcessInput("01R02F03B04");
+  ASSERTV(result == 0, "expected complete message", result);
+  ASSERTV(mb.leftValue == 0x01, "expected left == 0x01", mb.leftValue);
+  ASSERTV(mb.downValue == 0x04, "expected down == 0x04", mb.downValue);
+
+  DebugPrintln(" Test a single character message breaking a message");
+  mb.clear();
+  sendToMessageBufferProcessInput("L00R");
+  result = mb.processInput('Y');
+  ASSERTV(result == GP_ERROR_NO_STATE_ENTRY, "expected error on Y", result);
+  ASSERTV(mb.inputState == IS_MESSAGE_READY, "expected Y message ready", mb.inputState);
+  ASSERTV(mb.messageType == MT_BUTTON_Y, "expected MT_BUTTON_Y", mb.messageType);
+
+  DebugPrintln(" Test buffer leaves the breaking character for the next call");
+  mb.clear();
+  const uint8_t *buf = (const uint8_t *)"L00R00F00B0L01R02F03B04";
+  result = mb.processInput(buf, 23, &consumed);
+  ASSERTV(result == GP_ERROR_NO_STATE_ENTRY, "expected error on L", result);
+  ASSERTV(consumed == 11, "expected L not consumed", consumed);
+  ASSERTV(mb.inputState == IS_START, "expected IS_START", mb.inputState);
+  result = mb.processInput(buf + consumed, 12, &consumed);
+  ASSERTV(result == 0, "expected complete message", result);
+  ASSERTV(consumed == 12, "expected whole message", consumed);
+  ASSERTV(mb.rightValue == 0x02, "expected right == 0x02", mb.rightValue);
+
+  DebugPrintln(" Test buffer skips noise up to the next message");
+  mb.clear();
+  buf = (const uint8_t *)"?*12#L01R02F03B04";
+  result = mb.processInput(buf, 17, &consumed);
+  ASSERTV(result == GP_ERROR_NO_STATE_ENTRY, "expected error on ?", result);
+  ASSERTV(consumed == 5, "expected noise skipped", consumed);
+
+  DebugPrintln(" Test noise breaking a message is skipped, not retried");
+  mb.clear();
+  buf = (const uint8_t *)"L00R0?*L01R02F03B04";
+  result = mb.processInput(buf, 19, &consumed);
+  ASSERTV(result == GP_ERROR_NO_STATE_ENTRY, "expected error on ?", result);
+  ASSERTV(consumed == 7, "expected noise skipped", consumed);
+  result = mb.processInput(buf + consumed, 12, &consumed);
+  ASSERTV(result == 0, "expected complete message", result);
+
+  mb.resync = false;
+  mb.clear();
+}
+
+void sendToGamePadProcessInput(const char *inputStr) {
   for (; *inputStr != 0; inputStr++) {
     GamePad._processInput(*inputStr);
   }
 }
 
 void testGamePadInternal() {
-  printTest("GamePadInternal");
+  printTest(PSTR("GamePadInternal"));
   GamePad._clear();
 
   // Nothing should be set
@@ -345,7 +589,7 @@ void testGamePadInternal() {
   ASSERT(!GamePad.isStartPressed(), "unexpected START");
   ASSERT(!GamePad.isSelectPressed(), "unexpected SELECT");
 
-  Serial.println(" Testing Start button");
+  DebugPrintln(" Testing Start button");
   sendToGamePadProcessInput("S");
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
   ASSERT(!GamePad.isDownPressed(), "unexpected DOWN");
@@ -362,7 +606,7 @@ void testGamePadInternal() {
   ASSERT(GamePad.isStartPressed(), "expected START");
   ASSERT(!GamePad.isSelectPressed(), "unexpected SELECT");
 
-  Serial.println(" Testing _clear");
+  DebugPrintln(" Testing _clear");
   // Nothing should be set
   GamePad._clear();
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
@@ -381,7 +625,7 @@ void testGamePadInternal() {
   ASSERT(!GamePad.isSelectPressed(), "unexpected SELECT");
 
 
-  Serial.println(" Testing Select button");
+  DebugPrintln(" Testing Select button");
   GamePad._clear();
   sendToGamePadProcessInput("C");
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
@@ -399,7 +643,7 @@ void testGamePadInternal() {
   ASSERT(!GamePad.isStartPressed(), "unexpected START");
   ASSERT(GamePad.isSelectPressed(), "expected SELECT");
 
-  Serial.println(" Testing A/Square button");
+  DebugPrintln(" Testing A/Square button");
   GamePad._clear();
   sendToGamePadProcessInput("A");
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
@@ -417,7 +661,7 @@ void testGamePadInternal() {
   ASSERT(!GamePad.isStartPressed(), "unexpected START");
   ASSERT(!GamePad.isSelectPressed(), "unexpected SELECT");
 
-  Serial.println(" Testing B/Triangle button");
+  DebugPrintln(" Testing B/Triangle button");
   GamePad._clear();
   sendToGamePadProcessInput("B");
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
@@ -435,7 +679,7 @@ void testGamePadInternal() {
   ASSERT(!GamePad.isStartPressed(), "unexpected START");
   ASSERT(!GamePad.isSelectPressed(), "unexpected SELECT");
 
-  Serial.println(" Testing X/Cross button");
+  DebugPrintln(" Testing X/Cross button");
   GamePad._clear();
   sendToGamePadProcessInput("X");
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
@@ -453,7 +697,7 @@ void testGamePadInternal() {
   ASSERT(!GamePad.isStartPressed(), "unexpected START");
   ASSERT(!GamePad.isSelectPressed(), "unexpected SELECT");
 
-  Serial.println(" Testing Y/Circle button");
+  DebugPrintln(" Testing Y/Circle button");
   GamePad._clear();
   sendToGamePadProcessInput("Y");
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
@@ -471,7 +715,7 @@ void testGamePadInternal() {
   ASSERT(!GamePad.isStartPressed(), "unexpected START");
   ASSERT(!GamePad.isSelectPressed(), "unexpected SELECT");
 
-  Serial.println(" Test Up");
+  DebugPrintln(" Test Up");
   GamePad._clear();
   sendToGamePadProcessInput("L000R100F255B020");
   ASSERT(GamePad.isUpPressed(), "expected UP");
@@ -493,7 +737,7 @@ void testGamePadInternal() {
   ASSERTV(GamePad.getUpPosition() == 255, "expected 255", GamePad.getUpPosition());
   ASSERTV(GamePad.getDownPosition() == 20, "expected 20", GamePad.getDownPosition());
 
-  Serial.println(" Test Left");
+  DebugPrintln(" Test Left");
   GamePad._clear();
   sendToGamePadProcessInput("LFFR01F25BF0");
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
@@ -515,7 +759,7 @@ void testGamePadInternal() {
   ASSERTV(GamePad.getUpPosition() == 0x25, "expected 0x25", GamePad.getUpPosition());
   ASSERTV(GamePad.getDownPosition() == 0xF0, "expected 0xF0", GamePad.getDownPosition());
 
-  Serial.println(" Test Down");
+  DebugPrintln(" Test Down");
   GamePad._clear();
   sendToGamePadProcessInput("L0FR52F02BF1");
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
@@ -523,7 +767,7 @@ void testGamePadInternal() {
   ASSERT(!GamePad.isLeftPressed(), "unexpected LEFT");
   ASSERT(!GamePad.isRightPressed(), "unexpected RIGHT");
 
-  Serial.println(" Test Right");
+  DebugPrintln(" Test Right");
   GamePad._clear();
   sendToGamePadProcessInput("L00R01F00B00");
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
@@ -531,7 +775,7 @@ void testGamePadInternal() {
   ASSERT(!GamePad.isLeftPressed(), "unexpected LEFT");
   ASSERT(GamePad.isRightPressed(), "expected RIGHT");
 
-  Serial.println(" Test Stop");
+  DebugPrintln(" Test Stop");
   GamePad._clear();
   sendToGamePadProcessInput("L00R00F00B00");
   ASSERT(!GamePad.isUpPressed(), "unexpected UP");
@@ -540,26 +784,690 @@ void testGamePadInternal() {
   ASSERT(!GamePad.isRightPressed(), "unexpected RIGHT");
 }
 
+/**
+ * Send a string to the buffer version of GamePad._processInput()
+ */
+int sendBufferToGamePadProcessInput(const char *inputStr) {
+  return GamePad._processInput((const uint8_t *)inputStr, strlen(inputStr));
+}
+
+void testGamePadBufferInput() {
+  printTest(PSTR("GamePadBufferInput"));
+  int result;
+
+  DebugPrintln(" Test button then analog message");
+  GamePad._clear();
+  result = sendBufferToGamePadProcessInput("AL01R20F3FB0A");
+  ASSERTV(result == GP_OK, "expected GP_OK", result);
+  ASSERT(GamePad.isAPressed(), "expected A");
+  ASSERT(GamePad.isUpPressed(), "expected UP");
+  ASSERTV(GamePad.getLeftPosition() == 0x01, "expected 0x01", GamePad.getLeftPosition());
+  ASSERTV(GamePad.getRightPosition() == 0x20, "expected 0x20", GamePad.getRightPosition());
+  ASSERTV(GamePad.getUpPosition() == 0x3F, "expected 0x3F", GamePad.getUpPosition());
+  ASSERTV(GamePad.getDownPosition() == 0x0A, "expected 0x0A", GamePad.getDownPosition());
+
+  DebugPrintln(" Test all buttons in a buffer are reported");
+  GamePad._clear();
+  sendBufferToGamePadProcessInput("L200R000F000B000XY");
+  ASSERT(GamePad.isLeftPressed(), "expected LEFT");
+  ASSERT(GamePad.isXPressed(), "expected X");
+  ASSERT(GamePad.isYPressed(), "expected Y");
+  ASSERT(!GamePad.isAPressed(), "unexpected A");
+  GamePad._clearActionButtons();
+  ASSERT(!GamePad.isXPressed(), "unexpected X");
+  ASSERT(GamePad.isLeftPressed(), "expected LEFT");
+
+  DebugPrintln(" Test message split across buffers");
+  GamePad._clear();
+  sendBufferToGamePadProcessInput("L00R01");
+  ASSERT(!GamePad.isRightPressed(), "unexpected RIGHT");
+  sendBufferToGamePadProcessInput("F00B00");
+  ASSERT(GamePad.isRightPressed(), "expected RIGHT");
+
+  DebugPrintln(" Test errors are reported");
+  GamePad._clear();
+  result = sendBufferToGamePadProcessInput("?S");
+  ASSERTV(result == GP_ERROR_NO_STATE_ENTRY, "expected GP_ERROR_NO_STATE_ENTRY", result);
+  ASSERT(GamePad.isStartPressed(), "expected START");
+  result = GamePad._processInput('?');
+  ASSERTV(result == GP_ERROR_NO_STATE_ENTRY, "expected GP_ERROR_NO_STATE_ENTRY", result);
+}
+
+#if GAMEPAD_EVENT_QUEUE_SIZE
+void testGamePadEvents() {
+  printTest(PSTR("GamePadEvents"));
+  GamePadEvent event;
+
+  GamePad._clear();
+  ASSERT(!GamePad.readEvent(&event), "expected no events");
+
+  DebugPrintln(" Test button, analog and error events");
+  sendBufferToGamePadProcessInput("AL01R20F3FB0A?");
+  ASSERTV(GamePad.availableEvents() == 3, "expected 3 events", GamePad.availableEvents());
+  ASSERT(GamePad.readEvent(&event), "expected button event");
+  ASSERTV(event.type == GP_EVENT_BUTTON_PRESSED, "expected GP_EVENT_BUTTON_PRESSED", event.type);
+  ASSERTV(event.code == GP_BUTTON_A, "expected GP_BUTTON_A", event.code);
+  uint16_t firstTimestamp = event.timestamp;
+  ASSERT(GamePad.readEvent(&event), "expected analog event");
+  ASSERTV(event.type == GP_EVENT_ANALOG_UPDATE, "expected GP_EVENT_ANALOG_UPDATE", event.type);
+  ASSERTV(event.left == 0x01, "expected left == 0x01", event.left);
+  ASSERTV(event.right == 0x20, "expected right == 0x20", event.right);
+  ASSERTV(event.up == 0x3F, "expected up == 0x3F", event.up);
+  ASSERTV(event.down == 0x0A, "expected down == 0x0A", event.down);
+  ASSERTV((uint16_t)(event.timestamp - firstTimestamp) < 1000, "expected recent timestamp", event.timestamp);
+  ASSERT(GamePad.readEvent(&event), "expected error event");
+  ASSERTV(event.type == GP_EVENT_PARSE_ERROR, "expected GP_EVENT_PARSE_ERROR", event.type);
+  ASSERTV(event.code == GP_ERROR_NO_STATE_ENTRY, "expected GP_ERROR_NO_STATE_ENTRY", event.code);
+  ASSERT(!GamePad.readEvent(&event), "expected no more events");
+
+  DebugPrintln(" Test presses survive the per character API");
+  sendToGamePadProcessInput("XL00R00F00B00");
+  ASSERT(!GamePad.isXPressed(), "X is cleared by the next character");
+  ASSERT(GamePad.readEvent(&event), "expected button event");
+  ASSERTV(event.code == GP_BUTTON_X, "expected GP_BUTTON_X", event.code);
+
+  DebugPrintln(" Test full queue");
+  GamePad._clear();
+  for (int i = 0; i < GAMEPAD_EVENT_QUEUE_SIZE; i++) {
+    sendBufferToGamePadProcessInput("L00R00F00B00");
+  }
+  // Half the queue is kept free of joystick updates
+  ASSERTV(GamePad.availableEvents() == GAMEPAD_EVENT_QUEUE_SIZE / 2, "expected half full queue", GamePad.availableEvents());
+  ASSERTV(GamePad.getDroppedEvents() == GAMEPAD_EVENT_QUEUE_SIZE / 2, "expected dropped analog updates", GamePad.getDroppedEvents());
+  for (int i = 0; i < GAMEPAD_EVENT_QUEUE_SIZE; i++) {
+    sendBufferToGamePadProcessInput("Y");
+  }
+  ASSERTV(GamePad.availableEvents() == GAMEPAD_EVENT_QUEUE_SIZE, "expected full queue", GamePad.availableEvents());
+  ASSERTV(GamePad.getDroppedEvents() == GAMEPAD_EVENT_QUEUE_SIZE, "expected dropped events", GamePad.getDroppedEvents());
+  int buttonEvents = 0;
+  while (GamePad.readEvent(&event)) {
+    if (event.type == GP_EVENT_BUTTON_PRESSED) {
+      buttonEvents++;
+    }
+  }
+  ASSERTV(buttonEvents == GAMEPAD_EVENT_QUEUE_SIZE / 2, "expected button events", buttonEvents);
+  GamePad._clear();
+}
+#endif
+
+static int buttonCallbackCount;
+static uint8_t lastButton;
+static int analogCallbackCount;
+static uint8_t lastRight;
+static int errorCallbackCount;
+static uint8_t lastError;
+
+void onButtonPressedForTest(uint8_t button) {
+  buttonCallbackCount++;
+  lastButton = button;
+}
+
+void onAnalogUpdateForTest(uint8_t left, uint8_t right, uint8_t up, uint8_t down) {
+  analogCallbackCount++;
+  lastRight = right;
+}
+
+void onParseErrorForTest(uint8_t error) {
+  errorCallbackCount++;
+  lastError = error;
+}
+
+void testGamePadCallbacks() {
+  printTest(PSTR("GamePadCallbacks"));
+  buttonCallbackCount = analogCallbackCount = errorCallbackCount = 0;
+
+  GamePad._clear();
+  GamePad.onButtonPressed(onButtonPressedForTest);
+  GamePad.onAnalogUpdate(onAnalogUpdateForTest);
+  GamePad.onParseError(onParseErrorForTest);
+
+  sendBufferToGamePadProcessInput("BL00R7FF00B00?");
+  ASSERTV(buttonCallbackCount == 1, "expected 1 button callback", buttonCallbackCount);
+  ASSERTV(lastButton == GP_BUTTON_B, "expected GP_BUTTON_B", lastButton);
+  ASSERTV(analogCallbackCount == 1, "expected 1 analog callback", analogCallbackCount);
+  ASSERTV(lastRight == 0x7F, "expected right == 0x7F", lastRight);
+  ASSERTV(errorCallbackCount == 1, "expected 1 error callback", errorCallbackCount);
+  ASSERTV(lastError == GP_ERROR_NO_STATE_ENTRY, "expected GP_ERROR_NO_STATE_ENTRY", lastError);
+
+  // The per character API calls back on the character that completes the message
+  sendToGamePadProcessInput("L00R01F00B0");
+  ASSERTV(analogCallbackCount == 1, "expected no callback for a partial message", analogCallbackCount);
+  sendToGamePadProcessInput("0");
+  ASSERTV(analogCallbackCount == 2, "expected 2 analog callbacks", analogCallbackCount);
+  ASSERTV(lastRight == 0x01, "expected right == 0x01", lastRight);
+
+  GamePad.onButtonPressed(NULL);
+  GamePad.onAnalogUpdate(NULL);
+  GamePad.onParseError(NULL);
+  sendBufferToGamePadProcessInput("SL00R00F00B00?");
+  ASSERTV(buttonCallbackCount == 1, "expected button callback removed", buttonCallbackCount);
+  ASSERTV(analogCallbackCount == 2, "expected analog callback removed", analogCallbackCount);
+  ASSERTV(errorCallbackCount == 1, "expected error callback removed", errorCallbackCount);
+  GamePad._clear();
+}
+
+void testGamePadResync() {
+  printTest(PSTR("GamePadResync"));
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  GamePadEvent event;
+#endif
+
+  GamePad._clear();
+  GamePad.setResync(true);
+
+  DebugPrintln(" Test a dropped character costs one message");
+  sendBufferToGamePadProcessInput("L00R00F00B0L00R40F00B00");
+  ASSERT(GamePad.isRightPressed(), "expected second message");
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  ASSERTV(GamePad.availableEvents() == 2, "expected error and analog events", GamePad.availableEvents());
+  GamePad.readEvent(&event);
+  ASSERTV(event.type == GP_EVENT_PARSE_ERROR, "expected GP_EVENT_PARSE_ERROR", event.type);
+  GamePad.readEvent(&event);
+  ASSERTV(event.type == GP_EVENT_ANALOG_UPDATE, "expected GP_EVENT_ANALOG_UPDATE", event.type);
+#endif
+
+  DebugPrintln(" Test per character API");
+  GamePad._clear();
+  sendToGamePadProcessInput("L00R40F");
+  sendToGamePadProcessInput("Y");
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  ASSERTV(GamePad.availableEvents() == 2, "expected error and button events", GamePad.availableEvents());
+#endif
+  ASSERT(GamePad.isYPressed(), "expected Y from the breaking character");
+  ASSERT(!GamePad.isRightPressed(), "expected broken message ignored");
+
+  DebugPrintln(" Test one noise byte in a message is one error");
+  GamePad._clear();
+  errorCallbackCount = 0;
+  GamePad.onParseError(onParseErrorForTest);
+  sendBufferToGamePadProcessInput("L00R0?L00R40F00B00");
+  GamePad.onParseError(NULL);
+  ASSERTV(errorCallbackCount == 1, "expected 1 error", errorCallbackCount);
+  ASSERT(GamePad.isRightPressed(), "expected the message after the noise");
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  ASSERTV(GamePad.availableEvents() == 2, "expected error and analog events", GamePad.availableEvents());
+  GamePad.readEvent(&event);
+  ASSERTV(event.type == GP_EVENT_PARSE_ERROR, "expected GP_EVENT_PARSE_ERROR", event.type);
+  GamePad.readEvent(&event);
+  ASSERTV(event.type == GP_EVENT_ANALOG_UPDATE, "expected GP_EVENT_ANALOG_UPDATE", event.type);
+#endif
+
+  GamePad.setResync(false);
+  GamePad._clear();
+}
+
+// Send an analog message for a joystick offset of dx, dy from the center
+void sendJoystickPosition(int dx, int dy) {
+  static const char hexChars[] = "0123456789ABCDEF";
+  uint8_t values[4] = {
+    (uint8_t)(dx < 0 ? -dx : 0), (uint8_t)(dx > 0 ? dx : 0),
+    (uint8_t)(dy > 0 ? dy : 0), (uint8_t)(dy < 0 ? -dy : 0)
+  };
+  char frame[ANALOG_HEX_MESSAGE_LEN + 1];
+  const char *letters = "LRFB";
+  for (int i = 0; i < 4; i++) {
+    frame[i * 3] = letters[i];
+    frame[i * 3 + 1] = hexChars[values[i] >> 4];
+    frame[i * 3 + 2] = hexChars[values[i] & 0x0F];
+  }
+  frame[ANALOG_HEX_MESSAGE_LEN] = 0;
+  sendBufferToGamePadProcessInput(frame);
+}
+
+void testGamePadJoystick() {
+  printTest(PSTR("GamePadJoystick"));
+  GamePad._clear();
+  ASSERTV(GamePad.getAngle() == 0, "expected angle 0 when centered", GamePad.getAngle());
+  ASSERTV(GamePad.getRadius() == 0, "expected radius 0 when centered", GamePad.getRadius());
+
+  DebugPrintln(" Test the compass points");
+  sendJoystickPosition(255, 0);
+  ASSERTV(GamePad.getAngle() == 0, "expected right == 0 degrees", GamePad.getAngle());
+  ASSERTV(GamePad.getRadius() == 7, "expected full radius", GamePad.getRadius());
+  ASSERTV(GamePad.getx_axis() == 7, "expected x == 7", GamePad.getx_axis());
+  ASSERTV(GamePad.gety_axis() == 0, "expected y == 0", GamePad.gety_axis());
+  // A new position invalidates the cached results
+  sendJoystickPosition(0, 255);
+  ASSERTV(GamePad.getAngle() == 90, "expected up == 90 degrees", GamePad.getAngle());
+  ASSERTV(GamePad.gety_axis() == 7, "expected y == 7", GamePad.gety_axis());
+  sendJoystickPosition(-128, 0);
+  ASSERTV(GamePad.getAngle() == 180, "expected left == 180 degrees", GamePad.getAngle());
+  ASSERTV(GamePad.getRadius() == 4, "expected half radius", GamePad.getRadius());
+  ASSERTV(GamePad.getJoystickData(2) == -4, "expected x == -4", GamePad.getJoystickData(2));
+  sendJoystickPosition(0, -255);
+  ASSERTV(GamePad.getJoystickData(0) == 270, "expected down == 270 degrees", GamePad.getJoystickData(0));
+  ASSERT(GamePad.isPressed(1) && !GamePad.isPressed(0), "expected down pressed");
+  sendJoystickPosition(180, -180);
+  ASSERTV(GamePad.getAngle() == 315, "expected 315 degrees", GamePad.getAngle());
+  ASSERTV(GamePad.getXaxisData() == 5, "expected x == 5", GamePad.getXaxisData());
+  ASSERTV(GamePad.getYaxisData() == -5, "expected y == -5", GamePad.getYaxisData());
+
+#if defined(BITBUS_HOST)
+  // Host only: soft float atan2() and sqrt() would not leave the Nano room for the rest
+  DebugPrintln(" Test against floating point");
+  int worstAngle = 0;
+  for (int dx = -255; dx <= 255; dx += 15) {
+    for (int dy = -255; dy <= 255; dy += 15) {
+      sendJoystickPosition(dx, dy);
+      if (0 == dx && 0 == dy) {
+        continue;
+      }
+      int expected = (int)lround(atan2(dy, dx) * 180 / M_PI);
+      int error = abs(((int)GamePad.getAngle() - expected + 720) % 360);
+      if (error > 180) {
+        error = 360 - error;
+      }
+      if (error > worstAngle) {
+        worstAngle = error;
+      }
+      float radius = sqrt((float)dx * dx + (float)dy * dy) * 7 / 255;
+      radius = (radius > 7) ? 7 : radius;
+      ASSERTV(fabs(GamePad.getRadius() - radius) <= 0.55, "expected radius near float", dx * 1000 + dy);
+    }
+  }
+  ASSERTV(worstAngle <= 1, "expected angle within a degree", worstAngle);
+#endif
+
+  DebugPrintln(" Test isPressed()");
+  GamePad._clear();
+  sendBufferToGamePadProcessInput("Y");
+  ASSERT(GamePad.isPressed(7), "expected circle");
+  ASSERT(!GamePad.isPressed(6) && !GamePad.isPressed(10), "expected only circle");
+  GamePad._clear();
+}
+
+void testBitBusTransport() {
+  printTest(PSTR("BitBusTransport"));
+  static const char session[] = "L00R40F00B00AL00R00F00B00";
+  BitBusT<BitBusMemoryTransport> memoryBus;
+
+  GamePad._clear();
+  memoryBus.begin((const uint8_t *)session, 13);
+  memoryBus.processInput();
+  ASSERT(GamePad.isRightPressed(), "expected right from the memory transport");
+  ASSERTV(GamePad.getRightPosition() == 0x40, "expected right == 0x40", GamePad.getRightPosition());
+  ASSERT(GamePad.isAPressed(), "expected A from the memory transport");
+  ASSERTV(memoryBus.available() == 0, "expected transport drained", memoryBus.available());
+
+  // The whole session in one call
+  memoryBus.begin((const uint8_t *)session, strlen(session));
+  memoryBus.processInput();
+  ASSERT(!GamePad.isRightPressed(), "expected joystick centered");
+  ASSERT(GamePad.isAPressed(), "expected A within the same call");
+  memoryBus.processInput();
+  ASSERT(!GamePad.isAPressed(), "expected A cleared by the next call");
+  GamePad._clear();
+}
+
+void testBitBusBudget() {
+  printTest(PSTR("BitBusBudget"));
+  static const char session[] = "L00R40F00B00AL00R00F00B00";
+  BitBusT<BitBusMemoryTransport> memoryBus;
+  int pending;
+
+  GamePad._clear();
+  memoryBus.begin((const uint8_t *)session, strlen(session));
+  pending = memoryBus.processInput(5U);
+  ASSERTV(pending == 20, "expected 20 bytes pending", pending);
+  ASSERT(!GamePad.isRightPressed(), "expected message not finished yet");
+
+  // The message cut off by the budget is finished by the next call
+  pending = memoryBus.processInput(8U);
+  ASSERTV(pending == 12, "expected 12 bytes pending", pending);
+  ASSERTV(GamePad.getRightPosition() == 0x40, "expected right == 0x40", GamePad.getRightPosition());
+  ASSERT(GamePad.isAPressed(), "expected A");
+
+  pending = memoryBus.processInputMicros(0);
+  ASSERTV(pending == 12, "expected nothing processed without a budget", pending);
+  ASSERT(GamePad.isRightPressed(), "expected joystick unchanged");
+
+  pending = memoryBus.processInputMicros(1000000UL);
+  ASSERTV(pending == 0, "expected everything processed", pending);
+  ASSERT(!GamePad.isRightPressed(), "expected joystick centered");
+  GamePad._clear();
+}
+
+void testBitBusMultipleInstances() {
+  printTest(PSTR("BitBusMultipleInstances"));
+  static const char session1[] = "L00R40F00B00A";
+  static const char session2[] = "L00R00F40B00B";
+  GamePadModule pad1;
+  GamePadModule pad2;
+  BitBusT<BitBusMemoryTransport> bus1(pad1);
+  BitBusT<BitBusMemoryTransport> bus2(pad2);
+  BitBusRoundRobin<2> buses;
+  int pending;
+
+  DebugPrintln(" Test interleaved partial messages stay apart");
+  GamePad._clear();
+  ASSERT(&BitBus.getGamePad() == &GamePad, "expected BitBus to feed GamePad");
+  ASSERT(&bus2.getGamePad() == &pad2, "expected bus2 to feed pad2");
+  pad1._processInput((const uint8_t *)session1, 5);
+  pad2._processInput((const uint8_t *)session2, 8);
+  pad1._processInput((const uint8_t *)session1 + 5, 8);
+  pad2._processInput((const uint8_t *)session2 + 8, 5);
+  ASSERTV(pad1.getRightPosition() == 0x40, "expected pad1 right == 0x40", pad1.getRightPosition());
+  ASSERTV(pad1.getUpPosition() == 0, "expected pad1 up == 0", pad1.getUpPosition());
+  ASSERT(pad1.isAPressed() && !pad1.isBPressed(), "expected A on pad1 only");
+  ASSERTV(pad2.getUpPosition() == 0x40, "expected pad2 up == 0x40", pad2.getUpPosition());
+  ASSERTV(pad2.getRightPosition() == 0, "expected pad2 right == 0", pad2.getRightPosition());
+  ASSERT(pad2.isBPressed() && !pad2.isAPressed(), "expected B on pad2 only");
+  ASSERT(!GamePad.isAPressed() && !GamePad.isBPressed(), "expected GamePad untouched");
+  ASSERTV(pad1.availableEvents() == 0, "expected no events without a queue", pad1.availableEvents());
+
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  DebugPrintln(" Test an extra instance with its own event queue");
+  static GamePadEventQueue pad3Events;
+  GamePadModule pad3(pad3Events);
+  pad3._processInput((const uint8_t *)session1, strlen(session1));
+  ASSERTV(pad3.availableEvents() == 2, "expected analog and A events", pad3.availableEvents());
+  ASSERTV(GamePad.availableEvents() == 0, "expected GamePad's queue untouched", GamePad.availableEvents());
+#endif
+
+  DebugPrintln(" Test round robin budget");
+  pad1._clear();
+  pad2._clear();
+  ASSERT(buses.add(bus1), "expected add bus1");
+  ASSERT(buses.add(bus2), "expected add bus2");
+  ASSERT(!buses.add(BitBus), "expected no room for a third bus");
+  bus1.begin((const uint8_t *)session1, strlen(session1));
+  bus2.begin((const uint8_t *)session2, strlen(session2));
+  pending = buses.processInput(10U);
+  ASSERTV(pending == 16, "expected 5 bytes read from each bus", pending);
+  pending = buses.processInput(100U);
+  ASSERTV(pending == 0, "expected everything processed", pending);
+  ASSERT(pad1.isAPressed() && pad1.getRightPosition() == 0x40, "expected pad1 from bus1");
+  ASSERT(pad2.isBPressed() && pad2.getUpPosition() == 0x40, "expected pad2 from bus2");
+
+  // With a budget of one byte, the buses take turns
+  bus1.begin((const uint8_t *)session1, strlen(session1));
+  bus2.begin((const uint8_t *)session2, strlen(session2));
+  pending = buses.processInput(1U);
+  ASSERTV(bus1.available() == 12 && bus2.available() == 13, "expected bus1 first", pending);
+  pending = buses.processInput(1U);
+  ASSERTV(bus1.available() == 12 && bus2.available() == 12, "expected bus2 next", pending);
+  ASSERTV(pending == 24, "expected 24 bytes pending", pending);
+
+  pending = buses.processInputMicros(1000000UL);
+  ASSERTV(pending == 0, "expected everything processed", pending);
+  ASSERT(pad1.isAPressed() && pad2.isBPressed(), "expected both buttons");
+  GamePad._clear();
+}
+
+void testBitBusCoalescing() {
+  printTest(PSTR("BitBusCoalescing"));
+  static const char backlog[] = "L00R10F00B00AL00R20F00B00L00R30F00B00BL00R40F00B00";
+  BitBusT<BitBusMemoryTransport> memoryBus;
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  GamePadEvent event;
+#endif
+
+  GamePad._clear();
+  GamePad.setCoalescing(true);
+  memoryBus.begin((const uint8_t *)backlog, strlen(backlog));
+  memoryBus.processInput();
+  ASSERTV(GamePad.getRightPosition() == 0x40, "expected the newest position", GamePad.getRightPosition());
+  ASSERT(GamePad.isAPressed() && GamePad.isBPressed(), "expected every button");
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  ASSERTV(GamePad.availableEvents() == 3, "expected 2 button events and 1 analog", GamePad.availableEvents());
+  GamePad.readEvent(&event);
+  ASSERTV(event.code == GP_BUTTON_A, "expected GP_BUTTON_A", event.code);
+  GamePad.readEvent(&event);
+  ASSERTV(event.code == GP_BUTTON_B, "expected GP_BUTTON_B", event.code);
+  GamePad.readEvent(&event);
+  ASSERTV(event.type == GP_EVENT_ANALOG_UPDATE, "expected GP_EVENT_ANALOG_UPDATE", event.type);
+  ASSERTV(event.right == 0x40, "expected the newest position in the event", event.right);
+#endif
+
+  DebugPrintln(" Test a position held back by the budget is applied");
+  GamePad._clear();
+  memoryBus.begin((const uint8_t *)backlog, strlen(backlog));
+  memoryBus.processInput(15U);
+  ASSERTV(GamePad.getRightPosition() == 0x10, "expected the first position", GamePad.getRightPosition());
+
+  DebugPrintln(" Test input lost to an overflow");
+  GamePad._clear();
+  errorCallbackCount = 0;
+  GamePad.onParseError(onParseErrorForTest);
+  sendBufferToGamePadProcessInput("L00R10F");
+  GamePad._inputLost();
+  sendBufferToGamePadProcessInput("00B00L00R20F00B00");
+  GamePad._flushCoalesced();
+  GamePad.onParseError(NULL);
+  ASSERTV(GamePad.getRightPosition() == 0x20, "expected the message after the gap", GamePad.getRightPosition());
+  ASSERTV(errorCallbackCount == 0, "expected no errors from the cut off message", errorCallbackCount);
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  ASSERTV(GamePad.availableEvents() == 1, "expected only the analog event", GamePad.availableEvents());
+#endif
+
+  DebugPrintln(" Test button presses after a gap are kept");
+  static const struct {
+    const char *input;
+    uint8_t skipped;
+  } gaps[] = {
+    {"A", 0}, {"C", 0}, {"AB", 0}, {"AL00R20F00B00", 0}, {"0F00B00A", 7},
+    {"2AF00B00L00", 8}, {"B00L", 3}, {"2AB00X", 5}, {"A0F00", 5},
+  };
+  for (size_t i = 0; i < sizeof(gaps) / sizeof(gaps[0]); i++) {
+    size_t skipped = mb.skipToMessageStart((const uint8_t *)gaps[i].input, strlen(gaps[i].input));
+    ASSERTV(skipped == gaps[i].skipped, "expected to skip to the message start", skipped);
+  }
+  mb.clear();
+  GamePad._clear();
+  GamePad._inputLost();
+  sendBufferToGamePadProcessInput("A");
+  ASSERT(GamePad.isAPressed(), "expected the A press after the gap");
+
+  GamePad.setCoalescing(false);
+  GamePad._clear();
+}
+
+void testBitBusCapture() {
+  printTest(PSTR("BitBusCapture"));
+  static const char session[] = "L00R40F00B00A";
+  static uint8_t captureBuffer[40];
+  uint8_t log[BITBUS_CAPTURE_HEADER_LEN + sizeof(captureBuffer)];
+  BitBusRamCapture capture(captureBuffer, sizeof(captureBuffer));
+  BitBusT<BitBusMemoryTransport> memoryBus;
+
+  DebugPrintln(" Test capture and replay");
+  GamePad._clear();
+  capture.start();
+  memoryBus.begin((const uint8_t *)session, strlen(session));
+  memoryBus.processInput();
+  capture.stop();
+  // Stopped captures don't record
+  memoryBus.begin((const uint8_t *)session, strlen(session));
+  memoryBus.processInput();
+
+  uint16_t len = capture.read(log, sizeof(log));
+  ASSERTV(len == BITBUS_CAPTURE_HEADER_LEN + 2 + strlen(session), "expected one record", len);
+  ASSERTV(log[BITBUS_CAPTURE_HEADER_LEN + 1] == strlen(session), "expected record length", log[BITBUS_CAPTURE_HEADER_LEN + 1]);
+  ASSERT(!memcmp(log + BITBUS_CAPTURE_HEADER_LEN + 2, session, strlen(session)), "expected captured bytes");
+
+  BitBusReplay replay;
+  ASSERT(replay.begin(log, len), "expected replay to accept the capture");
+  BitBusT<BitBusStreamTransport<BitBusReplay> > replayBus;
+  replayBus.begin(replay);
+  GamePad._clear();
+  replayBus.processInput();
+  ASSERTV(GamePad.getRightPosition() == 0x40, "expected right == 0x40 from the replay", GamePad.getRightPosition());
+  ASSERT(GamePad.isAPressed(), "expected A from the replay");
+  ASSERT(replay.finished(), "expected replay finished");
+
+  DebugPrintln(" Test oldest records dropped when full");
+  capture.clear();
+  capture.start();
+  for (int i = 0; i < 3; i++) {
+    memoryBus.begin((const uint8_t *)session + i, 12);
+    memoryBus.processInput();
+  }
+  capture.stop();
+  len = capture.read(log, sizeof(log));
+  // Three 14 byte records don't fit in 40 bytes
+  ASSERTV(len == BITBUS_CAPTURE_HEADER_LEN + 28, "expected two records", len);
+  ASSERTV(log[BITBUS_CAPTURE_HEADER_LEN + 2] == session[1], "expected second record first", log[BITBUS_CAPTURE_HEADER_LEN + 2]);
+  GamePad._clear();
+}
+
+#if BITBUS_STATS
+void testBitBusStats() {
+  printTest(PSTR("BitBusStats"));
+  static const char session[] = "L00R40F00B00A?L0G";
+  BitBusT<BitBusMemoryTransport> memoryBus;
+
+  GamePad._clear();
+  BitBusResetStats();
+  memoryBus.begin((const uint8_t *)session, strlen(session));
+  memoryBus.processInput();
+  const BitBusStats &stats = BitBusGetStats();
+  ASSERTV(stats.bytes == strlen(session), "expected all bytes counted", stats.bytes);
+  ASSERTV(stats.maxBytesPerCall == strlen(session), "expected max bytes per call", stats.maxBytesPerCall);
+  ASSERTV(stats.frames[MT_ANALOG_POSITION] == 1, "expected 1 analog frame", stats.frames[MT_ANALOG_POSITION]);
+  ASSERTV(stats.frames[MT_BUTTON_A] == 1, "expected 1 A frame", stats.frames[MT_BUTTON_A]);
+  ASSERTV(stats.errors[GP_ERROR_NO_STATE_ENTRY - 100] == 2, "expected 2 no state entry errors",
+          stats.errors[GP_ERROR_NO_STATE_ENTRY - 100]);
+  // Only the partial "L0" message was thrown away, '?' arrived between messages
+  ASSERTV(stats.resets == 1, "expected 1 reset", stats.resets);
+  ASSERTV(stats.overflows == 0, "expected no overflows", stats.overflows);
+
+  uint16_t calls = 0;
+  uint16_t intervals = 0;
+  for (int i = 0; i < BITBUS_STATS_BUCKETS; i++) {
+    calls += stats.callTime[i];
+    intervals += stats.frameInterval[i];
+  }
+  ASSERTV(calls == 1, "expected 1 call timed", calls);
+  ASSERTV(intervals == 1, "expected 1 frame interval", intervals);
+
+  BitBusPrintStats();
+  BitBusResetStats();
+  ASSERTV(stats.bytes == 0, "expected reset", stats.bytes);
+  GamePad._clear();
+}
+#endif
+
+/*
+ * Times the parser and the getters in CPU cycles. The numbers are only
+ * meaningful on real hardware; the host build checks the timing runs and
+ * leaves the report out.
+ */
+enum {
+  BENCH_HEX_BYTE,
+  BENCH_DEC_BYTE,
+  BENCH_BUTTON,
+  BENCH_HEX_BUFFER,
+  BENCH_BUTTON_GETTER,
+  BENCH_POSITION_GETTER,
+  BENCH_ANGLE,
+};
+
+#define BENCH_ROUNDS 20
+
+// Feed a message to mb a byte at a time, timing each byte
+void benchMessageBytes(uint8_t region, const char *message, PGM_P label) {
+  mb.clear();
+  for (const char *c = message; *c; c++) {
+    BenchStart(region);
+    mb.processInput(*c);
+    BenchStop(region, label);
+  }
+}
+
+void benchmarkParser() {
+  printTest(PSTR("Benchmark"));
+  static const char hexMessage[] = "L20RFFF00B7F";
+  static const char decMessage[] = "L032R255F000B127";
+  volatile bool pressed;
+  volatile uint8_t position;
+  volatile uint16_t angle = 0;
+
+  GamePad._clear();
+  BenchBegin();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    benchMessageBytes(BENCH_HEX_BYTE, hexMessage, PSTR("mb.processInput(char) hex"));
+    benchMessageBytes(BENCH_DEC_BYTE, decMessage, PSTR("mb.processInput(char) dec"));
+    benchMessageBytes(BENCH_BUTTON, "A", PSTR("mb.processInput(char) button"));
+
+    size_t consumed;
+    mb.clear();
+    BENCH_START(BENCH_HEX_BUFFER);
+    mb.processInput((const uint8_t *)hexMessage, strlen(hexMessage), &consumed);
+    BENCH_STOP(BENCH_HEX_BUFFER, "mb.processInput(buf) hex message");
+
+    sendBufferToGamePadProcessInput("L20RFFF00B7FA");
+    BENCH_START(BENCH_BUTTON_GETTER);
+    pressed = GamePad.isAPressed();
+    BENCH_STOP(BENCH_BUTTON_GETTER, "GamePad.isAPressed()");
+    BENCH_START(BENCH_POSITION_GETTER);
+    position = GamePad.getLeftPosition();
+    BENCH_STOP(BENCH_POSITION_GETTER, "GamePad.getLeftPosition()");
+#if GAMEPAD_DABBLE_COMPAT
+    BENCH_START(BENCH_ANGLE);
+    angle = GamePad.getAngle();
+    BENCH_STOP(BENCH_ANGLE, "GamePad.getAngle()");
+#endif
+  }
+  BenchEnd();
+  (void)pressed;
+  (void)position;
+  (void)angle;
+
+#if defined(__AVR__)
+  BenchReport();
+#else
+  // Cycles from micros() here, not worth printing
+  DebugPrintln("Benchmark: no cycle counts off AVR, report skipped");
+#endif
+  ASSERTV(BenchGetRegion(BENCH_HEX_BYTE).count == BENCH_ROUNDS * strlen(hexMessage), "expected every hex byte timed",
+          BenchGetRegion(BENCH_HEX_BYTE).count);
+  ASSERTV(BenchGetRegion(BENCH_BUTTON_GETTER).count == BENCH_ROUNDS, "expected every getter call timed",
+          BenchGetRegion(BENCH_BUTTON_GETTER).count);
+  const BenchRegion &dec = BenchGetRegion(BENCH_DEC_BYTE);
+  ASSERT(dec.min <= dec.total / dec.count && dec.total / dec.count <= dec.max, "expected min <= avg <= max");
+  mb.clear();
+  GamePad._clear();
+}
+
 void unitTest() {
-  Serial.println("************* START OF UNIT TEST RUN ******************");
+  DebugPrintln("************* START OF UNIT TEST RUN ******************");
 
   assertionFailures = 0;
   testMessageBufferInternals();
+  testParserTables();
   testMessageBufferActionButtons();
   testMessageBufferAnalogPositionDec();
   testMessageBufferAnalogPositionHex();
   testMessageBufferInvalidInput();
+  testMessageBufferAnalogFastPath();
+  testMessageBufferResync();
   testGamePadInternal();
+  testGamePadBufferInput();
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  testGamePadEvents();
+#endif
+  testGamePadCallbacks();
+  testGamePadResync();
+  testGamePadJoystick();
+  testBitBusTransport();
+  testBitBusBudget();
+  testBitBusMultipleInstances();
+  testBitBusCoalescing();
+  testBitBusCapture();
+#if BITBUS_STATS
+  testBitBusStats();
+#endif
+  benchmarkParser();
 
   if(assertionFailures) {
-    Serial.print("FAIL: ");
+    DebugPrint("FAIL: ");
     Serial.print(assertionFailures);
-    Serial.println(" tests failed.");
+    DebugPrintln(" tests failed.");
   } else {
-    Serial.println("All tests passed.");
+    DebugPrintln("All tests passed.");
   }
   Serial.println();
-  Serial.println("************* END OF UNIT TEST RUN ******************");
+  DebugPrintln("************* END OF UNIT TEST RUN ******************");
 }
 
 void loop() {
@@ -0,0 +1,166 @@
+/*
+ * Firmware for extras/cycles/cycles.sh, not for a real board: it prints
+ * nothing.
+ *
+ * Runs the parser over the canonical streams with interrupts off, marking
+ * the start and end of each timed region by writing GPIOR0. cycles_sim
+ * counts the cycles simavr executes between the two writes. The region ids
+ * are the ones in cycles.txt.
+ *
+ * The old hand written parser in reference_parser.h is timed over the same
+ * streams, one byte at a time, to compare with the byte regions.
+ */
+#include <avr/sleep.h>
+
+#include <BitBus.h>
+#include <GamePad.h>
+#include <MessageBuffer.h>
+
+#include "reference_parser.h"
+
+#define STREAM_LEN 240
+// Bytes waiting in the transport for each BitBus.processInput() call
+#define CALL_LEN 48
+
+// GPIOR0 values other than a region id
+#define REGION_STOP 0x80
+#define REGION_DONE 0xFF
+
+// Kinds of region, timed over each stream
+enum {
+  RK_BYTE,    // _MessageBuffer::processInput(int), per byte
+  RK_BUFFER,  // _MessageBuffer::processInput(buf, len, &consumed), per byte
+  RK_CALL,    // BitBusT::processInput(), per call
+  RK_COUNT,
+};
+
+enum { STREAM_HEX, STREAM_DEC, STREAM_BUTTONS, STREAM_GARBAGE, STREAM_COUNT };
+
+static uint8_t stream[STREAM_LEN];
+static volatile int sink;
+
+// The BitBus singleton reads a SoftwareSerial, this drains memory through the same code
+static BitBusT<BitBusMemoryTransport> memoryBus;
+
+// Units is what the region's cycles are divided by: bytes or calls
+static inline void regionStart(uint8_t id, uint16_t units) {
+  GPIOR1 = units & 0xFF;
+  GPIOR2 = units >> 8;
+  asm volatile("" ::: "memory");
+  GPIOR0 = id;
+  asm volatile("" ::: "memory");
+}
+
+static inline void regionStop() {
+  asm volatile("" ::: "memory");
+  GPIOR0 = REGION_STOP;
+  asm volatile("" ::: "memory");
+}
+
+// Small deterministic generator so every run sees the same streams
+static uint32_t lcgState = 12345;
+static uint8_t lcg() {
+  lcgState = lcgState * 1103515245UL + 12345UL;
+  return lcgState >> 16;
+}
+
+static uint8_t appendValue(uint8_t *buf, uint8_t value, bool hex) {
+  static const char hexChars[] = "0123456789ABCDEF";
+  if (hex) {
+    buf[0] = hexChars[value >> 4];
+    buf[1] = hexChars[value & 0x0F];
+    return 2;
+  }
+  buf[0] = '0' + value / 100;
+  buf[1] = '0' + value / 10 % 10;
+  buf[2] = '0' + value % 10;
+  return 3;
+}
+
+// Fill stream with whole messages of the given kind, or random bytes
+static void makeStream(uint8_t kind) {
+  static const char buttons[] = MESSAGE_BUTTON_LETTERS;
+  static const char fields[] = MESSAGE_FIELD_LETTERS;
+  uint8_t len = 0;
+  while (len < STREAM_LEN) {
+    switch (kind) {
+    case STREAM_HEX:
+    case STREAM_DEC:
+      for (uint8_t i = 0; i < ANALOG_FIELDS; i++) {
+        stream[len++] = fields[i];
+        len += appendValue(stream + len, lcg(), STREAM_HEX == kind);
+      }
+      break;
+    case STREAM_BUTTONS:
+      stream[len++] = buttons[lcg() % (sizeof(buttons) - 1)];
+      break;
+    default:
+      stream[len++] = lcg();
+      break;
+    }
+  }
+}
+
+static void timeBytes(uint8_t id) {
+  _MessageBuffer mb;
+  int result = 0;
+  regionStart(id, STREAM_LEN);
+  for (uint8_t i = 0; i < STREAM_LEN; i++) {
+    result += mb.processInput(stream[i]);
+  }
+  regionStop();
+  sink = result;
+}
+
+static void timeReference(uint8_t id) {
+  reference::Parser parser;
+  int result = 0;
+  regionStart(id, STREAM_LEN);
+  for (uint8_t i = 0; i < STREAM_LEN; i++) {
+    result += parser.processInput(stream[i]);
+  }
+  regionStop();
+  sink = result;
+}
+
+static void timeBuffer(uint8_t id) {
+  _MessageBuffer mb;
+  int result = 0;
+  regionStart(id, STREAM_LEN);
+  for (size_t i = 0, consumed; i < STREAM_LEN; i += consumed) {
+    result += mb.processInput(stream + i, STREAM_LEN - i, &consumed);
+  }
+  regionStop();
+  sink = result;
+}
+
+static void timeCalls(uint8_t id) {
+  regionStart(id, STREAM_LEN / CALL_LEN);
+  for (uint8_t i = 0; i < STREAM_LEN; i += CALL_LEN) {
+    memoryBus.begin(stream + i, CALL_LEN);
+    memoryBus.processInput();
+  }
+  regionStop();
+  sink = GamePad.getXaxisData();
+}
+
+void setup() {
+  // Timer 0 would otherwise add its interrupt to whichever region it lands in
+  noInterrupts();
+  for (uint8_t s = 0; s < STREAM_COUNT; s++) {
+    makeStream(s);
+    uint8_t id = 1 + s * RK_COUNT;
+    timeBytes(id + RK_BYTE);
+    timeBuffer(id + RK_BUFFER);
+    timeCalls(id + RK_CALL);
+    // After all the regions of the library
+    timeReference(1 + STREAM_COUNT * RK_COUNT + s);
+  }
+  GPIOR0 = REGION_DONE;
+  // simavr stops on a sleep with interrupts off
+  sleep_enable();
+  sleep_cpu();
+}
+
+void loop() {
+}
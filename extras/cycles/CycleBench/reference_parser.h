@@ -0,0 +1,247 @@
+/*
+ * The hand written parser that the generated tables in GamePad.cpp replaced,
+ * cut down to processInput(int) without resync. extras/host/parser_test
+ * checks the new parser against it and times the two on the host, CycleBench
+ * counts the cycles of both on the AVR.
+ *
+ * The table, the index into it and the functions called from it are as
+ * they were, apart from the names. The table is in flash where the old one
+ * was, but the index is built in RAM at startup, which saves the old parser
+ * a cycle on each of its three index reads on AVR.
+ */
+#ifndef ReferenceParser_h
+#define ReferenceParser_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "BitBusPlatform.h"
+#include "GamePad.h"
+#include "MessageBuffer.h"
+
+namespace reference {
+
+enum State {
+  START = 0,
+  L_DIGIT_1 = 11, L_DIGIT_2 = 12, L_DIGIT_3_OR_R = 13,
+  WAIT_R = 20, R_DIGIT_1 = 21, R_DIGIT_2 = 22, R_DIGIT_3_OR_F = 23,
+  WAIT_F = 30, F_DIGIT_1 = 31, F_DIGIT_2 = 32, F_DIGIT_3_OR_B = 33,
+  WAIT_B = 40, B_DIGIT_1 = 41, B_DIGIT_2 = 42, B_DIGIT_3 = 43,
+  READY = 50,
+};
+
+class Parser;
+
+struct StateEntry {
+  uint8_t currentState;
+  uint8_t inputChar;
+  int (Parser::*stateFunc)(int, State *);
+  uint8_t nextState;
+  uint8_t messageType;
+};
+
+#define DIGIT (uint8_t)0xFE
+#define NO_ENTRY (uint8_t)0xFF
+#define NO_ROW (uint8_t)0xFF
+
+class Parser
+{
+public:
+  Parser() { clear(); }
+
+  void clear() {
+    messageType = MT_UNKNOWN;
+    leftValue = rightValue = upValue = downValue = 0;
+    state = START;
+    digitBuf[0] = digitBuf[1] = 0;
+    isHex = false;
+  }
+
+  // Returns: 0 for a complete message, 1 for a partial one, otherwise an error
+  int processInput(int inputChar);
+
+  int parseDigit1(int c, State *next) { digitBuf[0] = c; return 0; }
+  int parseDigit2(int c, State *next) { digitBuf[1] = c; return 0; }
+  int parseDigit2B(int c, State *next) {
+    digitBuf[1] = c;
+    if (isHex) {
+      parseBDigits(0xFF, next);
+      *next = READY;
+    }
+    return 0;
+  }
+  int parseLDecDigits(int c, State *next) { isHex = false; return parseDigits(c, &leftValue); }
+  int parseLHexDigits(int c, State *next) { isHex = true; return parseDigits(c, &leftValue); }
+  int parseRDigits(int c, State *next) { return parseDigits(c, &rightValue); }
+  int parseFDigits(int c, State *next) { return parseDigits(c, &upValue); }
+  int parseBDigits(int c, State *next) { return parseDigits(c, &downValue); }
+
+  uint8_t messageType;
+  uint8_t leftValue;
+  uint8_t rightValue;
+  uint8_t upValue;
+  uint8_t downValue;
+  State state;
+
+private:
+  static bool isDecDigit(int c) { return c <= '9' && c >= '0'; }
+  static uint8_t asciiToInt(int c) {
+    return (c <= '9' && c >= '0') ? c - '0' : (c <= 'F' && c >= 'A') ? 10 + c - 'A' : 0xFF;
+  }
+  int parseDigits(int c, uint8_t *valuePtr) {
+    uint8_t value = 0;
+    if (isHex) {
+      if (isDecDigit(c)) {
+        return GP_ERROR_UNEXPECTED_DEC_DIGIT;
+      }
+      value = (uint8_t)(asciiToInt(digitBuf[0]) << 4) + asciiToInt(digitBuf[1]);
+    } else {
+      uint8_t hundreds = asciiToInt(digitBuf[0]), tens = asciiToInt(digitBuf[1]), ones = asciiToInt(c);
+      if (hundreds > 9 || tens > 9 || ones > 9) {
+        return GP_ERROR_INVALID_DEC_DIGIT;
+      }
+      value = hundreds * 100 + tens * 10 + ones;
+    }
+    *valuePtr = value;
+    return 0;
+  }
+  static uint8_t lookup(int state, int inputChar);
+
+  char digitBuf[2];
+  bool isHex;
+};
+
+static const StateEntry stateTable[] BITBUS_FLASH = {
+  {START,          'S',   NULL,                       READY,          MT_START_BUTTON},
+  {START,          'C',   NULL,                       READY,          MT_SELECT},
+  {START,          'A',   NULL,                       READY,          MT_BUTTON_A},
+  {START,          'B',   NULL,                       READY,          MT_BUTTON_B},
+  {START,          'X',   NULL,                       READY,          MT_BUTTON_X},
+  {START,          'Y',   NULL,                       READY,          MT_BUTTON_Y},
+  {START,          'L',   NULL,                       L_DIGIT_1,      MT_ANALOG_POSITION},
+  {WAIT_R,         'R',   NULL,                       R_DIGIT_1,      MT_ANALOG_POSITION},
+  {WAIT_B,         'B',   NULL,                       B_DIGIT_1,      MT_ANALOG_POSITION},
+  {WAIT_F,         'F',   NULL,                       F_DIGIT_1,      MT_ANALOG_POSITION},
+  {L_DIGIT_1,      DIGIT, &Parser::parseDigit1,       L_DIGIT_2,      MT_ANALOG_POSITION},
+  {L_DIGIT_2,      DIGIT, &Parser::parseDigit2,       L_DIGIT_3_OR_R, MT_ANALOG_POSITION},
+  {L_DIGIT_3_OR_R, 'R',   &Parser::parseLHexDigits,   R_DIGIT_1,      MT_ANALOG_POSITION},
+  {L_DIGIT_3_OR_R, DIGIT, &Parser::parseLDecDigits,   WAIT_R,         MT_ANALOG_POSITION},
+  {R_DIGIT_1,      DIGIT, &Parser::parseDigit1,       R_DIGIT_2,      MT_ANALOG_POSITION},
+  {R_DIGIT_2,      DIGIT, &Parser::parseDigit2,       R_DIGIT_3_OR_F, MT_ANALOG_POSITION},
+  {R_DIGIT_3_OR_F, 'F',   &Parser::parseRDigits,      F_DIGIT_1,      MT_ANALOG_POSITION},
+  {R_DIGIT_3_OR_F, DIGIT, &Parser::parseRDigits,      WAIT_F,         MT_ANALOG_POSITION},
+  {F_DIGIT_1,      DIGIT, &Parser::parseDigit1,       F_DIGIT_2,      MT_ANALOG_POSITION},
+  {F_DIGIT_2,      DIGIT, &Parser::parseDigit2,       F_DIGIT_3_OR_B, MT_ANALOG_POSITION},
+  {F_DIGIT_3_OR_B, 'B',   &Parser::parseFDigits,      B_DIGIT_1,      MT_ANALOG_POSITION},
+  {F_DIGIT_3_OR_B, DIGIT, &Parser::parseFDigits,      WAIT_B,         MT_ANALOG_POSITION},
+  {B_DIGIT_1,      DIGIT, &Parser::parseDigit1,       B_DIGIT_2,      MT_ANALOG_POSITION},
+  {B_DIGIT_2,      DIGIT, &Parser::parseDigit2B,      B_DIGIT_3,      MT_ANALOG_POSITION},
+  {B_DIGIT_3,      DIGIT, &Parser::parseBDigits,      READY,          MT_ANALOG_POSITION},
+};
+
+enum { CC_OTHER, CC_DEC, CC_HEX, CC_A, CC_B, CC_C, CC_F, CC_L, CC_R, CC_S, CC_X, CC_Y, CC_COUNT };
+
+static uint8_t charClass(int c) {
+  if (c >= '0' && c <= '9') return CC_DEC;
+  switch (c) {
+  case 'A': return CC_A;
+  case 'B': return CC_B;
+  case 'C': return CC_C;
+  case 'D': case 'E': return CC_HEX;
+  case 'F': return CC_F;
+  case 'L': return CC_L;
+  case 'R': return CC_R;
+  case 'S': return CC_S;
+  case 'X': return CC_X;
+  case 'Y': return CC_Y;
+  default: return CC_OTHER;
+  }
+}
+
+// The index the old parser kept in flash, built here from the old character classes
+struct Index {
+  uint8_t charTable[128];
+  uint8_t stateRowTable[READY + 1];
+  uint8_t transitionTable[16][CC_COUNT];
+
+  Index() {
+    for (int c = 0; c < 128; c++) {
+      charTable[c] = charClass(c);
+    }
+    static const uint8_t rowStates[16] = {
+      START, WAIT_R, WAIT_B, WAIT_F, L_DIGIT_1, L_DIGIT_2, L_DIGIT_3_OR_R, R_DIGIT_1,
+      R_DIGIT_2, R_DIGIT_3_OR_F, F_DIGIT_1, F_DIGIT_2, F_DIGIT_3_OR_B, B_DIGIT_1, B_DIGIT_2, B_DIGIT_3,
+    };
+    memset(stateRowTable, NO_ROW, sizeof(stateRowTable));
+    static const char representative[CC_COUNT] = {'?', '0', 'D', 'A', 'B', 'C', 'F', 'L', 'R', 'S', 'X', 'Y'};
+    for (int row = 0; row < 16; row++) {
+      stateRowTable[rowStates[row]] = row;
+      for (int cc = 0; cc < CC_COUNT; cc++) {
+        transitionTable[row][cc] = scan(rowStates[row], representative[cc]);
+      }
+    }
+  }
+
+  static uint8_t scan(int state, int c) {
+    bool isDigit = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F');
+    for (unsigned int i = 0; i < sizeof(stateTable) / sizeof(stateTable[0]); i++) {
+      StateEntry entryBuf;
+      const StateEntry *entry = _bitBusFlashEntry(&stateTable[i], &entryBuf);
+      if (state == entry->currentState
+          && (c == entry->inputChar || (isDigit && DIGIT == entry->inputChar))) {
+        return i;
+      }
+    }
+    return NO_ENTRY;
+  }
+};
+
+static const Index oldIndex;
+
+inline uint8_t Parser::lookup(int state, int inputChar) {
+  if ((unsigned int)state > READY) {
+    return NO_ENTRY;
+  }
+  uint8_t row = oldIndex.stateRowTable[state];
+  if (NO_ROW == row) {
+    return NO_ENTRY;
+  }
+  uint8_t cc = ((unsigned int)inputChar < sizeof(oldIndex.charTable)) ? oldIndex.charTable[inputChar] : CC_OTHER;
+  return oldIndex.transitionTable[row][cc];
+}
+
+// Not inlined, to time it like the library's processInput()
+__attribute__((noinline)) int Parser::processInput(int inputChar) {
+  if (READY == state) {
+    clear();
+  }
+  uint8_t i = lookup(state, inputChar);
+  if (NO_ENTRY == i) {
+    clear();
+    return GP_ERROR_NO_STATE_ENTRY;
+  }
+  // The old parser copied each entry out of flash
+  StateEntry entryBuf;
+  const StateEntry *entry = _bitBusFlashEntry(&stateTable[i], &entryBuf);
+  State next = (State)entry->nextState;
+  if (entry->stateFunc) {
+    int result = (this->*entry->stateFunc)(inputChar, &next);
+    if (result) {
+      clear();
+      return result;
+    }
+  }
+  if (MT_UNKNOWN != entry->messageType) {
+    messageType = entry->messageType;
+  }
+  state = next;
+  return (READY == state) ? 0 : 1;
+}
+
+#undef DIGIT
+#undef NO_ENTRY
+#undef NO_ROW
+
+}  // namespace reference
+
+#endif
@@ -0,0 +1,112 @@
+#!/bin/sh
+#
+# Builds extras/cycles/CycleBench for the Nano, runs it on a simulated
+# ATmega328P and reports the exact cycles per byte, or per call, of each
+# region in cycles.txt. Fails if any region takes more than THRESHOLD
+# percent over its baseline, or has no baseline recorded yet. Then compares
+# each ref- region, the old parser, with the -byte region of the same stream.
+#
+# Needs arduino-cli with the arduino:avr core installed, and simavr as a
+# library with its headers (libsimavr-dev on Debian and Ubuntu):
+#   arduino-cli core install arduino:avr
+#
+# Usage: extras/cycles/cycles.sh [--update]
+#   --update      write the measured cycles into cycles.txt as the baseline
+#   FQBN          board to build for, default arduino:avr:nano
+#   BUILD_DIR     where to build, default /tmp/bitbus-cycles
+#   THRESHOLD     percent a region may grow by, default 1
+#   FLAGS         compiler options for the firmware, e.g. -DBITBUS_WORD_AT_A_TIME=0
+#   CC            compiler for cycles_sim, default cc
+#   SIMAVR_FLAGS  options to build against simavr, default from pkg-config
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+BASELINE=$HERE/cycles.txt
+FQBN=${FQBN:-arduino:avr:nano}
+BUILD_DIR=${BUILD_DIR:-/tmp/bitbus-cycles}
+THRESHOLD=${THRESHOLD:-1}
+CC=${CC:-cc}
+SKETCH=$HERE/CycleBench
+update=0
+if [ "$1" = "--update" ]; then
+  update=1
+fi
+
+if ! command -v arduino-cli >/dev/null 2>&1; then
+  echo "cycles.sh: arduino-cli not found" >&2
+  exit 2
+fi
+if [ -z "$SIMAVR_FLAGS" ]; then
+  SIMAVR_FLAGS=$(pkg-config --cflags --libs simavr 2>/dev/null || echo "-I/usr/include/simavr -lsimavr")
+fi
+
+mkdir -p "$BUILD_DIR"
+if ! $CC -O2 -o "$BUILD_DIR/cycles_sim" "$HERE/cycles_sim.c" $SIMAVR_FLAGS -lelf > "$BUILD_DIR/sim.log" 2>&1; then
+  echo "cycles.sh: can't build cycles_sim against simavr, see $BUILD_DIR/sim.log" >&2
+  exit 2
+fi
+if ! arduino-cli compile --fqbn "$FQBN" --library "$ROOT" --build-path "$BUILD_DIR/firmware" \
+     --build-property "build.extra_flags=$FLAGS" "$SKETCH" > "$BUILD_DIR/compile.log" 2>&1; then
+  echo "cycles.sh: build failed, see $BUILD_DIR/compile.log" >&2
+  exit 1
+fi
+"$BUILD_DIR/cycles_sim" "$BUILD_DIR/firmware/CycleBench.ino.elf" > "$BUILD_DIR/results"
+
+# Join the results to the baselines by region id
+awk -v threshold="$THRESHOLD" -v update="$update" -v out="$BUILD_DIR/cycles.txt" '
+  FNR == NR { units[$1] = $2; cycles[$1] = $3; next }
+  /^[[:space:]]*(#|$)/ { print > out; next }
+  {
+    id = $1; name = $2; baseline = $3
+    if (!(id in units)) {
+      printf "%-16s %10s\n", name, "NOT RUN"
+      failures++
+      print > out
+      next
+    }
+    perUnit = cycles[id] / units[id]
+    measured[name] = perUnit
+    if (name ~ /^ref-/) {
+      refs[++refCount] = substr(name, 5)
+    }
+    status = ""
+    if (baseline == "-") {
+      change = "-"
+      status = "NO BASELINE"
+      failures++
+    } else {
+      change = sprintf("%+.1f%%", 100 * (perUnit - baseline) / baseline)
+      if (perUnit > baseline * (1 + threshold / 100)) {
+        status = "REGRESSED"
+        failures++
+      }
+    }
+    printf "%-16s %10.2f %10s %8s %s\n", name, perUnit, baseline, change, status
+    printf "%-3s %-15s %.2f\n", id, name, perUnit > out
+  }
+  BEGIN { printf "%-16s %10s %10s %8s\n", "region", "cycles", "baseline", "change" }
+  END {
+    # The old parser against the generated one on the same stream
+    for (i = 1; i <= refCount; i++) {
+      stream = refs[i]
+      if (i == 1) {
+        printf "\n%-16s %10s %10s %8s\n", "stream", "reference", "parser", "speedup"
+      }
+      if ((stream "-byte") in measured && measured[stream "-byte"] > 0) {
+        printf "%-16s %10.2f %10.2f %7.2fx\n", stream, measured["ref-" stream],
+               measured[stream "-byte"], measured["ref-" stream] / measured[stream "-byte"]
+      }
+    }
+    exit failures > 0
+  }
+' "$BUILD_DIR/results" "$BASELINE" || failed=1
+
+if [ "$update" = 1 ]; then
+  cp "$BUILD_DIR/cycles.txt" "$BASELINE"
+  echo "cycles.sh: baseline updated"
+elif [ -n "$failed" ]; then
+  echo "cycles.sh: cycles regressed by more than $THRESHOLD% or have no baseline, see above" >&2
+  exit 1
+fi
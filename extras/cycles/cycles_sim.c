@@ -0,0 +1,87 @@
+/*
+ * Runs CycleBench on a simulated ATmega328P and prints the exact number of
+ * cycles spent in each region it marks, one line per region:
+ *
+ *   id units cycles
+ *
+ * A region starts when the firmware writes its id (1 - 0x7F) to GPIOR0,
+ * with the units to divide by already in GPIOR2:GPIOR1, and ends when it
+ * writes REGION_STOP. REGION_DONE ends the run.
+ *
+ * Usage: cycles_sim CycleBench.ino.elf
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+
+// Data space addresses of the general purpose I/O registers on the ATmega328P
+#define GPIOR0_ADDR 0x3E
+#define GPIOR1_ADDR 0x4A
+#define GPIOR2_ADDR 0x4B
+
+#define REGION_STOP 0x80
+#define REGION_DONE 0xFF
+
+#define F_CPU 16000000UL
+// Give up on firmware that never finishes
+#define MAX_CYCLES (60 * F_CPU)
+
+static int regionId = 0;
+static unsigned int regionUnits;
+static avr_cycle_count_t regionStart;
+static int done = 0;
+static int failures = 0;
+
+static void markerWrite(avr_t *avr, avr_io_addr_t addr, uint8_t value, void *param) {
+  avr->data[addr] = value;
+  if (REGION_DONE == value) {
+    done = 1;
+  } else if (REGION_STOP == value) {
+    if (0 == regionId) {
+      fprintf(stderr, "cycles_sim: region stopped before it started\n");
+      failures++;
+      return;
+    }
+    printf("%d %u %llu\n", regionId, regionUnits, (unsigned long long)(avr->cycle - regionStart));
+    regionId = 0;
+  } else {
+    regionId = value;
+    regionUnits = avr->data[GPIOR1_ADDR] | (avr->data[GPIOR2_ADDR] << 8);
+    regionStart = avr->cycle;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: cycles_sim firmware.elf\n");
+    return 2;
+  }
+
+  elf_firmware_t firmware = {{0}};
+  if (elf_read_firmware(argv[1], &firmware) != 0) {
+    fprintf(stderr, "cycles_sim: can't read %s\n", argv[1]);
+    return 2;
+  }
+  avr_t *avr = avr_make_mcu_by_name("atmega328p");
+  if (!avr) {
+    fprintf(stderr, "cycles_sim: simavr has no atmega328p\n");
+    return 2;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  avr->frequency = F_CPU;
+  avr_register_io_write(avr, GPIOR0_ADDR, markerWrite, NULL);
+
+  int state = cpu_Running;
+  while (!done && cpu_Done != state && cpu_Crashed != state && avr->cycle < MAX_CYCLES) {
+    state = avr_run(avr);
+  }
+  if (!done) {
+    fprintf(stderr, "cycles_sim: firmware stopped after %llu cycles without finishing\n",
+            (unsigned long long)avr->cycle);
+    return 1;
+  }
+  return failures ? 1 : 0;
+}
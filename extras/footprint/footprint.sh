@@ -0,0 +1,94 @@
+#!/bin/sh
+#
+# Builds an example sketch in each configuration in configs.txt and
+# reports its flash and RAM use. Fails if any configuration is over budget,
+# or has no budget yet.
+#
+# Needs arduino-cli with the arduino:avr core installed, which brings
+# avr-gcc and avr-size along:
+#   arduino-cli core install arduino:avr
+#
+# Usage: extras/footprint/footprint.sh [--update] [configs.txt]
+#   --update      set each budget to the measured size plus a margin
+#   FQBN          board to build for, default arduino:avr:nano
+#   BUILD_DIR     where to build, default /tmp/bitbus-footprint
+#   AVR_SIZE      avr-size to use, default the one on the PATH
+#   FLASH_MARGIN  bytes of flash --update allows over the measured size, default 64
+#   RAM_MARGIN    bytes of RAM --update allows over the measured size, default 8
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+update=0
+if [ "$1" = "--update" ]; then
+  update=1
+  shift
+fi
+CONFIGS=${1:-$HERE/configs.txt}
+FLASH_MARGIN=${FLASH_MARGIN:-64}
+RAM_MARGIN=${RAM_MARGIN:-8}
+FQBN=${FQBN:-arduino:avr:nano}
+BUILD_DIR=${BUILD_DIR:-/tmp/bitbus-footprint}
+
+if ! command -v arduino-cli >/dev/null 2>&1; then
+  echo "footprint.sh: arduino-cli not found" >&2
+  exit 2
+fi
+if [ -z "$AVR_SIZE" ]; then
+  AVR_SIZE=$(command -v avr-size || find "$HOME/.arduino15/packages/arduino/tools/avr-gcc" -name avr-size -type f 2>/dev/null | head -n 1)
+fi
+if [ -z "$AVR_SIZE" ]; then
+  echo "footprint.sh: avr-size not found, set AVR_SIZE" >&2
+  exit 2
+fi
+
+failures=0
+mkdir -p "$BUILD_DIR"
+: > "$BUILD_DIR/measured"
+printf '%-10s %8s %8s %8s %8s\n' config flash budget ram budget
+# Leave out comments and blank lines
+grep -v '^[[:space:]]*\(#\|$\)' "$CONFIGS" > "$BUILD_DIR/configs"
+while read -r name sketch flashBudget ramBudget flags; do
+  out=$BUILD_DIR/$name
+  mkdir -p "$out"
+  if ! arduino-cli compile --fqbn "$FQBN" --library "$ROOT" --build-path "$out" \
+       --build-property "build.extra_flags=$flags" "$ROOT/examples/$sketch" > "$out/compile.log" 2>&1; then
+    echo "$name: build failed, see $out/compile.log" >&2
+    failures=$((failures + 1))
+    continue
+  fi
+  # Flash holds .text and the initial values of .data, RAM holds .data and .bss
+  set -- $("$AVR_SIZE" -A "$out/$sketch.ino.elf" | awk '
+    $1 == ".text" { text = $2 } $1 == ".data" { data = $2 } $1 == ".bss" { bss = $2 }
+    END { print text + data, data + bss }')
+  flash=$1
+  ram=$2
+  status=
+  if [ "$flashBudget" = - ] || [ "$ramBudget" = - ]; then
+    status="NOT MEASURED"
+    failures=$((failures + 1))
+  elif [ "$flash" -gt "$flashBudget" ] || [ "$ram" -gt "$ramBudget" ]; then
+    status="OVER BUDGET"
+    failures=$((failures + 1))
+  fi
+  printf '%-10s %8d %8s %8d %8s %s\n' "$name" "$flash" "$flashBudget" "$ram" "$ramBudget" "$status"
+  echo "$name $((flash + FLASH_MARGIN)) $((ram + RAM_MARGIN))" >> "$BUILD_DIR/measured"
+done < "$BUILD_DIR/configs"
+
+if [ "$update" = 1 ]; then
+  # Rewrite the budget columns, keeping comments, spacing and flags
+  awk 'FNR == NR { flash[$1] = $2; ram[$1] = $3; next }
+    /^[[:space:]]*(#|$)/ || !($1 in flash) { print; next }
+    { line = sprintf("%-9s %-15s %-6s %-5s", $1, $2, flash[$1], ram[$1])
+      for (i = 5; i <= NF; i++) line = line " " $i
+      sub(/ +$/, "", line)
+      print line }' "$BUILD_DIR/measured" "$CONFIGS" > "$BUILD_DIR/configs.new"
+  cp "$BUILD_DIR/configs.new" "$CONFIGS"
+  echo "footprint.sh: budgets updated, check them into git with the sizes in the commit message"
+  exit 0
+fi
+if [ "$failures" -gt 0 ]; then
+  echo "footprint.sh: $failures configurations failed" >&2
+  exit 1
+fi
@@ -0,0 +1,153 @@
+/*
+ * AppEmulator: Host only stand in for the BitBlue app in Controller mode.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "AppEmulator.h"
+
+static const char buttonLetters[] = MESSAGE_BUTTON_LETTERS;
+static const char fieldLetters[] = MESSAGE_FIELD_LETTERS;
+// Characters the parser might take for part of a message
+static const char protocolChars[] = "0123456789ABCDEF" MESSAGE_BUTTON_LETTERS MESSAGE_FIELD_LETTERS;
+
+AppEmulator::AppEmulator(const AppOptions &options)
+  : options(options), randomState(options.seed), frame(0), walkX(0), walkY(0),
+    pendingPresses(0), pendingButton(0) {
+  if (0 == this->options.period) {
+    this->options.period = 1;
+  }
+  if (0 == this->options.burst) {
+    this->options.burst = 1;
+  }
+}
+
+// Small deterministic generator so a seed always gives the same session
+uint32_t AppEmulator::random() {
+  randomState = randomState * 1103515245UL + 12345UL;
+  return (randomState >> 8) & 0xFFFFFF;
+}
+
+// Fill in the joystick fields for the current frame
+void AppEmulator::position(uint8_t values[ANALOG_FIELDS]) {
+  double x = 0, y = 0;
+  double phase = (double)(frame % options.period) / options.period;
+  switch (options.trajectory) {
+  case APP_TRAJECTORY_STILL:
+    break;
+  case APP_TRAJECTORY_CIRCLE:
+    x = cos(2 * M_PI * phase);
+    y = sin(2 * M_PI * phase);
+    break;
+  case APP_TRAJECTORY_SWEEP:
+    x = phase < 0.5 ? 4 * phase - 1 : 3 - 4 * phase;
+    break;
+  case APP_TRAJECTORY_WALK:
+    walkX += (int)(random() % 17) - 8;
+    walkY += (int)(random() % 17) - 8;
+    walkX = walkX < -255 ? -255 : walkX > 255 ? 255 : walkX;
+    walkY = walkY < -255 ? -255 : walkY > 255 ? 255 : walkY;
+    x = walkX / 255.0;
+    y = walkY / 255.0;
+    break;
+  case APP_TRAJECTORY_NOISE:
+    for (int i = 0; i < ANALOG_FIELDS; i++) {
+      values[i] = random() & 0xFF;
+    }
+    return;
+  }
+  // One field for each direction, the app leaves the opposite one at 0
+  values[0] = x < 0 ? (uint8_t)lround(-x * 255) : 0;
+  values[1] = x > 0 ? (uint8_t)lround(x * 255) : 0;
+  values[2] = y > 0 ? (uint8_t)lround(y * 255) : 0;
+  values[3] = y < 0 ? (uint8_t)lround(-y * 255) : 0;
+}
+
+/*
+ * Mangle one byte of a message the way a noisy link does: garble it, swap in
+ * another character the parser knows, lose it or add one.
+ *
+ * Returns: the new length
+ */
+size_t AppEmulator::corrupt(uint8_t *buf, size_t len) {
+  size_t at = random() % len;
+  switch (random() % 4) {
+  case 0:
+    buf[at] = random() & 0xFF;
+    return len;
+  case 1:
+    buf[at] = protocolChars[random() % (sizeof(protocolChars) - 1)];
+    return len;
+  case 2:
+    memmove(buf + at, buf + at + 1, len - at - 1);
+    return len - 1;
+  default:
+    memmove(buf + at + 1, buf + at, len - at);
+    buf[at] = protocolChars[random() % (sizeof(protocolChars) - 1)];
+    return len + 1;
+  }
+}
+
+size_t AppEmulator::next(uint8_t *buf, AppMessage *message) {
+  size_t len = 0;
+  if (pendingPresses > 0) {
+    pendingPresses--;
+    buf[len++] = buttonLetters[pendingButton];
+    appButtonText(message->text, pendingButton);
+  } else {
+    uint8_t values[ANALOG_FIELDS];
+    position(values);
+    bool hex = APP_FORMAT_HEX == options.format
+      || (APP_FORMAT_MIXED == options.format && (random() & 1));
+    for (int i = 0; i < ANALOG_FIELDS; i++) {
+      len += sprintf((char *)buf + len, hex ? "%c%02X" : "%c%03u", fieldLetters[i], values[i]);
+    }
+    appFrameText(message->text, values[0], values[1], values[2], values[3]);
+    frame++;
+
+    // Buttons mashed before the next frame
+    double bursts = options.buttonsPerFrame / options.burst;
+    unsigned int count = (unsigned int)bursts + (uniform() < bursts - floor(bursts));
+    if (count > 0) {
+      pendingPresses = count * options.burst;
+      pendingButton = random() % (sizeof(buttonLetters) - 1);
+    }
+  }
+
+  message->corrupted = uniform() < options.errorRate;
+  if (message->corrupted) {
+    len = corrupt(buf, len);
+  }
+  return len;
+}
+
+void appButtonText(char *text, uint8_t button) {
+  text[0] = button < sizeof(buttonLetters) - 1 ? buttonLetters[button] : '?';
+  text[1] = '\0';
+}
+
+void appFrameText(char *text, uint8_t left, uint8_t right, uint8_t up, uint8_t down) {
+  snprintf(text, APP_TEXT_LEN, "%c%03u%c%03u%c%03u%c%03u", fieldLetters[0], left, fieldLetters[1], right,
+           fieldLetters[2], up, fieldLetters[3], down);
+}
+
+long appMatch(const AppMessage *sent, size_t count, size_t first, const char *text) {
+  bool isButton = ('\0' == text[1]);
+  for (size_t i = first; i < count; i++) {
+    if (!sent[i].corrupted && !strcmp(sent[i].text, text)) {
+      return i;
+    }
+    if (isButton && '\0' != sent[i].text[1]) {
+      break;
+    }
+  }
+  return -1;
+}
+
+uint64_t appNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,108 @@
+/**
+ * AppEmulator: Host only stand in for the BitBlue app in Controller mode.
+ *
+ * Generates what the app sends: a joystick frame ("LhhRhhFhhBhh" or
+ * "LdddRdddFdddBddd") per step of a trajectory, with action button letters
+ * mashed in between, and optionally corrupts some of them on the way out.
+ * appsim sends its output over a pipe or a pseudo terminal, loadtest reads
+ * it back through BitBus.
+ */
+#ifndef HOST_APP_EMULATOR_H
+#define HOST_APP_EMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MessageBuffer.h"
+
+// Longest message on the wire, with room for an inserted byte
+#define APP_MESSAGE_MAX (ANALOG_DEC_MESSAGE_LEN + 1)
+
+/*
+ * A message as the sketch should see it, whichever form it was sent in:
+ * "X" for a button, "L012R000F255B000" for a frame. Decoded messages are
+ * written the same way by appMessageText() so the two can be compared.
+ */
+#define APP_TEXT_LEN (ANALOG_DEC_MESSAGE_LEN + 1)
+
+struct AppMessage {
+  char text[APP_TEXT_LEN];
+  // Mangled on the way out, so it may be lost or read as something else
+  bool corrupted;
+};
+
+enum AppFormat { APP_FORMAT_HEX, APP_FORMAT_DEC, APP_FORMAT_MIXED };
+
+enum AppTrajectory {
+  APP_TRAJECTORY_STILL,   // centred
+  APP_TRAJECTORY_CIRCLE,  // full deflection, once around per period
+  APP_TRAJECTORY_SWEEP,   // left to right and back per period
+  APP_TRAJECTORY_WALK,    // random walk
+  APP_TRAJECTORY_NOISE,   // a random position every frame
+};
+
+struct AppOptions {
+  AppOptions()
+    : format(APP_FORMAT_HEX), trajectory(APP_TRAJECTORY_CIRCLE), period(100),
+      buttonsPerFrame(0), burst(1), errorRate(0), seed(1) {}
+
+  AppFormat format;
+  AppTrajectory trajectory;
+  unsigned int period;     // frames per trip around the trajectory
+  double buttonsPerFrame;  // average action buttons sent per frame
+  unsigned int burst;      // presses of the same button in one mash
+  double errorRate;        // chance of corrupting each message
+  unsigned long seed;
+};
+
+class AppEmulator
+{
+ public:
+  AppEmulator(const AppOptions &options);
+
+  /*
+   * Write the next message, corrupted or not, to buf, which holds at least
+   * APP_MESSAGE_MAX bytes. message is what the sketch should decode from it.
+   *
+   * Returns: the number of bytes written
+   */
+  size_t next(uint8_t *buf, AppMessage *message);
+
+  // Returns: true if the last message was the end of a frame and the buttons after it
+  bool frameDone() const { return 0 == pendingPresses; }
+
+ private:
+  uint32_t random();
+  double uniform() { return random() / 16777216.0; }
+  void position(uint8_t values[ANALOG_FIELDS]);
+  size_t corrupt(uint8_t *buf, size_t len);
+
+  AppOptions options;
+  uint32_t randomState;
+  unsigned long frame;
+  int walkX;
+  int walkY;
+  unsigned int pendingPresses;
+  uint8_t pendingButton;
+};
+
+// Write a decoded button, enum GAMEPAD_BUTTON, the way AppMessage does
+void appButtonText(char *text, uint8_t button);
+// Write a decoded joystick position the way AppMessage does
+void appFrameText(char *text, uint8_t left, uint8_t right, uint8_t up, uint8_t down);
+
+/*
+ * Find a message the sketch decoded, written as text, among the ones sent
+ * from first on. Corrupted messages never match. Frames are as good as
+ * unique, however many were lost in between, but buttons repeat. So a
+ * button is only matched past other buttons: one read out of garbage can't
+ * skip over a frame and throw the rest of the matching off.
+ *
+ * Returns: the index of the match, or -1
+ */
+long appMatch(const AppMessage *sent, size_t count, size_t first, const char *text);
+
+// Returns: the current CLOCK_MONOTONIC time, which appsim and loadtest share
+uint64_t appNanos();
+
+#endif
@@ -0,0 +1,298 @@
+/*
+ * ArduinoHost: Implementation of the host shims for the Arduino core.
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "SoftwareSerial.h"
+
+//------------------------------------------------------------------------------
+// Timing
+
+static uint64_t _hostNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t startNanos = _hostNanos();
+
+unsigned long millis(void) {
+  return (unsigned long)((_hostNanos() - startNanos) / 1000000ULL);
+}
+
+unsigned long micros(void) {
+  return (unsigned long)((_hostNanos() - startNanos) / 1000ULL);
+}
+
+void delay(unsigned long ms) {
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000L;
+  nanosleep(&ts, NULL);
+}
+
+void delayMicroseconds(unsigned int us) {
+  struct timespec ts;
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = (us % 1000000) * 1000L;
+  nanosleep(&ts, NULL);
+}
+
+//------------------------------------------------------------------------------
+// Digital I/O: there are no pins on the host, reads return LOW.
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+}
+
+int digitalRead(uint8_t pin) {
+  return LOW;
+}
+
+//------------------------------------------------------------------------------
+// Print
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::write(const char *str) {
+  if (str == NULL) {
+    return 0;
+  }
+  return write((const uint8_t *)str, strlen(str));
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+
+  *str = '\0';
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+
+  return write(str);
+}
+
+size_t Print::print(const char *str) {
+  return write(str);
+}
+
+size_t Print::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char n, int base) {
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(int n, int base) {
+  return print((long)n, base);
+}
+
+size_t Print::print(unsigned int n, int base) {
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == 0) {
+    return write((uint8_t)n);
+  } else if (base == 10 && n < 0) {
+    size_t t = print('-');
+    return printNumber(-n, 10) + t;
+  }
+  return printNumber(n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  if (base == 0) {
+    return write((uint8_t)n);
+  }
+  return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t Print::println() {
+  return write("\r\n");
+}
+
+size_t Print::println(const char *str) {
+  size_t n = print(str);
+  return n + println();
+}
+
+size_t Print::println(char c) {
+  size_t n = print(c);
+  return n + println();
+}
+
+size_t Print::println(unsigned char num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(int num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(unsigned int num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(long num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(unsigned long num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(double num, int digits) {
+  size_t n = print(num, digits);
+  return n + println();
+}
+
+//------------------------------------------------------------------------------
+// Stream
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = read();
+    if (c < 0) {
+      break;
+    }
+    *buffer++ = (char)c;
+    count++;
+  }
+  return count;
+}
+
+//------------------------------------------------------------------------------
+// USART registers
+
+volatile uint8_t UBRR0H;
+volatile uint8_t UBRR0L;
+volatile uint8_t UCSR0A;
+volatile uint8_t UCSR0B;
+volatile uint8_t UCSR0C;
+volatile uint8_t UDR0;
+
+//------------------------------------------------------------------------------
+// HardwareSerial
+
+HardwareSerial Serial;
+
+HardwareSerial::HardwareSerial() : rxBuffer(64), echo(true) {
+}
+
+void HardwareSerial::begin(unsigned long baudRate) {
+}
+
+void HardwareSerial::end() {
+}
+
+int HardwareSerial::available() {
+  return (int)rxBuffer.count();
+}
+
+int HardwareSerial::read() {
+  return rxBuffer.pop();
+}
+
+int HardwareSerial::peek() {
+  return rxBuffer.peek();
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  // println() sends CR/LF, the terminal only needs the LF
+  if (echo && c != '\r') {
+    putchar(c);
+  }
+  return 1;
+}
+
+size_t HardwareSerial::_hostInject(const uint8_t *data, size_t len) {
+  return rxBuffer.push(data, len);
+}
+
+void HardwareSerial::_hostSetEcho(bool echo) {
+  this->echo = echo;
+}
+
+//------------------------------------------------------------------------------
+// SoftwareSerial
+
+SoftwareSerial *SoftwareSerial::activeObject = NULL;
+
+SoftwareSerial::SoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverseLogic)
+  : rxPin(receivePin), txPin(transmitPin), speed(0), rxBuffer(_SS_MAX_RX_BUFF), txCount(0) {
+}
+
+SoftwareSerial::~SoftwareSerial() {
+  end();
+}
+
+void SoftwareSerial::begin(long speed) {
+  this->speed = speed;
+  listen();
+}
+
+bool SoftwareSerial::listen() {
+  if (activeObject == this) {
+    return false;
+  }
+  activeObject = this;
+  rxBuffer.clear();
+  return true;
+}
+
+void SoftwareSerial::end() {
+  if (activeObject == this) {
+    activeObject = NULL;
+  }
+}
+
+int SoftwareSerial::available() {
+  return isListening() ? (int)rxBuffer.count() : 0;
+}
+
+int SoftwareSerial::read() {
+  return isListening() ? rxBuffer.pop() : -1;
+}
+
+int SoftwareSerial::peek() {
+  return isListening() ? rxBuffer.peek() : -1;
+}
+
+size_t SoftwareSerial::write(uint8_t c) {
+  txCount++;
+  return 1;
+}
+
+size_t SoftwareSerial::_hostInject(const uint8_t *data, size_t len) {
+  return rxBuffer.push(data, len);
+}
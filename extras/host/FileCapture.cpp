@@ -0,0 +1,47 @@
+/*
+ * FileCapture: Host only BitBusCapture that writes straight to a file.
+ */
+#include <stdlib.h>
+
+#include "FileCapture.h"
+
+bool FileCapture::open(const char *path) {
+  close();
+  file = fopen(path, "wb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  fwrite(_bitBusCaptureHeader, 1, BITBUS_CAPTURE_HEADER_LEN, file);
+  return true;
+}
+
+void FileCapture::close() {
+  stop();
+  if (file) {
+    fclose(file);
+    file = NULL;
+  }
+}
+
+void FileCapture::record(const uint8_t *header, uint8_t headerLen, const uint8_t *data, uint8_t len) {
+  if (file) {
+    fwrite(header, 1, headerLen, file);
+    fwrite(data, 1, len, file);
+  }
+}
+
+uint8_t *loadCaptureFile(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *data = (uint8_t *)malloc(size > 0 ? size : 1);
+  *len = fread(data, 1, size, f);
+  fclose(f);
+  return data;
+}
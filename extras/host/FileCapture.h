@@ -0,0 +1,31 @@
+/**
+ * FileCapture: Host only BitBusCapture that writes straight to a file.
+ */
+#ifndef HOST_FILE_CAPTURE_H
+#define HOST_FILE_CAPTURE_H
+
+#include <stdio.h>
+
+#include "BitBusCapture.h"
+
+class FileCapture : public BitBusCapture
+{
+ public:
+  FileCapture() : file(NULL) {}
+  ~FileCapture() { close(); }
+
+  // Create path and write the capture header. Returns: false if it can't be created.
+  bool open(const char *path);
+  void close();
+
+ protected:
+  virtual void record(const uint8_t *header, uint8_t headerLen, const uint8_t *data, uint8_t len);
+
+ private:
+  FILE *file;
+};
+
+// Read a whole capture file into memory. Returns: NULL on error, free() the result.
+uint8_t *loadCaptureFile(const char *path, size_t *len);
+
+#endif
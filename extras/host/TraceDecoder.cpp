@@ -0,0 +1,197 @@
+/*
+ * TraceDecoder: Host only reader for BitBusTraceDump() output.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "GamePad.h"
+#include "MessageBuffer.h"
+#include "TraceDecoder.h"
+
+struct Name {
+  uint8_t value;
+  const char *name;
+};
+
+#define NAME(x) {x, #x}
+
+static const Name stateNames[] = {
+  NAME(IS_START),
+  NAME(IS_WAITING_FOR_L_DIGIT_1),
+  NAME(IS_WAITING_FOR_L_DIGIT_2),
+  NAME(IS_WAITING_FOR_L_HEX_DIGIT_2),
+  NAME(IS_WAITING_FOR_L_DIGIT_3_OR_R),
+  NAME(IS_WAITING_FOR_HEX_R),
+  NAME(IS_WAITING_FOR_HEX_R_DIGIT_1),
+  NAME(IS_WAITING_FOR_HEX_R_DIGIT_2),
+  NAME(IS_WAITING_FOR_HEX_F),
+  NAME(IS_WAITING_FOR_HEX_F_DIGIT_1),
+  NAME(IS_WAITING_FOR_HEX_F_DIGIT_2),
+  NAME(IS_WAITING_FOR_HEX_B),
+  NAME(IS_WAITING_FOR_HEX_B_DIGIT_1),
+  NAME(IS_WAITING_FOR_HEX_B_DIGIT_2),
+  NAME(IS_WAITING_FOR_R),
+  NAME(IS_WAITING_FOR_R_DIGIT_1),
+  NAME(IS_WAITING_FOR_R_DIGIT_2),
+  NAME(IS_WAITING_FOR_R_DIGIT_3),
+  NAME(IS_WAITING_FOR_F),
+  NAME(IS_WAITING_FOR_F_DIGIT_1),
+  NAME(IS_WAITING_FOR_F_DIGIT_2),
+  NAME(IS_WAITING_FOR_F_DIGIT_3),
+  NAME(IS_WAITING_FOR_B),
+  NAME(IS_WAITING_FOR_B_DIGIT_1),
+  NAME(IS_WAITING_FOR_B_DIGIT_2),
+  NAME(IS_WAITING_FOR_B_DIGIT_3),
+  NAME(IS_MESSAGE_READY),
+  NAME(IS_ERROR),
+};
+
+static const Name eventNames[] = {
+  {BT_CHAR, "CHAR"},
+  {BT_MESSAGE, "MESSAGE"},
+  {BT_ERROR, "ERROR"},
+  {BT_ANALOG, "ANALOG"},
+  {BT_CHUNK, "CHUNK"},
+  {BT_SKIP, "SKIP"},
+  {BT_SUPERSEDED, "SUPERSEDED"},
+  {BT_UNHANDLED, "UNHANDLED"},
+};
+
+static const Name messageNames[] = {
+  NAME(MT_UNKNOWN),
+  NAME(MT_START_BUTTON),
+  NAME(MT_SELECT),
+  NAME(MT_BUTTON_A),
+  NAME(MT_BUTTON_B),
+  NAME(MT_BUTTON_X),
+  NAME(MT_BUTTON_Y),
+  NAME(MT_UP),
+  NAME(MT_DOWN),
+  NAME(MT_LEFT),
+  NAME(MT_RIGHT),
+  NAME(MT_ANALOG_POSITION),
+};
+
+static const Name errorNames[] = {
+  NAME(GP_ERROR_UNHANDLED_MESSAGE_TYPE),
+  NAME(GP_ERROR_NO_STATE_ENTRY),
+  NAME(GP_ERROR_INVALID_DEC_DIGIT),
+  NAME(GP_ERROR_UNEXPECTED_DEC_DIGIT),
+};
+
+// What the state machine does with a character, by the action in a transition
+static const char *actionNames[] = {"", " digit", " hex store", " dec store"};
+
+#define LOOKUP(names, value) lookup(names, sizeof(names) / sizeof(names[0]), value)
+
+static const char *lookup(const Name *names, size_t count, uint8_t value) {
+  for (size_t i = 0; i < count; i++) {
+    if (names[i].value == value) {
+      return names[i].name;
+    }
+  }
+  return "?";
+}
+
+const char *traceStateName(uint8_t state) {
+  return LOOKUP(stateNames, state);
+}
+
+const char *traceEventName(uint8_t event) {
+  return LOOKUP(eventNames, event);
+}
+
+size_t traceFromHex(const char *text, uint8_t *out, size_t max) {
+  size_t n = 0;
+  int high = -1;
+  for (; *text && n < max; text++) {
+    if (!isxdigit((unsigned char)*text)) {
+      continue;
+    }
+    int nybble = isdigit((unsigned char)*text) ? *text - '0' : toupper((unsigned char)*text) - 'A' + 10;
+    if (high < 0) {
+      high = nybble;
+    } else {
+      out[n++] = (uint8_t)(high << 4 | nybble);
+      high = -1;
+    }
+  }
+  return n;
+}
+
+int traceDecode(const uint8_t *dump, size_t len, BitBusTraceRecord *records, int max) {
+  if (len < BITBUS_TRACE_HEADER_LEN || memcmp(dump, "BBT\x01", 4) || BITBUS_TRACE_RECORD_LEN != dump[4]) {
+    return -1;
+  }
+  int count = dump[5];
+  if (len < BITBUS_TRACE_HEADER_LEN + (size_t)count * BITBUS_TRACE_RECORD_LEN) {
+    return -1;
+  }
+  count = count < max ? count : max;
+  const uint8_t *p = dump + BITBUS_TRACE_HEADER_LEN;
+  for (int i = 0; i < count; i++, p += BITBUS_TRACE_RECORD_LEN) {
+    records[i].time = p[0] | p[1] << 8;
+    records[i].event = p[2];
+    records[i].state = p[3];
+    records[i].input = p[4];
+    records[i].entry = p[5];
+    records[i].code = p[6];
+  }
+  return count;
+}
+
+void traceTimes(const BitBusTraceRecord *records, int count, unsigned long *micros) {
+  for (int i = 0; i < count; i++) {
+    micros[i] = i ? micros[i - 1] + 4UL * (uint16_t)(records[i].time - records[i - 1].time) : 0;
+  }
+}
+
+// Write a character the way it would appear in a message, or its code
+static void formatChar(uint8_t c, char *out, size_t len) {
+  if (c >= ' ' && c < 0x7F) {
+    snprintf(out, len, "'%c'", c);
+  } else {
+    snprintf(out, len, "0x%02X", c);
+  }
+}
+
+void traceFormat(const BitBusTraceRecord &r, unsigned long micros, char *line, size_t len) {
+  char c[8];
+  formatChar(r.input, c, sizeof(c));
+  int n = snprintf(line, len, "%8lu us  %-10s %-30s ", micros, traceEventName(r.event), traceStateName(r.state));
+  if (n < 0 || (size_t)n >= len) {
+    return;
+  }
+  line += n;
+  len -= n;
+  switch (r.event) {
+  case BT_CHAR:
+    snprintf(line, len, "%-4s -> %s%s", c, traceStateName(TRANSITION_STATE(r.entry)),
+             actionNames[TRANSITION_ACTION(r.entry)]);
+    break;
+  case BT_MESSAGE:
+    snprintf(line, len, "%-4s -> %s%s, %s", c, traceStateName(TRANSITION_STATE(r.entry)),
+             actionNames[TRANSITION_ACTION(r.entry)], LOOKUP(messageNames, r.code));
+    break;
+  case BT_ERROR:
+    snprintf(line, len, "%-4s %s", c, LOOKUP(errorNames, r.code));
+    break;
+  case BT_ANALOG:
+  case BT_SUPERSEDED:
+    snprintf(line, len, "%u bytes, %s", r.input, LOOKUP(messageNames, r.code));
+    break;
+  case BT_CHUNK:
+    snprintf(line, len, "%u bytes%s", r.input, r.code ? ", after lost input" : "");
+    break;
+  case BT_SKIP:
+    snprintf(line, len, "%u bytes", r.input);
+    break;
+  case BT_UNHANDLED:
+    snprintf(line, len, "%s", LOOKUP(messageNames, r.code));
+    break;
+  default:
+    snprintf(line, len, "input 0x%02X entry 0x%02X code %u", r.input, r.entry, r.code);
+    break;
+  }
+}
@@ -0,0 +1,50 @@
+/**
+ * TraceDecoder: Host only reader for BitBusTraceDump() output.
+ *
+ * Turns the dump back into BitBusTraceRecords and describes each one with
+ * the parser's own names for its states, messages and errors.
+ */
+#ifndef HOST_TRACE_DECODER_H
+#define HOST_TRACE_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "BitBusTrace.h"
+
+// Longest line traceFormat() writes
+#define TRACE_LINE_LEN 160
+
+/*
+ * Turn hex text, e.g. a dump copied from the Serial Monitor, back into
+ * bytes. Anything that isn't a hex digit is skipped.
+ *
+ * Returns: the number of bytes written to out
+ */
+size_t traceFromHex(const char *text, uint8_t *out, size_t max);
+
+/*
+ * Read the records out of a dump, up to max of them.
+ *
+ * Returns: the number of records, or -1 if it isn't a trace dump
+ */
+int traceDecode(const uint8_t *dump, size_t len, BitBusTraceRecord *records, int max);
+
+// Returns: the name of an enum _INPUT_STATE, e.g. "IS_WAITING_FOR_HEX_R", or "?"
+const char *traceStateName(uint8_t state);
+// Returns: the name of an enum BITBUS_TRACE_EVENT without the BT_, or "?"
+const char *traceEventName(uint8_t event);
+
+/*
+ * Describe a record on one line, starting with micros, its time since the
+ * first record.
+ */
+void traceFormat(const BitBusTraceRecord &r, unsigned long micros, char *line, size_t len);
+
+/*
+ * Work out the time of each record since the first, in micros[]. The record
+ * times wrap every 262ms, so longer gaps come out short.
+ */
+void traceTimes(const BitBusTraceRecord *records, int count, unsigned long *micros);
+
+#endif
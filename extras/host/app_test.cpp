@@ -0,0 +1,131 @@
+/*
+ * Checks that AppEmulator speaks the protocol the parser accepts: every
+ * clean message it sends, in each form and on each trajectory, decodes to
+ * the message it says it sent, and corrupted ones don't throw the parser
+ * off for long.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "AppEmulator.h"
+#include "BitBus.h"
+#include "GamePad.h"
+
+#define MESSAGES 2000
+
+#define HOST_TEST_DECODED (MESSAGES * 2)
+#include "HostTest.h"
+
+/*
+ * Send MESSAGES messages through a BitBusT, one call per message.
+ *
+ * Returns: the number of clean messages decoded as sent, in order
+ */
+static int run(const AppOptions &options, AppMessage *sent, bool resync = false) {
+  static uint8_t buf[MESSAGES * APP_MESSAGE_MAX];
+  AppEmulator app(options);
+  GamePadModule pad;
+  pad.onButtonPressed(onButton);
+  pad.onAnalogUpdate(onAnalog);
+  pad.setResync(resync);
+  BitBusT<BitBusMemoryTransport> bus(pad);
+  decodedCount = 0;
+  for (int i = 0; i < MESSAGES; i++) {
+    size_t len = app.next(buf, &sent[i]);
+    bus.begin(buf, len);
+    bus.processInput();
+  }
+
+  // Anything decoded from a corrupted message matches nothing and is skipped
+  int matched = 0, next = 0;
+  for (int d = 0; d < decodedCount; d++) {
+    long i = appMatch(sent, MESSAGES, next, decoded[d]);
+    if (i >= 0) {
+      matched++;
+      next = i + 1;
+    }
+  }
+  return matched;
+}
+
+static void testClean() {
+  static AppMessage sent[MESSAGES];
+  for (int format = APP_FORMAT_HEX; format <= APP_FORMAT_MIXED; format++) {
+    for (int trajectory = APP_TRAJECTORY_STILL; trajectory <= APP_TRAJECTORY_NOISE; trajectory++) {
+      AppOptions options;
+      options.format = (AppFormat)format;
+      options.trajectory = (AppTrajectory)trajectory;
+      options.buttonsPerFrame = 0.5;
+      options.burst = 3;
+      int matched = run(options, sent);
+      CHECK(MESSAGES == matched, "every clean message decodes as sent");
+      CHECK(MESSAGES == decodedCount, "nothing extra is decoded");
+    }
+  }
+}
+
+static void testShapes() {
+  AppOptions options;
+  options.format = APP_FORMAT_DEC;
+  options.trajectory = APP_TRAJECTORY_CIRCLE;
+  options.period = 4;
+  AppEmulator app(options);
+  uint8_t buf[APP_MESSAGE_MAX];
+  AppMessage message;
+  size_t len = app.next(buf, &message);
+  CHECK(ANALOG_DEC_MESSAGE_LEN == len, "decimal frame length");
+  CHECK(0 == memcmp(buf, "L000R255F000B000", len), "circle starts at full right");
+  CHECK(!strcmp(message.text, "L000R255F000B000"), "text of a decimal frame");
+  app.next(buf, &message);
+  CHECK(!strcmp(message.text, "L000R000F255B000"), "a quarter of the way round is full up");
+
+  options.format = APP_FORMAT_HEX;
+  options.trajectory = APP_TRAJECTORY_SWEEP;
+  AppEmulator sweep(options);
+  len = sweep.next(buf, &message);
+  CHECK(ANALOG_HEX_MESSAGE_LEN == len, "hex frame length");
+  CHECK(0 == memcmp(buf, "LFFR00F00B00", len), "sweep starts at full left");
+  CHECK(!strcmp(message.text, "L255R000F000B000"), "hex frames are decoded to the same text");
+
+  // Two buttons per frame in bursts of two: every frame is followed by a mash
+  options.buttonsPerFrame = 2;
+  options.burst = 2;
+  AppEmulator masher(options);
+  masher.next(buf, &message);
+  CHECK(!masher.frameDone(), "a mash follows the frame");
+  masher.next(buf, &message);
+  CHECK(1 == strlen(message.text) && buf[0] == message.text[0], "a button is its letter");
+  AppMessage second;
+  masher.next(buf, &second);
+  CHECK(!strcmp(message.text, second.text), "a mash repeats one button");
+  CHECK(masher.frameDone(), "the frame is done after the mash");
+}
+
+static void testCorrupted() {
+  static AppMessage sent[MESSAGES];
+  AppOptions options;
+  options.format = APP_FORMAT_MIXED;
+  options.trajectory = APP_TRAJECTORY_WALK;
+  options.buttonsPerFrame = 1;
+  options.errorRate = 0.1;
+  int matched = run(options, sent);
+  int resynced = run(options, sent, true);
+  int clean = 0;
+  for (int i = 0; i < MESSAGES; i++) {
+    clean += !sent[i].corrupted;
+  }
+  printf("corrupted input: %d of %d clean messages decoded, %d in resync mode\n", matched, clean, resynced);
+  CHECK(clean < MESSAGES, "some messages are corrupted");
+  // In resync mode a corrupted message can take the next one down with it, but no more
+  CHECK(resynced >= clean - (MESSAGES - clean), "the parser recovers after each corrupted message");
+}
+
+int main() {
+  Serial._hostSetEcho(false);
+  testClean();
+  testShapes();
+  testCorrupted();
+
+  return hostTestResult("AppEmulator");
+}
@@ -0,0 +1,215 @@
+/*
+ * Plays the part of the BitBlue app in Controller mode: sends joystick
+ * frames, and buttons mashed in between, at a steady frame rate to stdout,
+ * a file or a new pseudo terminal.
+ *
+ * Usage: appsim [options]
+ *   --rate N        frames per second, 0 sends as fast as the reader takes them. Default 20
+ *   --frames N      stop after N frames. Default 1000
+ *   --seconds N     stop after N seconds instead
+ *   --format F      hex, dec or mixed. Default hex
+ *   --trajectory T  still, circle, sweep, walk or noise. Default circle
+ *   --period N      frames per trip around the trajectory. Default 100
+ *   --buttons N     average action buttons per frame. Default 0
+ *   --burst N       presses of the same button in one mash. Default 1
+ *   --errors P      chance of corrupting each message, 0 to 1. Default 0
+ *   --seed N        for the trajectory, buttons and errors. Default 1
+ *   --out PATH      write to PATH instead of stdout
+ *   --pty           create a pseudo terminal, print its name and write to it
+ *   --log PATH      record the time each message was sent, for loadtest --log
+ *
+ * The log has a line per message: the CLOCK_MONOTONIC time in ns, "c" for a
+ * clean message or "x" for a corrupted one, and the message as the sketch
+ * should decode it.
+ *
+ * For example:
+ *   build/appsim --rate 500 --buttons 0.5 --log sent.log | build/loadtest --log sent.log
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "AppEmulator.h"
+
+// Time for the reader to open the pseudo terminal before frames start
+#define PTY_START_DELAY_MS 2000
+
+static bool lookup(const char *name, const char *const names[], int count, int *value) {
+  for (int i = 0; i < count; i++) {
+    if (!strcmp(name, names[i])) {
+      *value = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns: the master side of a new raw pseudo terminal, or -1
+static int openPty() {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) || unlockpt(master)) {
+    perror("appsim: pseudo terminal");
+    return -1;
+  }
+  // No echo or line editing: the reader gets the bytes as they were sent
+  struct termios tio;
+  if (0 == tcgetattr(master, &tio)) {
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+  }
+  fprintf(stderr, "appsim: sending on %s\n", ptsname(master));
+  return master;
+}
+
+static bool writeAll(int fd, const uint8_t *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+static void sleepUntil(uint64_t nanos) {
+  struct timespec ts;
+  ts.tv_sec = nanos / 1000000000ULL;
+  ts.tv_nsec = nanos % 1000000000ULL;
+  while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) {
+  }
+}
+
+int main(int argc, char **argv) {
+  static const char *const formats[] = {"hex", "dec", "mixed"};
+  static const char *const trajectories[] = {"still", "circle", "sweep", "walk", "noise"};
+  AppOptions options;
+  double rate = 20;
+  unsigned long frames = 1000;
+  double seconds = 0;
+  const char *outPath = NULL;
+  const char *logPath = NULL;
+  bool pty = false;
+  bool usage = false;
+
+  for (int i = 1; i < argc && !usage; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    int choice;
+    if (!strcmp(arg, "--pty")) {
+      pty = true;
+      continue;
+    }
+    if (!value) {
+      usage = true;
+      break;
+    }
+    i++;
+    if (!strcmp(arg, "--rate")) {
+      rate = atof(value);
+    } else if (!strcmp(arg, "--frames")) {
+      frames = strtoul(value, NULL, 10);
+    } else if (!strcmp(arg, "--seconds")) {
+      seconds = atof(value);
+    } else if (!strcmp(arg, "--format") && lookup(value, formats, 3, &choice)) {
+      options.format = (AppFormat)choice;
+    } else if (!strcmp(arg, "--trajectory") && lookup(value, trajectories, 5, &choice)) {
+      options.trajectory = (AppTrajectory)choice;
+    } else if (!strcmp(arg, "--period")) {
+      options.period = strtoul(value, NULL, 10);
+    } else if (!strcmp(arg, "--buttons")) {
+      options.buttonsPerFrame = atof(value);
+    } else if (!strcmp(arg, "--burst")) {
+      options.burst = strtoul(value, NULL, 10);
+    } else if (!strcmp(arg, "--errors")) {
+      options.errorRate = atof(value);
+    } else if (!strcmp(arg, "--seed")) {
+      options.seed = strtoul(value, NULL, 10);
+    } else if (!strcmp(arg, "--out")) {
+      outPath = value;
+    } else if (!strcmp(arg, "--log")) {
+      logPath = value;
+    } else {
+      usage = true;
+    }
+  }
+  if (usage || (pty && outPath)) {
+    fprintf(stderr, "Usage: %s [--rate N] [--frames N | --seconds N] [--format hex|dec|mixed]\n"
+            "  [--trajectory still|circle|sweep|walk|noise] [--period N] [--buttons N] [--burst N]\n"
+            "  [--errors P] [--seed N] [--out PATH | --pty] [--log PATH]\n", argv[0]);
+    return 2;
+  }
+
+  // A reader that goes away ends the session
+  signal(SIGPIPE, SIG_IGN);
+  int fd = STDOUT_FILENO;
+  if (pty) {
+    fd = openPty();
+  } else if (outPath) {
+    fd = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+      perror(outPath);
+    }
+  }
+  if (fd < 0) {
+    return 1;
+  }
+  FILE *log = NULL;
+  if (logPath && !(log = fopen(logPath, "w"))) {
+    perror(logPath);
+    return 1;
+  }
+  if (pty) {
+    sleepUntil(appNanos() + PTY_START_DELAY_MS * 1000000ULL);
+  }
+
+  AppEmulator app(options);
+  uint64_t start = appNanos();
+  uint64_t interval = rate > 0 ? (uint64_t)(1e9 / rate) : 0;
+  unsigned long sent = 0;
+  for (unsigned long frame = 0; seconds > 0 || frame < frames; frame++) {
+    uint64_t due = start + frame * interval;
+    if (seconds > 0 && (interval ? due : appNanos()) - start >= seconds * 1e9) {
+      break;
+    }
+    if (interval) {
+      sleepUntil(due);
+    }
+    // The frame, then any buttons mashed after it
+    bool ok = true;
+    do {
+      uint8_t buf[APP_MESSAGE_MAX];
+      AppMessage message;
+      size_t len = app.next(buf, &message);
+      if (log) {
+        fprintf(log, "%llu %c %s\n", (unsigned long long)appNanos(), message.corrupted ? 'x' : 'c', message.text);
+      }
+      ok = writeAll(fd, buf, len);
+      sent++;
+    } while (ok && !app.frameDone());
+    if (!ok) {
+      fprintf(stderr, "appsim: reader went away: %s\n", strerror(errno));
+      break;
+    }
+  }
+
+  if (log) {
+    fclose(log);
+  }
+  fprintf(stderr, "appsim: sent %lu messages in %.2f s\n", sent, (appNanos() - start) / 1e9);
+  if (pty) {
+    // Give the reader time to take the last bytes before the terminal goes away
+    sleepUntil(appNanos() + PTY_START_DELAY_MS * 1000000ULL);
+  }
+  return 0;
+}
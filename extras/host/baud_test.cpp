@@ -0,0 +1,352 @@
+/*
+ * Test for begin(BITBUS_AUTO_BAUD), see BitBusBaud.h.
+ *
+ * The Bluetooth module is modelled down to the bits on the wire: AppEmulator
+ * messages are sent at one rate, and a modelled UART reads them at whatever
+ * rate it was started at, wrong or not, sampling the middle of each bit the
+ * way the AVR USART and SoftwareSerial do. The detector has to find the
+ * module's rate from that and then read every message after it.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "AppEmulator.h"
+#include "BitBus.h"
+#include "BitBusBaud.h"
+#include "GamePad.h"
+#include "SoftwareSerial.h"
+
+#define MESSAGES 300
+// Time from the start of one message to the next, if the link keeps up
+#define MESSAGE_PERIOD 0.01
+// How often the sketch calls processInput()
+#define LOOP_PERIOD 0.002
+#define RX_BUFFER_SIZE 64
+
+#define HOST_TEST_DECODED (MESSAGES * 2)
+#include "HostTest.h"
+
+/*
+ * The serial line from the module: 8N1 frames, idle high, each byte sent
+ * whole as soon as the one before it is done or its message is due.
+ */
+class Line
+{
+ public:
+  Line(double rate) : bitTime(1 / rate), count(0) {}
+
+  void send(const uint8_t *data, size_t len, double when) {
+    double start = count ? starts[count - 1] + 10 * bitTime : 0;
+    start = start > when ? start : when;
+    for (size_t i = 0; i < len && count < sizeof(bytes); i++, count++) {
+      bytes[count] = data[i];
+      starts[count] = start;
+      start += 10 * bitTime;
+    }
+  }
+
+  // Returns: when the last byte has been sent
+  double end() const { return count ? starts[count - 1] + 10 * bitTime : 0; }
+
+  // Returns: the level of the line at time t, 0 or 1
+  int level(double t) const {
+    size_t i = byteAt(t);
+    if (i >= count) {
+      return 1;
+    }
+    return bit(i, (int)((t - starts[i]) / bitTime));
+  }
+
+  // Returns: the first time from t on the line goes from 1 to 0, or INFINITY
+  double fallingEdge(double t) const {
+    for (size_t i = byteAt(t); i < count; i++) {
+      for (int j = 0; j < 10; j++) {
+        double at = starts[i] + j * bitTime;
+        // The start bit always follows a 1, the stop bit or the idle line
+        if (at >= t && 0 == bit(i, j) && (0 == j || 1 == bit(i, j - 1))) {
+          return at;
+        }
+      }
+    }
+    return INFINITY;
+  }
+
+ private:
+  // Returns: the first byte that isn't over by time t
+  size_t byteAt(double t) const {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (starts[mid] + 10 * bitTime <= t) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  // Returns: bit j of frame i, counting the start bit as 0
+  int bit(size_t i, int j) const {
+    if (j < 0 || j >= 9) {
+      return 1;
+    }
+    return j ? (bytes[i] >> (j - 1)) & 1 : 0;
+  }
+
+  double bitTime;
+  uint8_t bytes[MESSAGES * APP_MESSAGE_MAX];
+  double starts[MESSAGES * APP_MESSAGE_MAX];
+  size_t count;
+};
+
+/*
+ * Reads a Line at any rate: waits for a falling edge, checks the start bit
+ * in the middle, samples the middle of each data bit and then looks for the
+ * next falling edge from the middle of the stop bit.
+ */
+class LineReader
+{
+ public:
+  LineReader(const Line &line) : line(line), bitTime(1), cursor(0) {}
+
+  void setRate(double rate) { bitTime = 1 / rate; }
+
+  // Read the bytes that are over by time until, up to max of them
+  size_t read(double until, uint8_t *out, size_t max) {
+    size_t n = 0;
+    while (n < max) {
+      double edge = line.fallingEdge(cursor);
+      if (edge + 9.5 * bitTime > until) {
+        break;
+      }
+      if (line.level(edge + 0.5 * bitTime)) {
+        cursor = edge + 0.5 * bitTime;
+        continue;
+      }
+      uint8_t c = 0;
+      for (int i = 0; i < 8; i++) {
+        c |= line.level(edge + (1.5 + i) * bitTime) << i;
+      }
+      out[n++] = c;
+      cursor = edge + 9.5 * bitTime;
+    }
+    return n;
+  }
+
+ private:
+  const Line &line;
+  double bitTime;
+  double cursor;
+};
+
+/*
+ * The USART in an ATmega328P at 16MHz, as set up by BitBusUart::begin():
+ * the rate it actually runs at is off by as much as 2% from the one asked
+ * for. Holds what it reads in a buffer of RX_BUFFER_SIZE bytes.
+ */
+class ModelUart
+{
+ public:
+  ModelUart(const Line &line) : reader(line), head(0), tail(0), dropped(0), rate(0) {}
+
+  void begin(unsigned long baudRate) {
+    unsigned long divisor = (F_CPU / 4 / baudRate - 1) / 2;
+    double actual = F_CPU / 8.0 / (divisor + 1);
+    if ((F_CPU == 16000000UL && 57600 == baudRate) || divisor > 4095) {
+      divisor = (F_CPU / 8 / baudRate - 1) / 2;
+      actual = F_CPU / 16.0 / (divisor + 1);
+    }
+    reader.setRate(actual);
+    rate = baudRate;
+    head = tail = 0;
+  }
+
+  int available() { return head - tail; }
+  int read() { return head != tail ? buffer[tail++ % RX_BUFFER_SIZE] : -1; }
+
+  // Receive what arrives by time until
+  void run(double until) {
+    uint8_t buf[256];
+    size_t n;
+    while ((n = reader.read(until, buf, sizeof(buf))) > 0) {
+      for (size_t i = 0; i < n; i++) {
+        if (head - tail < RX_BUFFER_SIZE) {
+          buffer[head++ % RX_BUFFER_SIZE] = buf[i];
+        } else {
+          dropped++;
+        }
+      }
+    }
+  }
+
+  LineReader reader;
+  uint8_t buffer[RX_BUFFER_SIZE];
+  unsigned long head;
+  unsigned long tail;
+  unsigned long dropped;
+  unsigned long rate;
+};
+
+static AppMessage sent[MESSAGES];
+
+// Send MESSAGES messages from the app
+static void sendSession(Line *line, unsigned long seed) {
+  AppOptions options;
+  options.format = APP_FORMAT_MIXED;
+  options.trajectory = APP_TRAJECTORY_WALK;
+  options.buttonsPerFrame = 0.5;
+  options.seed = seed;
+  AppEmulator app(options);
+  for (int i = 0; i < MESSAGES; i++) {
+    uint8_t buf[APP_MESSAGE_MAX];
+    size_t len = app.next(buf, &sent[i]);
+    line->send(buf, len, i * MESSAGE_PERIOD);
+  }
+}
+
+/*
+ * Check what was decoded after the rate was found: every message sent from
+ * some point on, none lost and nothing else.
+ *
+ * Returns: the number of messages decoded, or -1 if they don't match
+ */
+static int matchDecoded() {
+  int first = MESSAGES - decodedCount;
+  for (int d = 0; d < decodedCount; d++) {
+    if (first < 0 || strcmp(decoded[d], sent[first + d].text)) {
+      return -1;
+    }
+  }
+  return decodedCount;
+}
+
+static void testDetector() {
+  _BitBusBaudDetector detector;
+  CHECK(9600 == detector.start(1000), "9600 is tried first");
+  CHECK(9600 == detector.update(NULL, 0, 1000 + BITBUS_AUTO_BAUD_DWELL_MS - 1), "a quiet rate is kept for a while");
+  CHECK(38400 == detector.update(NULL, 0, 1000 + BITBUS_AUTO_BAUD_DWELL_MS), "then the next one is tried");
+
+  const char *noise = "\x80\x00\xff\xf0\x80\x00\xff\xf0\x80\x00\xff\xf0\x80\x00\xff\xf0";
+  unsigned long rate = 38400;
+  for (int i = 0; i < BITBUS_AUTO_BAUD_ERRORS && 38400 == rate; i++) {
+    rate = detector.update((const uint8_t *)noise, ANALOG_DEC_MESSAGE_LEN, 1000 + BITBUS_AUTO_BAUD_DWELL_MS);
+  }
+  CHECK(115200 == rate, "a message's worth of noise at a time is enough to move on");
+
+  const char *messages = "R00F00B00LFFR00F00B00XL255R000F000B000Y";
+  rate = detector.update((const uint8_t *)messages, strlen(messages), 1000 + BITBUS_AUTO_BAUD_DWELL_MS);
+  CHECK(detector.isLocked() && 115200 == rate, "three messages after the tail of one lock the rate in");
+  rate = detector.update((const uint8_t *)noise, 16, 1000 + 10 * BITBUS_AUTO_BAUD_DWELL_MS);
+  CHECK(detector.isLocked() && 115200 == rate, "a locked rate stays");
+
+  CHECK(9600 == detector.start(0) && !detector.isLocked(), "start() starts over");
+}
+
+/*
+ * The module at each rate it can be set to, read by a BitBusUart, with the
+ * module's clock off by skew as well.
+ */
+static void testRate(unsigned long rate, double skew) {
+  Line *line = new Line(rate * (1 + skew));
+  sendSession(line, rate);
+  ModelUart uart(*line);
+  GamePadModule pad;
+  pad.onButtonPressed(onButton);
+  pad.onAnalogUpdate(onAnalog);
+  BitBusT<BitBusStreamTransport<ModelUart> > bus(pad);
+  bus.begin(uart, BITBUS_AUTO_BAUD);
+  decodedCount = 0;
+
+  double lockedAt = -1;
+  for (double t = 0; t < line->end() + LOOP_PERIOD; t += LOOP_PERIOD) {
+    uart.run(t);
+    bus.processInput();
+    if (lockedAt < 0 && bus.getBaudRate()) {
+      lockedAt = t;
+    }
+  }
+
+  char msg[80];
+  int matched = matchDecoded();
+  printf("%6lu baud %+.1f%%: locked at %.3f s, %d messages after that, %lu bytes dropped\n", rate, skew * 100,
+         lockedAt, matched, uart.dropped);
+  snprintf(msg, sizeof(msg), "%lu baud %+.1f%% is found", rate, skew * 100);
+  CHECK(rate == bus.getBaudRate(), msg);
+  snprintf(msg, sizeof(msg), "%lu baud %+.1f%% reads every message after the lock", rate, skew * 100);
+  CHECK(matched > 0 && 0 == uart.dropped, msg);
+  delete line;
+}
+
+// A rate the detector doesn't try is never locked in
+static void testUnknownRate() {
+  Line *line = new Line(250000);
+  sendSession(line, 1);
+  ModelUart uart(*line);
+  GamePadModule pad;
+  pad.onButtonPressed(onButton);
+  pad.onAnalogUpdate(onAnalog);
+  BitBusT<BitBusStreamTransport<ModelUart> > bus(pad);
+  bus.begin(uart, BITBUS_AUTO_BAUD);
+  decodedCount = 0;
+  for (double t = 0; t < line->end() + LOOP_PERIOD; t += LOOP_PERIOD) {
+    uart.run(t);
+    bus.processInput();
+  }
+  CHECK(0 == bus.getBaudRate(), "250000 baud is never locked in");
+  CHECK(0 == decodedCount, "nothing is decoded");
+  delete line;
+}
+
+// The BitBus singleton, reading its SoftwareSerial
+static void testSingleton() {
+  Line *line = new Line(38400);
+  sendSession(line, 2);
+  LineReader reader(*line);
+  GamePad._clear();
+  GamePad.onButtonPressed(onButton);
+  GamePad.onAnalogUpdate(onAnalog);
+  BitBus.begin(BITBUS_AUTO_BAUD);
+  SoftwareSerial *rx = SoftwareSerial::_hostListener();
+  CHECK(0 == BitBus.getBaudRate(), "no rate until one is found");
+  decodedCount = 0;
+
+  for (double t = 0; t < line->end() + LOOP_PERIOD; t += LOOP_PERIOD) {
+    reader.setRate(rx->speed);
+    uint8_t buf[256];
+    size_t n;
+    while ((n = reader.read(t, buf, sizeof(buf))) > 0) {
+      rx->_hostInject(buf, n);
+    }
+    BitBus.processInput();
+  }
+  CHECK(38400 == BitBus.getBaudRate(), "the singleton finds 38400 baud");
+  CHECK(38400 == rx->speed, "and leaves its SoftwareSerial at it");
+  CHECK(matchDecoded() > 0, "then reads every message");
+
+  BitBus.begin(9600);
+  CHECK(9600 == BitBus.getBaudRate(), "a rate given to begin() is kept");
+  GamePad.onButtonPressed(NULL);
+  GamePad.onAnalogUpdate(NULL);
+  delete line;
+}
+
+int main() {
+  Serial._hostSetEcho(false);
+  testDetector();
+  static const unsigned long rates[] = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+  for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+    testRate(rates[i], 0);
+  }
+  // A module's clock is good to a percent or so either way
+  testRate(115200, 0.01);
+  testRate(115200, -0.01);
+  testRate(57600, -0.01);
+  testRate(9600, 0.01);
+  testUnknownRate();
+  testSingleton();
+
+  return hostTestResult("Baud rate detection");
+}
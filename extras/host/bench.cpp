@@ -0,0 +1,428 @@
+/*
+ * Byte throughput benchmark for the BitBus parser on the host.
+ *
+ * Pushes synthetic byte streams (and optionally a recorded one) through
+ * both _MessageBuffer::processInput() APIs, both GamePad._processInput() APIs,
+ * BitBus.processInput() with and without a byte budget and a BitBusT reading
+ * from memory and reports the average cost per byte, completed
+ * frames per second and the worst single call (one byte, one message for the
+ * _MessageBuffer buffer API, or up to 64 bytes for the rest).
+ *
+ * It then compares the integer joystick getters, getAngle() and friends, with
+ * the same results worked out in floating point, the way Dabble does.
+ *
+ * Usage: bench [--file recorded.bin] [--capture capture.bbc] [--min-ms N]
+ *   --file     raw bytes
+ *   --capture  a BitBusCapture, timing is ignored
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "BitBus.h"
+#include "FileCapture.h"
+#include "GamePad.h"
+#include "MessageBuffer.h"
+#include "SoftwareSerial.h"
+
+#define MAX_STREAM_SIZE 65536
+#define WORST_CASE_PASSES 5
+
+struct bench_stream {
+  const char *name;
+  uint8_t *data;
+  size_t len;
+};
+
+struct bench_result {
+  double nsPerByte;
+  double framesPerSec;
+  double worstNs;
+  unsigned long frames;
+};
+
+static uint64_t nowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Small deterministic generator so every run sees the same streams
+static uint32_t lcgState = 12345;
+static uint32_t lcg() {
+  lcgState = lcgState * 1103515245UL + 12345UL;
+  return lcgState >> 8;
+}
+
+static const char hexChars[] = "0123456789ABCDEF";
+
+static size_t appendHexFrame(uint8_t *buf, uint8_t l, uint8_t r, uint8_t f, uint8_t b) {
+  uint8_t values[4] = {l, r, f, b};
+  const char *letters = "LRFB";
+  size_t n = 0;
+  for (int i = 0; i < 4; i++) {
+    buf[n++] = letters[i];
+    buf[n++] = hexChars[values[i] >> 4];
+    buf[n++] = hexChars[values[i] & 0x0F];
+  }
+  return n;
+}
+
+static size_t appendDecFrame(uint8_t *buf, uint8_t l, uint8_t r, uint8_t f, uint8_t b) {
+  uint8_t values[4] = {l, r, f, b};
+  const char *letters = "LRFB";
+  size_t n = 0;
+  for (int i = 0; i < 4; i++) {
+    buf[n++] = letters[i];
+    buf[n++] = '0' + values[i] / 100;
+    buf[n++] = '0' + (values[i] / 10) % 10;
+    buf[n++] = '0' + values[i] % 10;
+  }
+  return n;
+}
+
+static void makeStream(struct bench_stream *stream, const char *name) {
+  stream->name = name;
+  stream->data = (uint8_t *)malloc(MAX_STREAM_SIZE);
+  stream->len = 0;
+}
+
+static void buildHexStream(struct bench_stream *s) {
+  makeStream(s, "hex frames");
+  while (s->len + 12 <= MAX_STREAM_SIZE) {
+    s->len += appendHexFrame(s->data + s->len, lcg(), lcg(), lcg(), lcg());
+  }
+}
+
+static void buildDecStream(struct bench_stream *s) {
+  makeStream(s, "dec frames");
+  while (s->len + 16 <= MAX_STREAM_SIZE) {
+    s->len += appendDecFrame(s->data + s->len, lcg(), lcg(), lcg(), lcg());
+  }
+}
+
+static void buildButtonStream(struct bench_stream *s) {
+  static const char buttons[] = "SCABXY";
+  makeStream(s, "buttons");
+  while (s->len < MAX_STREAM_SIZE) {
+    s->data[s->len++] = buttons[lcg() % 6];
+  }
+}
+
+static void buildGarbageStream(struct bench_stream *s) {
+  makeStream(s, "garbage");
+  while (s->len < MAX_STREAM_SIZE) {
+    s->data[s->len++] = lcg() & 0xFF;
+  }
+}
+
+/*
+ * Approximates a real session: a joystick sweeping around the circle with
+ * the occasional button press, mostly in the app's default hex mode.
+ */
+static void buildSessionStream(struct bench_stream *s) {
+  static const char buttons[] = "SCABXY";
+  makeStream(s, "session");
+  unsigned step = 0;
+  while (s->len + 16 <= MAX_STREAM_SIZE) {
+    if (lcg() % 20 == 0) {
+      s->data[s->len++] = buttons[lcg() % 6];
+      continue;
+    }
+    uint8_t phase = step++ & 0xFF;
+    uint8_t x = phase < 128 ? phase * 2 : (255 - phase) * 2;
+    uint8_t y = 255 - x;
+    s->len += appendHexFrame(s->data + s->len, x, y, y / 2, x / 2);
+  }
+}
+
+static bool loadStream(struct bench_stream *s, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  makeStream(s, path);
+  s->len = fread(s->data, 1, MAX_STREAM_SIZE, f);
+  fclose(f);
+  return s->len > 0;
+}
+
+// The data bytes of a capture, without the record headers
+static bool loadCapture(struct bench_stream *s, const char *path) {
+  size_t len;
+  uint8_t *log = loadCaptureFile(path, &len);
+  if (!log) {
+    return false;
+  }
+  BitBusReplay replay;
+  bool ok = replay.begin(log, len);
+  if (!ok) {
+    fprintf(stderr, "%s: not a BitBus capture\n", path);
+  } else {
+    makeStream(s, path);
+    int c;
+    while (s->len < MAX_STREAM_SIZE && (c = replay.read()) >= 0) {
+      s->data[s->len++] = c;
+    }
+  }
+  free(log);
+  return ok && s->len > 0;
+}
+
+static _MessageBuffer mb;
+
+/*
+ * Each target processes input starting at buf and returns how many
+ * characters it used: one for the per character APIs, up to a whole
+ * message for the buffer API.
+ */
+typedef size_t (*step_func)(const uint8_t *buf, size_t len);
+
+static size_t stepMessageBuffer(const uint8_t *buf, size_t len) {
+  mb.processInput(*buf);
+  return 1;
+}
+
+static size_t stepMessageBufferBuffered(const uint8_t *buf, size_t len) {
+  size_t consumed;
+  mb.processInput(buf, len, &consumed);
+  return consumed;
+}
+
+static size_t stepGamePad(const uint8_t *buf, size_t len) {
+  GamePad._processInput(*buf);
+  return 1;
+}
+
+static size_t stepGamePadBuffered(const uint8_t *buf, size_t len) {
+  GamePad._processInput(buf, len < _SS_MAX_RX_BUFF ? len : _SS_MAX_RX_BUFF);
+  return len < _SS_MAX_RX_BUFF ? len : _SS_MAX_RX_BUFF;
+}
+
+// Deliver up to a full SoftwareSerial buffer of input, then drain it.
+static size_t stepBitBus(const uint8_t *buf, size_t len) {
+  size_t n = SoftwareSerial::_hostListener()->_hostInject(buf, len);
+  BitBus.processInput();
+  return n;
+}
+
+// Keep the SoftwareSerial buffer topped up, but only parse 16 bytes per call.
+static size_t stepBitBusBudget(const uint8_t *buf, size_t len) {
+  size_t n = SoftwareSerial::_hostListener()->_hostInject(buf, len);
+  BitBus.processInput(16U);
+  return n;
+}
+
+// Same chunks as stepBitBus, but through a transport without virtual calls.
+static BitBusT<BitBusMemoryTransport> memoryBus;
+
+static size_t stepMemoryBus(const uint8_t *buf, size_t len) {
+  size_t n = len < _SS_MAX_RX_BUFF ? len : _SS_MAX_RX_BUFF;
+  memoryBus.begin(buf, n);
+  memoryBus.processInput();
+  return n;
+}
+
+struct bench_target {
+  const char *name;
+  step_func step;
+};
+
+static const struct bench_target targets[] = {
+  {"_MessageBuffer",          stepMessageBuffer},
+  {"_MessageBuffer (buffer)", stepMessageBufferBuffered},
+  {"GamePad._processInput",   stepGamePad},
+  {"GamePad (buffer)",        stepGamePadBuffered},
+  {"BitBus.processInput",     stepBitBus},
+  {"BitBus.processInput(16)", stepBitBusBudget},
+  {"BitBusT<Memory>",         stepMemoryBus},
+};
+
+/*
+ * Count the complete messages in a stream with a fresh parser.
+ */
+static unsigned long countFrames(const struct bench_stream *s) {
+  _MessageBuffer counter;
+  unsigned long frames = 0;
+  for (size_t i = 0; i < s->len; i++) {
+    if (counter.processInput(s->data[i]) == 0) {
+      frames++;
+    }
+  }
+  return frames;
+}
+
+/*
+ * Run the stream through the parser until at least minNanos has elapsed,
+ * then time every call to find the worst case.
+ */
+static void runBench(const struct bench_stream *s, step_func step, uint64_t minNanos,
+                     struct bench_result *result) {
+  unsigned long framesPerPass = countFrames(s);
+  unsigned long frames = 0;
+  uint64_t bytes = 0;
+  uint64_t start = nowNanos();
+  uint64_t elapsed;
+
+  mb.clear();
+  GamePad._clear();
+  do {
+    size_t pos = 0;
+    while (pos < s->len) {
+      pos += step(s->data + pos, s->len - pos);
+    }
+    bytes += s->len;
+    frames += framesPerPass;
+    elapsed = nowNanos() - start;
+  } while (elapsed < minNanos);
+
+  /*
+   * Time each call individually over a few passes. Keeping the fastest time
+   * seen for each call filters out preemption by the OS, the slowest call
+   * is then the parser's own worst case.
+   */
+  uint64_t *best = (uint64_t *)malloc(s->len * sizeof(uint64_t));
+  size_t calls = 0;
+  for (int pass = 0; pass < WORST_CASE_PASSES; pass++) {
+    size_t pos = 0;
+    mb.clear();
+    GamePad._clear();
+    for (calls = 0; pos < s->len; calls++) {
+      uint64_t t0 = nowNanos();
+      pos += step(s->data + pos, s->len - pos);
+      uint64_t t = nowNanos() - t0;
+      if (pass == 0 || t < best[calls]) {
+        best[calls] = t;
+      }
+    }
+  }
+  uint64_t worst = 0;
+  for (size_t i = 0; i < calls; i++) {
+    if (best[i] > worst) {
+      worst = best[i];
+    }
+  }
+  free(best);
+
+  result->nsPerByte = (double)elapsed / bytes;
+  result->framesPerSec = frames * 1e9 / elapsed;
+  result->worstNs = (double)worst;
+  result->frames = frames;
+}
+
+static void printResult(const char *streamName, const char *target, const struct bench_stream *s,
+                        const struct bench_result *r) {
+  printf("%-12s %-26s %8zu %10.2f %14.0f %12.0f\n",
+         streamName, target, s->len, r->nsPerByte, r->framesPerSec, r->worstNs);
+}
+
+// Keeps the compiler from dropping the work being measured
+static volatile int32_t joystickSink;
+
+enum joystick_mode { JOYSTICK_PARSE_ONLY, JOYSTICK_INTEGER, JOYSTICK_FLOAT };
+
+// The polar form in floating point, like Dabble's getAngle(), getRadius(), getx_axis() and gety_axis()
+static void floatJoystick() {
+  float dx = (float)GamePad.getRightPosition() - GamePad.getLeftPosition();
+  float dy = (float)GamePad.getUpPosition() - GamePad.getDownPosition();
+  float angle = atan2f(dy, dx);
+  float radius = sqrtf(dx * dx + dy * dy) * 7 / 255;
+  radius = (radius > 7) ? 7 : radius;
+  float degrees = angle * (float)(180 / M_PI);
+  joystickSink += (int32_t)(degrees < 0 ? degrees + 360 : degrees) + (int32_t)radius
+    + (int32_t)(radius * cosf(angle)) + (int32_t)(radius * sinf(angle));
+}
+
+// Returns: ns per analog message, parsing it and then reading the polar form as mode says
+static double runJoystick(const struct bench_stream *s, enum joystick_mode mode, uint64_t minNanos) {
+  uint64_t elapsed = 0;
+  unsigned long messages = 0;
+  GamePad._clear();
+  while (elapsed < minNanos) {
+    uint64_t start = nowNanos();
+    for (size_t pos = 0; pos + ANALOG_HEX_MESSAGE_LEN <= s->len; pos += ANALOG_HEX_MESSAGE_LEN) {
+      GamePad._processInput(s->data + pos, ANALOG_HEX_MESSAGE_LEN);
+      if (JOYSTICK_INTEGER == mode) {
+        joystickSink += GamePad.getAngle() + GamePad.getRadius() + GamePad.getx_axis() + GamePad.gety_axis();
+      } else if (JOYSTICK_FLOAT == mode) {
+        floatJoystick();
+      }
+      messages++;
+    }
+    elapsed += nowNanos() - start;
+  }
+  return (double)elapsed / messages;
+}
+
+static void benchJoystick(const struct bench_stream *hexStream, uint64_t minNanos) {
+  double parse = runJoystick(hexStream, JOYSTICK_PARSE_ONLY, minNanos);
+  double integer = runJoystick(hexStream, JOYSTICK_INTEGER, minNanos);
+  double floating = runJoystick(hexStream, JOYSTICK_FLOAT, minNanos);
+  printf("\n%-26s %14s\n", "joystick polar form", "ns/position");
+  printf("%-26s %14.2f\n", "integer tables", integer - parse);
+  printf("%-26s %14.2f\n", "float reference", floating - parse);
+}
+
+int main(int argc, char **argv) {
+  const char *recordedPath = NULL;
+  const char *capturePath = NULL;
+  unsigned long minMs = 200;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--file") && i + 1 < argc) {
+      recordedPath = argv[++i];
+    } else if (!strcmp(argv[i], "--capture") && i + 1 < argc) {
+      capturePath = argv[++i];
+    } else if (!strcmp(argv[i], "--min-ms") && i + 1 < argc) {
+      minMs = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--file recorded.bin] [--capture capture.bbc] [--min-ms N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  // The library may print debug output, keep the report readable
+  Serial._hostSetEcho(false);
+  BitBus.begin();
+
+  struct bench_stream streams[7];
+  int numStreams = 0;
+  buildHexStream(&streams[numStreams++]);
+  buildDecStream(&streams[numStreams++]);
+  buildButtonStream(&streams[numStreams++]);
+  buildGarbageStream(&streams[numStreams++]);
+  buildSessionStream(&streams[numStreams++]);
+  if (recordedPath) {
+    if (!loadStream(&streams[numStreams], recordedPath)) {
+      return 1;
+    }
+    numStreams++;
+  }
+  if (capturePath) {
+    if (!loadCapture(&streams[numStreams], capturePath)) {
+      return 1;
+    }
+    numStreams++;
+  }
+
+  printf("%-12s %-26s %8s %10s %14s %12s\n",
+         "stream", "target", "bytes", "ns/byte", "frames/sec", "worst ns/call");
+  for (int i = 0; i < numStreams; i++) {
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+      struct bench_result r;
+      runBench(&streams[i], targets[t].step, minMs * 1000000ULL, &r);
+      printResult(streams[i].name, targets[t].name, &streams[i], &r);
+    }
+  }
+  // The hex stream is nothing but analog messages
+  benchJoystick(&streams[0], minMs * 1000000ULL);
+
+  for (int i = 0; i < numStreams; i++) {
+    free(streams[i].data);
+  }
+  return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Checks GamePad.setCoalescing() against a transport that overflows, and
+ * measures how long BitBus takes to catch up on a backlog of joystick
+ * messages with and without it.
+ *
+ * Usage: coalesce_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "BitBus.h"
+#include "GamePad.h"
+#include "HostTest.h"
+
+/*
+ * A receive buffer that fills up like SoftwareSerial's: bytes that arrive
+ * while it is full are lost, and overflow() reports it once.
+ */
+class OverflowTransport
+{
+public:
+  void begin() { head = tail = 0; overflowed = false; }
+  void receive(const char *bytes) {
+    for (; *bytes; bytes++) {
+      if (head - tail == sizeof(buf)) {
+        overflowed = true;
+      } else {
+        buf[head++ % sizeof(buf)] = *bytes;
+      }
+    }
+  }
+  int available() { return head - tail; }
+  int read() { return (head == tail) ? -1 : buf[tail++ % sizeof(buf)]; }
+  bool overflow() { bool result = overflowed; overflowed = false; return result; }
+
+private:
+  uint8_t buf[64];
+  unsigned int head;
+  unsigned int tail;
+  bool overflowed;
+};
+
+static unsigned long errorCount;
+static void countError(uint8_t error) {
+  errorCount++;
+}
+
+static void testOverflow(bool coalescing) {
+  BitBusT<OverflowTransport> bus;
+  bus.begin();
+  GamePad._clear();
+  GamePad.setCoalescing(coalescing);
+  errorCount = 0;
+
+  // 5 * 12 bytes fit, the rest of the sixth message and the seventh are lost
+  for (int i = 0; i < 7; i++) {
+    bus.receive("L00R10F00B00");
+  }
+  bus.receive("L00R20F00B00");
+  bus.processInput();
+  // The message after the gap arrives once there is room
+  bus.receive("B00L00R30F00B00");
+  bus.processInput();
+
+  if (coalescing) {
+    CHECK(0 == errorCount, "no errors from the message cut off by the overflow");
+    CHECK(0x30 == GamePad.getRightPosition(), "the newest position is applied");
+    CHECK(!GamePad.isBPressed(), "no button out of the cut off message");
+  } else {
+    CHECK(errorCount > 0, "the default mode parses across the gap");
+  }
+  GamePad.setCoalescing(false);
+}
+
+// An action button right after the gap is still reported
+static void testButtonAfterOverflow() {
+  BitBusT<OverflowTransport> bus;
+  bus.begin();
+  GamePad._clear();
+  GamePad.setCoalescing(true);
+
+  for (int i = 0; i < 6; i++) {
+    bus.receive("L00R10F00B00");
+  }
+  bus.processInput();
+  bus.receive("A");
+  bus.processInput();
+  CHECK(GamePad.isAPressed(), "the A press after the overflow is reported");
+  GamePad.setCoalescing(false);
+  GamePad._clear();
+}
+
+// A gap left over when coalescing is turned off is forgotten
+static void testGapForgottenWithoutCoalescing() {
+  BitBusT<OverflowTransport> bus;
+  bus.begin();
+  GamePad._clear();
+  GamePad.setCoalescing(true);
+  errorCount = 0;
+
+  // The overflow leaves a gap after all 64 bytes waiting, only 24 are read
+  for (int i = 0; i < 5; i++) {
+    bus.receive("L00R10F00B00");
+  }
+  bus.receive("L00R20F00B00");
+  bus.processInput(24);
+  GamePad.setCoalescing(false);
+  bus.processInput();
+  // The rest of the cut off message completes it rather than being skipped
+  bus.receive("20F00B00");
+  bus.processInput();
+  CHECK(0 == errorCount, "no errors without a gap skipped to");
+  CHECK(0x20 == GamePad.getRightPosition(), "the cut off message is completed");
+  GamePad._clear();
+}
+
+// A message is only skipped for a next one that has all its letters in place
+static void testSupersededNeedsWholeNextMessage() {
+  static const char broken[] = "L00R10F00B00L0R20F00B00A";
+  BitBusT<BitBusMemoryTransport> bus;
+  GamePad._clear();
+  GamePad.setCoalescing(true);
+  errorCount = 0;
+  bus.begin((const uint8_t *)broken, strlen(broken));
+  bus.processInput();
+  CHECK(0x10 == GamePad.getRightPosition(), "the message before a broken one is applied");
+  CHECK(errorCount > 0, "the broken message is an error");
+
+  static const char frames[] = "L00R10F00B00L000R020F000B000L00R30F00B00";
+#if BITBUS_STATS
+  BitBusResetStats();
+#endif
+  // In one chunk, as BitBus reads at most BITBUS_INPUT_BUFFER_SIZE bytes at a time
+  GamePad._clear();
+  GamePad._processInput((const uint8_t *)frames, strlen(frames));
+  GamePad._flushCoalesced();
+  CHECK(0x30 == GamePad.getRightPosition(), "the newest of hex and decimal messages is applied");
+#if BITBUS_STATS
+  const BitBusStats &stats = BitBusGetStats();
+  CHECK(2 == stats.superseded, "two messages skipped");
+  CHECK(1 == stats.frames[MT_ANALOG_POSITION], "only the decoded message counts as a frame");
+  BitBusResetStats();
+#endif
+  GamePad.setCoalescing(false);
+  GamePad._clear();
+}
+
+static uint64_t nowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static volatile unsigned long analogCallbacks;
+static void countAnalog(uint8_t left, uint8_t right, uint8_t up, uint8_t down) {
+  analogCallbacks++;
+}
+
+// Returns: ns for one processInput() call to drain a backlog of frames joystick messages
+static double catchUp(size_t frames, bool coalescing) {
+  static const char frame[] = "L10R20F30B40";
+  size_t len = frames * (sizeof(frame) - 1);
+  uint8_t *backlog = (uint8_t *)malloc(len);
+  for (size_t i = 0; i < frames; i++) {
+    memcpy(backlog + i * (sizeof(frame) - 1), frame, sizeof(frame) - 1);
+  }
+
+  BitBusT<BitBusMemoryTransport> bus;
+  GamePad._clear();
+  GamePad.setCoalescing(coalescing);
+  uint64_t best = ~0ULL;
+  for (int pass = 0; pass < 50; pass++) {
+    bus.begin(backlog, len);
+    uint64_t start = nowNanos();
+    bus.processInput();
+    uint64_t elapsed = nowNanos() - start;
+    best = (elapsed < best) ? elapsed : best;
+  }
+  GamePad.setCoalescing(false);
+  free(backlog);
+  return (double)best;
+}
+
+int main() {
+  Serial._hostSetEcho(false);
+  GamePad.onParseError(countError);
+  testOverflow(false);
+  testOverflow(true);
+  testButtonAfterOverflow();
+  testGapForgottenWithoutCoalescing();
+  testSupersededNeedsWholeNextMessage();
+  GamePad.onParseError(NULL);
+
+  // The analog callback stands in for the work a sketch does per update
+  GamePad.onAnalogUpdate(countAnalog);
+  printf("%-16s %14s %14s\n", "backlog frames", "default ns", "coalescing ns");
+  static const size_t backlogs[] = {1, 5, 50, 500};
+  for (size_t i = 0; i < sizeof(backlogs) / sizeof(backlogs[0]); i++) {
+    printf("%-16zu %14.0f %14.0f\n", backlogs[i], catchUp(backlogs[i], false), catchUp(backlogs[i], true));
+  }
+  GamePad.onAnalogUpdate(NULL);
+
+  return hostTestResult("Coalescing");
+}
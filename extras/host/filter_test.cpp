@@ -0,0 +1,96 @@
+/*
+ * Checks the analog filter stages. The Makefile builds this, and a copy of
+ * the library, with every stage turned on:
+ *   GAMEPAD_SMOOTHING=2 GAMEPAD_DEADZONE=8 GAMEPAD_HYSTERESIS=16
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "GamePad.h"
+#include "HostTest.h"
+
+#if !GAMEPAD_SMOOTHING || !GAMEPAD_DEADZONE || !GAMEPAD_HYSTERESIS
+#error "Build with every filter stage turned on"
+#endif
+
+static const char hexChars[] = "0123456789ABCDEF";
+
+static void sendPosition(uint8_t left, uint8_t right, uint8_t up, uint8_t down) {
+  uint8_t values[4] = {left, right, up, down};
+  const char *letters = "LRFB";
+  uint8_t frame[ANALOG_HEX_MESSAGE_LEN];
+  for (int i = 0; i < 4; i++) {
+    frame[i * 3] = letters[i];
+    frame[i * 3 + 1] = hexChars[values[i] >> 4];
+    frame[i * 3 + 2] = hexChars[values[i] & 0x0F];
+  }
+  GamePad._processInput(frame, sizeof(frame));
+}
+
+// Returns: what one step of smoothing from 0 makes of value
+static uint8_t firstStep(uint8_t value) {
+  return ((((int16_t)value << 7) >> GAMEPAD_SMOOTHING) + 64) >> 7;
+}
+
+static void testDeadzone() {
+  GamePad._clear();
+  for (int i = 0; i < 50; i++) {
+    sendPosition(0, GAMEPAD_DEADZONE, i & 1 ? GAMEPAD_DEADZONE / 2 : 0, 0);
+  }
+  CHECK(0 == GAMEPAD_DEADZONE || 0 == GamePad.getRightPosition(), "jitter inside the deadzone reads as 0");
+  CHECK(!GamePad.isRightPressed() && !GamePad.isUpPressed(), "no direction inside the deadzone");
+}
+
+static void testSmoothing() {
+  GamePad._clear();
+  sendPosition(0, 200, 0, 0);
+  CHECK(GamePad.getRightPosition() == firstStep(200), "first step moves 1/2^N of the way");
+  for (int i = 0; i < 100; i++) {
+    sendPosition(0, 200, 0, 0);
+  }
+  CHECK(GamePad.getRightPosition() == 200, "smoothing settles on the input");
+  CHECK(GamePad.isRightPressed(), "right pressed");
+
+  for (int i = 0; i < 100; i++) {
+    sendPosition(0, 0, 0, 0);
+  }
+  CHECK(GamePad.getRightPosition() == 0, "smoothing settles back at 0");
+  CHECK(!GamePad.isRightPressed(), "released");
+}
+
+static void testHysteresis() {
+  GamePad._clear();
+  for (int i = 0; i < 100; i++) {
+    sendPosition(0, 150, 150, 0);
+  }
+  bool up = GamePad.isUpPressed();
+  CHECK(up || GamePad.isRightPressed(), "one direction on the diagonal");
+
+  // Wobble around the diagonal
+  int changes = 0;
+  for (int i = 0; i < 200; i++) {
+    uint8_t wobble = (i & 1) ? 10 : 0;
+    sendPosition(0, 145 + wobble, 155 - wobble, 0);
+    if (GamePad.isUpPressed() != up) {
+      up = !up;
+      changes++;
+    }
+  }
+  CHECK(0 == changes, "no flapping near the diagonal");
+
+  // A clear move still changes direction
+  for (int i = 0; i < 20; i++) {
+    sendPosition(0, up ? 255 : 0, up ? 0 : 255, 0);
+  }
+  CHECK(GamePad.isUpPressed() != up, "direction changes once another axis leads");
+}
+
+int main() {
+  Serial._hostSetEcho(false);
+  testDeadzone();
+  testSmoothing();
+  testHysteresis();
+  return hostTestResult("GamePad filter");
+}
@@ -0,0 +1,41 @@
+/**
+ * Host shim for the Arduino HardwareSerial class.
+ *
+ * Output written to Serial goes to stdout. Input can be queued with
+ * _hostInject() so a test can play the part of the remote end.
+ */
+#ifndef HOST_HARDWARE_SERIAL_H
+#define HOST_HARDWARE_SERIAL_H
+
+#include "Stream.h"
+#include "HostBuffer.h"
+
+class HardwareSerial : public Stream
+{
+ public:
+  HardwareSerial();
+
+  void begin(unsigned long baudRate);
+  void end();
+
+  virtual int available();
+  virtual int read();
+  virtual int peek();
+  virtual size_t write(uint8_t c);
+  using Print::write;
+
+  operator bool() { return true; }
+
+  // Host only: queue bytes to be returned from read().
+  size_t _hostInject(const uint8_t *data, size_t len);
+  // Host only: turn writes to stdout on or off. Benchmarks run quietly.
+  void _hostSetEcho(bool echo);
+
+ private:
+  _HostBuffer rxBuffer;
+  bool echo;
+};
+
+extern HardwareSerial Serial;
+
+#endif
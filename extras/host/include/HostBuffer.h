@@ -0,0 +1,75 @@
+/**
+ * HostBuffer: FIFO used by the host serial shims to model a receive buffer.
+ *
+ * Like the AVR cores, a full buffer drops incoming bytes and raises an
+ * overflow flag instead of blocking.
+ */
+#ifndef HOST_BUFFER_H
+#define HOST_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class _HostBuffer
+{
+ public:
+  static const size_t MAX_CAPACITY = 4096;
+
+  _HostBuffer(size_t capacity) : capacity(capacity), head(0), tail(0), overflowed(false) {
+    if (this->capacity > MAX_CAPACITY) {
+      this->capacity = MAX_CAPACITY;
+    }
+  }
+
+  // Returns: the number of bytes accepted. The rest are dropped.
+  size_t push(const uint8_t *data, size_t len) {
+    size_t i;
+    for (i = 0; i < len; i++) {
+      if (count() >= capacity) {
+        overflowed = true;
+        break;
+      }
+      storage[head % MAX_CAPACITY] = data[i];
+      head++;
+    }
+    return i;
+  }
+
+  int pop() {
+    if (head == tail) {
+      return -1;
+    }
+    return storage[tail++ % MAX_CAPACITY];
+  }
+
+  int peek() const {
+    if (head == tail) {
+      return -1;
+    }
+    return storage[tail % MAX_CAPACITY];
+  }
+
+  size_t count() const { return head - tail; }
+
+  void clear() { head = tail = 0; overflowed = false; }
+
+  void setCapacity(size_t newCapacity) {
+    capacity = newCapacity > MAX_CAPACITY ? MAX_CAPACITY : newCapacity;
+  }
+
+  // Returns and clears the overflow flag.
+  bool overflow() {
+    bool result = overflowed;
+    overflowed = false;
+    return result;
+  }
+
+ private:
+  size_t capacity;
+  size_t head;
+  size_t tail;
+  bool overflowed;
+  uint8_t storage[MAX_CAPACITY];
+};
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * HostTest: the checks shared by the host only tests, one binary per test.
+ *
+ *   CHECK(GamePad.isXPressed(), "X from the last chunk");
+ *   ...
+ *   return hostTestResult("BitBusCapture");
+ *
+ * Tests of AppEmulator traffic can also collect the text of every message
+ * a GamePadModule decodes: define HOST_TEST_DECODED to the most messages
+ * to keep and include this after AppEmulator.h, then hand onButton and
+ * onAnalog to the pad and compare decoded[] with what was sent.
+ */
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond, msg)                                  \
+  do {                                                    \
+    if (!(cond)) {                                        \
+      printf("FAIL: %s (line %d)\n", (msg), __LINE__);    \
+      failures++;                                         \
+    }                                                     \
+  } while (0)
+
+// Print how the checks went. Returns: the exit status for main()
+static inline int hostTestResult(const char *name) {
+  if (failures) {
+    printf("%s: %d checks failed.\n", name, failures);
+    return 1;
+  }
+  printf("%s: all checks passed.\n", name);
+  return 0;
+}
+
+#ifdef HOST_TEST_DECODED
+
+static char decoded[HOST_TEST_DECODED][APP_TEXT_LEN];
+static int decodedCount;
+
+static void onButton(uint8_t button) {
+  if (decodedCount < HOST_TEST_DECODED) {
+    appButtonText(decoded[decodedCount++], button);
+  }
+}
+
+static void onAnalog(uint8_t left, uint8_t right, uint8_t up, uint8_t down) {
+  if (decodedCount < HOST_TEST_DECODED) {
+    appFrameText(decoded[decodedCount++], left, right, up, down);
+  }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ * Host shim for the Arduino SoftwareSerial library.
+ *
+ * Models the 64 byte receive buffer of the AVR implementation, including the
+ * overflow flag. The host plays the part of the Bluetooth module by calling
+ * _hostInject() on the listening instance.
+ */
+#ifndef HOST_SOFTWARE_SERIAL_H
+#define HOST_SOFTWARE_SERIAL_H
+
+#include "Stream.h"
+#include "HostBuffer.h"
+
+#ifndef _SS_MAX_RX_BUFF
+#define _SS_MAX_RX_BUFF 64
+#endif
+
+class SoftwareSerial : public Stream
+{
+ public:
+  SoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverseLogic = false);
+  ~SoftwareSerial();
+
+  void begin(long speed);
+  bool listen();
+  void end();
+  bool isListening() { return this == activeObject; }
+  bool overflow() { return rxBuffer.overflow(); }
+
+  virtual int available();
+  virtual int read();
+  virtual int peek();
+  virtual size_t write(uint8_t c);
+  using Print::write;
+
+  operator bool() { return true; }
+
+  // Host only: deliver bytes as if they had arrived on the RX pin.
+  size_t _hostInject(const uint8_t *data, size_t len);
+  // Host only: bytes written by the sketch with write().
+  size_t _hostTxCount() const { return txCount; }
+  // Host only: the instance that is currently listening, or NULL.
+  static SoftwareSerial *_hostListener() { return activeObject; }
+
+  uint8_t rxPin;
+  uint8_t txPin;
+  long speed;
+
+ private:
+  static SoftwareSerial *activeObject;
+  _HostBuffer rxBuffer;
+  size_t txCount;
+};
+
+#endif
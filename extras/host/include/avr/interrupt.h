@@ -0,0 +1,14 @@
+/**
+ * Host shim for <avr/interrupt.h>
+ *
+ * Interrupt handlers become ordinary functions that a test calls directly.
+ */
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#define ISR(vector, ...) extern "C" void vector(void); void vector(void)
+
+#define sei()
+#define cli()
+
+#endif
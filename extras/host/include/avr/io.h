@@ -0,0 +1,49 @@
+/**
+ * Host shim for <avr/io.h>
+ *
+ * Only the USART0 registers are modelled, as plain memory. A test plays the
+ * part of the hardware by writing UDR0 and UCSR0A and then calling the
+ * interrupt handler, see <avr/interrupt.h>.
+ */
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+extern volatile uint8_t UBRR0H;
+extern volatile uint8_t UBRR0L;
+extern volatile uint8_t UCSR0A;
+extern volatile uint8_t UCSR0B;
+extern volatile uint8_t UCSR0C;
+extern volatile uint8_t UDR0;
+
+// UCSR0A
+#define RXC0  7
+#define TXC0  6
+#define UDRE0 5
+#define FE0   4
+#define DOR0  3
+#define UPE0  2
+#define U2X0  1
+#define MPCM0 0
+
+// UCSR0B
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0  4
+#define TXEN0  3
+#define UCSZ02 2
+#define RXB80  1
+#define TXB80  0
+
+// UCSR0C
+#define UCSZ01 2
+#define UCSZ00 1
+
+// Named like the ATmega328P vector, the handler is an ordinary function
+#define USART_RX_vect __vector_usart_rx
+
+#endif
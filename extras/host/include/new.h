@@ -0,0 +1,9 @@
+/**
+ * Host shim for the Arduino core's new.h, which provides placement new.
+ */
+#ifndef HOST_NEW_H
+#define HOST_NEW_H
+
+#include <new>
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Test for BITBUS_UART_PARSER(), which parses in the USART receive interrupt,
+ * and GamePadModule::readState(). Built with BITBUS_PARSE_IN_ISR set.
+ *
+ * The test plays the part of the USART as uart_test does. The torn read test
+ * calls the interrupt handler from a timer signal, which like an interrupt
+ * can land anywhere in readState().
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "Arduino.h"
+#include "BitBus.h"
+#include "BitBusUart.h"
+#include "GamePad.h"
+#include "HostTest.h"
+
+#if !BITBUS_PARSE_IN_ISR
+#error "isr_test needs BITBUS_PARSE_IN_ISR"
+#endif
+
+BITBUS_UART_PARSER(bbUart, 0, GamePad)
+
+// Frames sent a byte per timer tick for the torn read test
+#define TORN_READ_FRAMES 4000UL
+#define TORN_READ_TICK_US 20
+
+static void receive(uint8_t c, bool overrun = false) {
+  UDR0 = c;
+  UCSR0A = _BV(RXC0) | (overrun ? _BV(DOR0) : 0);
+  USART_RX_vect();
+}
+
+static void receive(const char *s) {
+  while (*s) {
+    receive(*s++);
+  }
+}
+
+static void testParse() {
+  GamePad._clear();
+  bbUart.begin(115200);
+  GamePadState state;
+
+  receive("LFFR00F00");
+  GamePad.readState(&state);
+  CHECK(0 == state.left, "a partial frame changes nothing");
+  receive("B10");
+  GamePad.readState(&state);
+  CHECK(255 == state.left && 0 == state.right && 0 == state.up && 0x10 == state.down,
+        "the frame is applied with its last byte");
+  CHECK(state.positionButtons == GamePad.isLeftPressed() << 2, "left is pressed");
+  CHECK(0 == state.actionButtons, "no action buttons yet");
+
+  receive("AAX");
+  CHECK(!GamePad.isAPressed(), "the getters wait for readState()");
+  GamePad.readState(&state);
+  CHECK(state.actionButtons == ((1 << GP_BUTTON_A) | (1 << GP_BUTTON_X)), "buttons pressed since the last read");
+  CHECK(GamePad.isAPressed() && GamePad.isXPressed() && !GamePad.isBPressed(), "getters report the same buttons");
+  GamePad.readState(&state);
+  CHECK(0 == state.actionButtons, "each press is reported once");
+  CHECK(!GamePad.isAPressed(), "getters follow readState()");
+  CHECK(255 == state.left, "the position stays");
+
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  GamePadEvent event;
+  int buttons = 0;
+  while (GamePad.readEvent(&event)) {
+    buttons += (GP_EVENT_BUTTON_PRESSED == event.type);
+  }
+  CHECK(3 == buttons, "every press is queued as an event");
+#endif
+}
+
+static void testOverrun() {
+  GamePad._clear();
+  bbUart.begin(115200);
+  GamePadState state;
+
+  // A byte lost after "LFFR0": what follows isn't read as part of the frame
+  receive("LFFR0");
+  receive('0', true);
+  receive("F00B00");
+  GamePad.readState(&state);
+  CHECK(0 == state.left, "the frame broken by the overrun is dropped");
+  CHECK(1 == bbUart.getOverflowCount(), "the overrun is counted");
+
+  receive("L20R00F00B00");
+  GamePad.readState(&state);
+  CHECK(0x20 == state.left, "the next frame is read");
+}
+
+static const char hex[] = "0123456789ABCDEF";
+static volatile unsigned long sentBytes;
+
+// Stands in for the interrupt handler: a byte of the next frame each tick,
+// frames with every field the same
+static void tick(int signal) {
+  unsigned long i = sentBytes / ANALOG_HEX_MESSAGE_LEN;
+  uint8_t v = i & 0xFF;
+  switch (sentBytes % 3) {
+  case 0:
+    receive(MESSAGE_FIELD_LETTERS[sentBytes % ANALOG_HEX_MESSAGE_LEN / 3]);
+    break;
+  case 1:
+    receive(hex[v >> 4]);
+    break;
+  default:
+    receive(hex[v & 0xF]);
+    break;
+  }
+  sentBytes = sentBytes + 1;
+}
+
+static void testTornReads() {
+  GamePad._clear();
+  bbUart.begin(115200);
+  sentBytes = 0;
+  signal(SIGALRM, tick);
+  struct itimerval timer = {{0, TORN_READ_TICK_US}, {0, TORN_READ_TICK_US}};
+  setitimer(ITIMER_REAL, &timer, NULL);
+
+  unsigned long reads = 0, torn = 0, changes = 0;
+  uint8_t last = 0;
+  while (sentBytes < TORN_READ_FRAMES * ANALOG_HEX_MESSAGE_LEN) {
+    GamePadState state;
+    GamePad.readState(&state);
+    reads++;
+    if (state.left != state.right || state.left != state.up || state.left != state.down) {
+      torn++;
+    }
+    changes += (state.left != last);
+    last = state.left;
+  }
+  struct itimerval off = {{0, 0}, {0, 0}};
+  setitimer(ITIMER_REAL, &off, NULL);
+  signal(SIGALRM, SIG_DFL);
+
+  GamePadState state;
+  GamePad.readState(&state);
+  printf("readState: %lu reads saw %lu different positions\n", reads, changes);
+  CHECK(0 == torn, "no read mixes two frames");
+  CHECK(((TORN_READ_FRAMES - 1) & 0xFF) == state.left, "the last frame is read");
+}
+
+int main() {
+  Serial._hostSetEcho(false);
+  testParse();
+  testOverrun();
+  testTornReads();
+
+  return hostTestResult("Parse in ISR");
+}
@@ -0,0 +1,269 @@
+/*
+ * Reads what appsim sends, from a pipe or a pseudo terminal, through the
+ * BitBus singleton and its SoftwareSerial, the way a sketch calling
+ * BitBus.processInput() from loop() would. Reports the sustained throughput
+ * and the bytes dropped by the 64 byte receive buffer, and, given appsim's
+ * log, the messages lost and the latency from send to callback.
+ *
+ * Usage: loadtest [options]
+ *   --input PATH    read from PATH, e.g. appsim's pseudo terminal. Default stdin
+ *   --log PATH      appsim's log of the messages it sent
+ *   --loop-us N     time the rest of loop() takes between calls. Default 0
+ *   --baud N        deliver bytes no faster than a serial link at N baud, 8N1.
+ *                   Default 0, as fast as they come
+ *   --seconds N     stop after N seconds. Default: at the end of the input
+ *   --resync        set GamePad resync mode
+ *
+ * The messages the sketch decodes are matched in order against the clean
+ * ones in the log with appMatch(). One that matches nothing was read from a
+ * corrupted message, or mangled by the parser, and is counted as unexpected.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "AppEmulator.h"
+#include "BitBus.h"
+#include "GamePad.h"
+#include "SoftwareSerial.h"
+
+#define READ_SIZE 4096
+
+// A message the sketch decoded, and when
+struct Record {
+  uint64_t nanos;
+  char text[APP_TEXT_LEN];
+};
+
+struct RecordList {
+  Record *records;
+  size_t count;
+  size_t capacity;
+};
+
+static Record *append(RecordList *list) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? 2 * list->capacity : 1024;
+    list->records = (Record *)realloc(list->records, list->capacity * sizeof(Record));
+  }
+  return &list->records[list->count++];
+}
+
+static RecordList decoded;
+static unsigned long frames, buttons, errors;
+
+static void onButton(uint8_t button) {
+  Record *r = append(&decoded);
+  r->nanos = appNanos();
+  appButtonText(r->text, button);
+  buttons++;
+}
+
+static void onAnalog(uint8_t left, uint8_t right, uint8_t up, uint8_t down) {
+  Record *r = append(&decoded);
+  r->nanos = appNanos();
+  appFrameText(r->text, left, right, up, down);
+  frames++;
+}
+
+static void onError(uint8_t error) {
+  errors++;
+}
+
+// What appsim sent, read back from its log
+struct SentLog {
+  AppMessage *messages;
+  uint64_t *nanos;
+  size_t count;
+};
+
+// Returns: false if the log can't be read
+static bool loadLog(const char *path, SentLog *sent) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  size_t capacity = 0;
+  unsigned long long nanos;
+  char kind;
+  char text[APP_TEXT_LEN];
+  while (3 == fscanf(f, "%llu %c %16s", &nanos, &kind, text)) {
+    if (sent->count == capacity) {
+      capacity = capacity ? 2 * capacity : 1024;
+      sent->messages = (AppMessage *)realloc(sent->messages, capacity * sizeof(AppMessage));
+      sent->nanos = (uint64_t *)realloc(sent->nanos, capacity * sizeof(uint64_t));
+    }
+    strcpy(sent->messages[sent->count].text, text);
+    sent->messages[sent->count].corrupted = ('x' == kind);
+    sent->nanos[sent->count++] = nanos;
+  }
+  fclose(f);
+  return true;
+}
+
+static int compareNanos(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Match what was decoded against what was sent, and print the losses and latency
+static void reportLog(const SentLog *sent) {
+  unsigned long clean = 0, matched = 0, lost = 0, unexpected = 0;
+  for (size_t i = 0; i < sent->count; i++) {
+    clean += !sent->messages[i].corrupted;
+  }
+  uint64_t *latency = (uint64_t *)malloc((decoded.count + 1) * sizeof(uint64_t));
+  size_t next = 0;
+  for (size_t d = 0; d < decoded.count; d++) {
+    const Record *r = &decoded.records[d];
+    long s = appMatch(sent->messages, sent->count, next, r->text);
+    if (s < 0) {
+      unexpected++;
+      continue;
+    }
+    for (size_t skipped = next; skipped < (size_t)s; skipped++) {
+      lost += !sent->messages[skipped].corrupted;
+    }
+    latency[matched++] = r->nanos - sent->nanos[s];
+    next = s + 1;
+  }
+  for (size_t skipped = next; skipped < sent->count; skipped++) {
+    lost += !sent->messages[skipped].corrupted;
+  }
+
+  printf("sent       %lu messages, %lu of them corrupted\n", (unsigned long)sent->count,
+         (unsigned long)sent->count - clean);
+  printf("lost       %lu of the clean ones (%.2f%%), %lu unexpected\n", lost,
+         clean ? 100.0 * lost / clean : 0.0, unexpected);
+  if (matched) {
+    qsort(latency, matched, sizeof(uint64_t), compareNanos);
+    uint64_t total = 0;
+    for (size_t i = 0; i < matched; i++) {
+      total += latency[i];
+    }
+    printf("latency us min %.1f  avg %.1f  p50 %.1f  p99 %.1f  max %.1f\n", latency[0] / 1e3,
+           total / 1e3 / matched, latency[matched / 2] / 1e3, latency[matched * 99 / 100] / 1e3,
+           latency[matched - 1] / 1e3);
+  }
+  free(latency);
+}
+
+int main(int argc, char **argv) {
+  const char *inputPath = NULL;
+  const char *logPath = NULL;
+  unsigned long loopMicros = 0;
+  unsigned long baud = 0;
+  double seconds = 0;
+  bool resync = false;
+
+  for (int i = 1; i < argc; i++) {
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!strcmp(argv[i], "--resync")) {
+      resync = true;
+    } else if (!strcmp(argv[i], "--input") && value) {
+      inputPath = argv[++i];
+    } else if (!strcmp(argv[i], "--log") && value) {
+      logPath = argv[++i];
+    } else if (!strcmp(argv[i], "--loop-us") && value) {
+      loopMicros = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--baud") && value) {
+      baud = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--seconds") && value) {
+      seconds = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "Usage: %s [--input PATH] [--log PATH] [--loop-us N] [--baud N] [--seconds N] [--resync]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  int fd = STDIN_FILENO;
+  if (inputPath && (fd = open(inputPath, O_RDONLY | O_NOCTTY)) < 0) {
+    perror(inputPath);
+    return 1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  struct termios tio;
+  if (isatty(fd) && 0 == tcgetattr(fd, &tio)) {
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+
+  Serial._hostSetEcho(false);
+  GamePad.onButtonPressed(onButton);
+  GamePad.onAnalogUpdate(onAnalog);
+  GamePad.onParseError(onError);
+  GamePad.setResync(resync);
+  BitBus.begin();
+  SoftwareSerial *rx = SoftwareSerial::_hostListener();
+
+  unsigned long long received = 0, dropped = 0;
+  bool eof = false;
+  uint64_t start = appNanos();
+  uint64_t now = start;
+  // With a baud rate, when the link finishes sending the bytes read so far
+  uint64_t linkNanos = start;
+  while (!eof || rx->available() > 0) {
+    if (seconds > 0 && now - start >= seconds * 1e9) {
+      break;
+    }
+    // Everything that arrived since the last call lands in the receive buffer
+    size_t want = READ_SIZE;
+    if (baud) {
+      unsigned long long onWire = now > linkNanos ? (now - linkNanos) * baud / 10000000000ULL : 0;
+      want = onWire < want ? onWire : want;
+    }
+    uint8_t buf[READ_SIZE];
+    ssize_t n = 0;
+    if (want) {
+      n = read(fd, buf, want);
+      if (n > 0) {
+        received += n;
+        dropped += n - rx->_hostInject(buf, n);
+      } else if (0 == n || EIO == errno) {
+        // EIO is the pseudo terminal closing
+        eof = true;
+      }
+      // An idle link doesn't save up bytes to deliver later
+      if (baud) {
+        linkNanos = n > 0 ? linkNanos + n * 10000000000ULL / baud : now;
+      }
+    }
+    BitBus.processInput();
+    if (loopMicros) {
+      delayMicroseconds(loopMicros);
+    } else if (!want) {
+      // Nothing more is on the wire until the next byte time
+      delayMicroseconds(10000000UL / baud);
+    } else if (n <= 0 && !eof) {
+      struct pollfd pfd = {fd, POLLIN, 0};
+      poll(&pfd, 1, 1);
+    }
+    now = appNanos();
+  }
+
+  double elapsed = (now - start) / 1e9;
+  printf("received   %llu bytes in %.2f s, %.0f bytes/s\n", received, elapsed,
+         elapsed > 0 ? received / elapsed : 0.0);
+  printf("decoded    %lu frames, %lu buttons, %lu parse errors\n", frames, buttons, errors);
+  printf("dropped    %llu bytes (%.2f%%) with the receive buffer full\n", dropped,
+         received ? 100.0 * dropped / received : 0.0);
+  if (logPath) {
+    SentLog sent = {NULL, NULL, 0};
+    if (!loadLog(logPath, &sent)) {
+      return 1;
+    }
+    reportLog(&sent);
+    free(sent.messages);
+    free(sent.nanos);
+  }
+  free(decoded.records);
+  return 0;
+}
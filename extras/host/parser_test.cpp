@@ -0,0 +1,215 @@
+/*
+ * Checks the parser generated from the grammar in MessageBuffer.h against
+ * the hand written table it replaced (reference_parser.h, kept with
+ * extras/cycles/CycleBench), checks that no two of its states could be
+ * merged, and times both one byte at a time. The times are host ns, the
+ * AVR cycles of both are the ref- and -byte regions of cycles.sh.
+ *
+ * Usage: parser_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "GamePad.h"
+#include "HostTest.h"
+#include "MessageBuffer.h"
+#include "../cycles/CycleBench/reference_parser.h"
+
+// Append a random message from the app to buf. Returns: its length.
+static size_t randomMessage(char *buf, int kind) {
+  static const char buttons[] = MESSAGE_BUTTON_LETTERS;
+  switch (kind) {
+  case 0:
+    return sprintf(buf, "%c", buttons[rand() % (sizeof(buttons) - 1)]);
+  case 1:
+    return sprintf(buf, "L%02XR%02XF%02XB%02X", rand() & 0xFF, rand() & 0xFF, rand() & 0xFF, rand() & 0xFF);
+  default:
+    return sprintf(buf, "L%03dR%03dF%03dB%03d", rand() % 1000, rand() % 1000, rand() % 1000, rand() % 1000);
+  }
+}
+
+// Returns: a stream of count messages of the given kind, -1 for a mix
+static char *randomStream(size_t count, int kind, size_t *lenPtr) {
+  char *stream = (char *)malloc(count * 17 + 1);
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    len += randomMessage(stream + len, kind < 0 ? rand() % 3 : kind);
+  }
+  *lenPtr = len;
+  return stream;
+}
+
+static bool sameMessage(const _MessageBuffer &mb, const reference::Parser &ref) {
+  return mb.messageType == ref.messageType && mb.leftValue == ref.leftValue
+    && mb.rightValue == ref.rightValue && mb.upValue == ref.upValue && mb.downValue == ref.downValue;
+}
+
+// Every message the app can send is parsed the same way, character by character
+static void testWellFormed() {
+  size_t len;
+  char *stream = randomStream(200000, -1, &len);
+  _MessageBuffer mb;
+  reference::Parser ref;
+  int mismatches = 0;
+  for (size_t i = 0; i < len; i++) {
+    int result = mb.processInput(stream[i]);
+    int refResult = ref.processInput(stream[i]);
+    if (result != refResult || (0 == result && !sameMessage(mb, ref))) {
+      mismatches++;
+    }
+  }
+  CHECK(0 == mismatches, "well formed messages parse the same as the reference");
+  free(stream);
+}
+
+/*
+ * With corrupted input the generated parser gives up on a message as soon
+ * as it can't be completed, where the reference sometimes read on. So
+ * instead of matching the reference, every message it does complete must
+ * be one the reference reads from the same characters.
+ */
+static void testCorrupted() {
+  size_t len;
+  char *stream = randomStream(100000, -1, &len);
+  for (size_t i = 0; i < len; i++) {
+    int r = rand() % 40;
+    if (r == 0) {
+      stream[i] = rand() & 0xFF;
+    } else if (r == 1) {
+      stream[i] = "0123456789ABCDEFLRSXY"[rand() % 21];
+    }
+  }
+
+  _MessageBuffer mb;
+  reference::Parser full;
+  unsigned long messages = 0, refMessages = 0, unsound = 0;
+  size_t start = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (IS_START == mb.inputState || IS_MESSAGE_READY == mb.inputState) {
+      start = i;
+    }
+    if (0 == full.processInput(stream[i])) {
+      refMessages++;
+    }
+    if (0 != mb.processInput(stream[i])) {
+      continue;
+    }
+    messages++;
+    reference::Parser ref;
+    int result = 1;
+    for (size_t j = start; j <= i; j++) {
+      result = ref.processInput(stream[j]);
+    }
+    if (0 != result || !sameMessage(mb, ref)) {
+      unsound++;
+    }
+  }
+  CHECK(0 == unsound, "every message parsed from corrupted input is one the reference reads");
+  printf("corrupted input: %lu messages parsed, %lu by the reference\n", messages, refMessages);
+  free(stream);
+}
+
+/*
+ * Moore's algorithm: split the states until each group behaves the same
+ * for every character. A minimal machine ends with one state per group.
+ */
+static void testMinimal() {
+  const int states = IS_MESSAGE_READY + 1;
+  uint8_t group[states];
+  for (int s = 0; s < states; s++) {
+    group[s] = (IS_MESSAGE_READY == s);
+  }
+  int groups = 2;
+  for (;;) {
+    uint8_t next[states];
+    int nextGroups = 0;
+    for (int s = 0; s < states; s++) {
+      next[s] = nextGroups;
+      for (int t = 0; t < s; t++) {
+        bool same = group[s] == group[t];
+        for (int c = 0; same && c < 128; c++) {
+          uint8_t a = _MessageBuffer::_transition(s, c);
+          uint8_t b = _MessageBuffer::_transition(t, c);
+          same = TRANSITION_ACTION(a) == TRANSITION_ACTION(b)
+            && (TRANSITION_STATE(a) == IS_ERROR) == (TRANSITION_STATE(b) == IS_ERROR)
+            && (TRANSITION_STATE(a) == IS_ERROR || group[TRANSITION_STATE(a)] == group[TRANSITION_STATE(b)]);
+        }
+        if (same) {
+          next[s] = next[t];
+          break;
+        }
+      }
+      if (next[s] == nextGroups) {
+        nextGroups++;
+      }
+    }
+    memcpy(group, next, sizeof(group));
+    if (nextGroups == groups) {
+      break;
+    }
+    groups = nextGroups;
+  }
+  printf("generated parser: %d states, %d after minimizing\n", states, groups);
+  CHECK(states == groups, "no two states of the generated parser can be merged");
+}
+
+static uint64_t nowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static volatile unsigned long sink;
+
+// Returns: best ns per byte over several passes
+template <class Parser>
+static double timeParser(const char *stream, size_t len) {
+  double best = 1e9;
+  for (int pass = 0; pass < 20; pass++) {
+    Parser parser;
+    unsigned long complete = 0;
+    uint64_t start = nowNanos();
+    for (size_t i = 0; i < len; i++) {
+      complete += (0 == parser.processInput(stream[i]));
+    }
+    uint64_t elapsed = nowNanos() - start;
+    sink += complete;
+    double perByte = (double)elapsed / len;
+    best = (perByte < best) ? perByte : best;
+  }
+  return best;
+}
+
+static void timeParsers() {
+  static const struct {
+    const char *name;
+    int kind;
+  } streams[] = {
+    {"buttons", 0},
+    {"hex positions", 1},
+    {"dec positions", 2},
+    {"mixed", -1},
+  };
+  printf("%-16s %18s %18s\n", "stream", "reference ns/byte", "generated ns/byte");
+  for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++) {
+    size_t len;
+    char *stream = randomStream(20000, streams[i].kind, &len);
+    printf("%-16s %18.2f %18.2f\n", streams[i].name,
+           timeParser<reference::Parser>(stream, len), timeParser<_MessageBuffer>(stream, len));
+    free(stream);
+  }
+}
+
+int main() {
+  Serial._hostSetEcho(false);
+  srand(19);
+  testWellFormed();
+  testCorrupted();
+  testMinimal();
+  timeParsers();
+
+  return hostTestResult("Parser");
+}
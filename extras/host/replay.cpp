@@ -0,0 +1,78 @@
+/*
+ * Plays a capture back through BitBus and prints the GamePad events it
+ * produces, one per line. Diff the output of two versions of the library to
+ * check a field capture still decodes the same way.
+ *
+ * Usage: replay capture.bbc [--speed N]
+ *   --speed N  1 replays at the original speed, 2 twice as fast and so on.
+ *              The default of 0 replays as fast as possible.
+ *
+ * Turn a capture dumped over Serial by BitBusRamCapture::dump() into a file
+ * with: xxd -r -p dump.txt capture.bbc
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "BitBus.h"
+#include "FileCapture.h"
+#include "GamePad.h"
+
+// Callbacks rather than readEvent(), so no event is lost to a full queue
+static void printButton(uint8_t button) {
+  printf("BUTTON %c\n", "SCABXY"[button % 6]);
+}
+
+static void printAnalog(uint8_t left, uint8_t right, uint8_t up, uint8_t down) {
+  printf("ANALOG L %3u R %3u U %3u D %3u\n", left, right, up, down);
+}
+
+static void printError(uint8_t error) {
+  printf("ERROR  %u\n", error);
+}
+
+int main(int argc, char **argv) {
+  const char *path = NULL;
+  int speed = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+      speed = atoi(argv[++i]);
+    } else if (!path && argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      path = NULL;
+      break;
+    }
+  }
+  if (!path) {
+    fprintf(stderr, "Usage: %s capture.bbc [--speed N]\n", argv[0]);
+    return 2;
+  }
+
+  size_t len;
+  uint8_t *log = loadCaptureFile(path, &len);
+  if (!log) {
+    return 1;
+  }
+  BitBusReplay replay;
+  if (!replay.begin(log, len, speed)) {
+    fprintf(stderr, "%s: not a BitBus capture\n", path);
+    return 1;
+  }
+
+  Serial._hostSetEcho(false);
+  GamePad.onButtonPressed(printButton);
+  GamePad.onAnalogUpdate(printAnalog);
+  GamePad.onParseError(printError);
+  BitBus.begin(replay);
+  while (!replay.finished()) {
+    BitBus.processInput();
+    if (speed) {
+      delay(1);
+    }
+  }
+  free(log);
+  return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Measures how many joystick messages survive a noisy link, with and without
+ * GamePad.setResync().
+ *
+ * A stream of hex analog messages is corrupted at a given rate: each
+ * corrupted byte is either dropped or replaced with a random byte, the two
+ * failures seen on Bluetooth serial links. The stream is then parsed in 32
+ * byte chunks, like BitBus.processInput() does, and every decoded message is
+ * checked against the one that was sent.
+ *
+ * Usage: resync_test [--frames N]
+ * Fails if resync mode ever recovers fewer messages than the default.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "GamePad.h"
+#include "MessageBuffer.h"
+
+#define CHUNK_SIZE 32
+
+// Small deterministic generator so every run sees the same streams
+static uint32_t lcgState;
+static uint32_t lcg() {
+  lcgState = lcgState * 1103515245UL + 12345UL;
+  return lcgState >> 8;
+}
+
+static const char hexChars[] = "0123456789ABCDEF";
+
+/*
+ * Message n carries left = n, so a decoded message can be matched with the
+ * one that was sent. The other values are derived from it, so that noise is
+ * very unlikely to produce a message that checks out.
+ */
+static void frameValues(uint8_t n, uint8_t values[4]) {
+  values[0] = n;
+  values[1] = ~n;
+  values[2] = n ^ 0x5A;
+  values[3] = n + 0x33;
+}
+
+static size_t appendFrame(uint8_t *buf, uint8_t n) {
+  uint8_t values[4];
+  const char *letters = "LRFB";
+  size_t len = 0;
+  frameValues(n, values);
+  for (int i = 0; i < 4; i++) {
+    buf[len++] = letters[i];
+    buf[len++] = hexChars[values[i] >> 4];
+    buf[len++] = hexChars[values[i] & 0x0F];
+  }
+  return len;
+}
+
+static unsigned long goodFrames;
+
+static void countGoodFrame(uint8_t left, uint8_t right, uint8_t up, uint8_t down) {
+  uint8_t values[4];
+  frameValues(left, values);
+  if (right == values[1] && up == values[2] && down == values[3]) {
+    goodFrames++;
+  }
+}
+
+struct run_result {
+  unsigned long sent;
+  unsigned long intact;  // Messages that arrived without a corrupted byte
+  unsigned long recovered;
+};
+
+static void run(unsigned long frames, double errorRate, bool resync, struct run_result *result) {
+  uint8_t *stream = (uint8_t *)malloc(frames * ANALOG_HEX_MESSAGE_LEN);
+  size_t len = 0;
+  unsigned long threshold = (unsigned long)(errorRate * 0x1000000);
+
+  lcgState = 12345;
+  result->sent = frames;
+  result->intact = 0;
+  for (unsigned long n = 0; n < frames; n++) {
+    uint8_t frame[ANALOG_HEX_MESSAGE_LEN];
+    appendFrame(frame, (uint8_t)n);
+    bool intact = true;
+    for (int i = 0; i < ANALOG_HEX_MESSAGE_LEN; i++) {
+      if ((lcg() & 0xFFFFFF) < threshold) {
+        intact = false;
+        if (lcg() & 1) {
+          continue;  // Dropped
+        }
+        stream[len++] = lcg() & 0xFF;
+      } else {
+        stream[len++] = frame[i];
+      }
+    }
+    if (intact) {
+      result->intact++;
+    }
+  }
+
+  GamePad._clear();
+  GamePad.setResync(resync);
+  goodFrames = 0;
+  for (size_t pos = 0; pos < len; pos += CHUNK_SIZE) {
+    size_t n = len - pos < CHUNK_SIZE ? len - pos : CHUNK_SIZE;
+    GamePad._processInput(stream + pos, n);
+  }
+  result->recovered = goodFrames;
+  free(stream);
+}
+
+int main(int argc, char **argv) {
+  static const double errorRates[] = {0, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1};
+  unsigned long frames = 100000;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+      frames = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--frames N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  Serial._hostSetEcho(false);
+  GamePad.onAnalogUpdate(countGoodFrame);
+
+  printf("%-12s %10s %10s %10s %10s\n", "byte errors", "sent", "intact", "default", "resync");
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(errorRates) / sizeof(errorRates[0]); i++) {
+    struct run_result normal, resync;
+    run(frames, errorRates[i], false, &normal);
+    run(frames, errorRates[i], true, &resync);
+    printf("%11.1f%% %10lu %9.2f%% %9.2f%% %9.2f%%\n", errorRates[i] * 100, normal.sent,
+           100.0 * normal.intact / normal.sent, 100.0 * normal.recovered / normal.sent,
+           100.0 * resync.recovered / resync.sent);
+    if (resync.recovered < normal.recovered) {
+      failures++;
+    }
+  }
+  GamePad.setResync(false);
+  GamePad.onAnalogUpdate(NULL);
+
+  if (failures) {
+    printf("FAIL: resync recovered fewer messages at %d error rates\n", failures);
+    return 1;
+  }
+  return 0;
+}
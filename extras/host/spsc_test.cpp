@@ -0,0 +1,61 @@
+/*
+ * Stress test for _SpscQueue with the producer and consumer on separate threads.
+ *
+ * The producer stands in for an interrupt handler. Every item carries a
+ * sequence number and a checksum so the consumer can detect lost, duplicated
+ * or torn items.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include "SpscQueue.h"
+
+#define NUM_ITEMS 200000UL
+
+struct test_item {
+  uint32_t sequence;
+  uint32_t check;
+};
+
+static _SpscQueue<test_item, 8> queue;
+
+static void *producer(void *arg) {
+  for (uint32_t i = 0; i < NUM_ITEMS; ) {
+    test_item item;
+    item.sequence = i;
+    item.check = ~i;
+    if (queue.push(item)) {
+      i++;
+    } else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  pthread_t thread;
+  pthread_create(&thread, NULL, producer, NULL);
+
+  unsigned long errors = 0;
+  for (uint32_t expected = 0; expected < NUM_ITEMS; ) {
+    test_item item;
+    if (!queue.pop(&item)) {
+      sched_yield();
+      continue;
+    }
+    if (item.sequence != expected || item.check != ~expected) {
+      errors++;
+    }
+    expected++;
+  }
+  pthread_join(thread, NULL);
+
+  if (errors || queue.count()) {
+    printf("FAIL: _SpscQueue lost or corrupted %lu of %lu items\n", errors, NUM_ITEMS);
+    return 1;
+  }
+  printf("_SpscQueue: %lu items passed between threads intact.\n", NUM_ITEMS);
+  return 0;
+}
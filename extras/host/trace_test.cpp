@@ -0,0 +1,183 @@
+/*
+ * Test for the parser trace, BitBusTrace.h, and for TraceDecoder reading
+ * its dump back. Built with BITBUS_TRACE at BITBUS_TRACE_CHARS.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "Arduino.h"
+#include "BitBusTrace.h"
+#include "GamePad.h"
+#include "HostTest.h"
+#include "TraceDecoder.h"
+
+#if BITBUS_TRACE < BITBUS_TRACE_CHARS
+#error "trace_test needs BITBUS_TRACE=2"
+#endif
+
+// Keeps what is printed to it
+class CapturePrint : public Print
+{
+ public:
+  size_t write(uint8_t c) override {
+    text += (char)c;
+    return 1;
+  }
+  std::string text;
+};
+
+static void input(const char *s) {
+  GamePad._processInput((const uint8_t *)s, strlen(s));
+}
+
+// Returns: the index of the first record of an event from i on, or -1
+static int find(uint8_t event, int i = 0) {
+  BitBusTraceRecord r;
+  for (; BitBusTraceGet(i, &r); i++) {
+    if (r.event == event) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static BitBusTraceRecord get(int i) {
+  BitBusTraceRecord r = {};
+  BitBusTraceGet(i, &r);
+  return r;
+}
+
+static void testCharacters() {
+  GamePad._clear();
+  BitBusTraceClear();
+  CHECK(0 == BitBusTraceCount(), "a cleared trace is empty");
+
+  // Split so the fast path can't take the whole message
+  input("L2");
+  input("0R00F00B00");
+  BitBusTraceRecord r = get(0);
+  CHECK(BT_CHUNK == r.event && 2 == r.input && IS_START == r.state, "the chunk comes first with its length");
+  r = get(1);
+  CHECK(BT_CHAR == r.event && 'L' == r.input && IS_START == r.state, "then each character");
+  CHECK(IS_WAITING_FOR_L_DIGIT_1 == TRANSITION_STATE(r.entry), "with the state it leads to");
+  r = get(2);
+  CHECK(BT_CHAR == r.event && '2' == r.input && IS_WAITING_FOR_L_DIGIT_1 == r.state, "the state before each character");
+  int i = find(BT_MESSAGE);
+  CHECK(i > 0, "the last character is a message");
+  r = get(i);
+  CHECK('0' == r.input && MT_ANALOG_POSITION == r.code && IS_MESSAGE_READY == TRANSITION_STATE(r.entry),
+        "the message records its type");
+  r = get(3);
+  CHECK(BT_CHUNK == r.event && 10 == r.input, "the second chunk");
+  CHECK(IS_WAITING_FOR_L_HEX_DIGIT_2 == r.state || IS_WAITING_FOR_L_DIGIT_2 == r.state,
+        "the chunk starts part way through the message");
+  CHECK(0x20 == GamePad.getLeftPosition(), "tracing doesn't change the result");
+
+  BitBusTraceClear();
+  input("A");
+  r = get(1);
+  CHECK(BT_MESSAGE == r.event && MT_BUTTON_A == r.code, "a button is a message");
+}
+
+static void testMessages() {
+  GamePad._clear();
+  BitBusTraceClear();
+  input("L20R00F00B00");
+  CHECK(2 == BitBusTraceCount(), "a whole analog message is a chunk and one record");
+  BitBusTraceRecord r = get(1);
+  CHECK(BT_ANALOG == r.event && 12 == r.input && MT_ANALOG_POSITION == r.code, "read by the fast path");
+
+  BitBusTraceClear();
+  input("LQ");
+  int i = find(BT_ERROR);
+  CHECK(i > 0, "a bad character is an error");
+  r = get(i);
+  CHECK('Q' == r.input && IS_WAITING_FOR_L_DIGIT_1 == r.state && GP_ERROR_NO_STATE_ENTRY == r.code,
+        "with the state and character it was in");
+
+  GamePad._inputLost();
+  BitBusTraceClear();
+  input("0B00L20R00F00B00");
+  r = get(0);
+  CHECK(BT_CHUNK == r.event && 1 == r.code, "the chunk after lost input says so");
+  r = get(1);
+  CHECK(BT_SKIP == r.event && 4 == r.input, "the rest of the broken message is skipped");
+  CHECK(BT_ANALOG == get(2).event, "then the next message is read");
+
+  GamePad.setCoalescing(true);
+  BitBusTraceClear();
+  input("L20R00F00B00L30R00F00B00");
+  CHECK(BT_SUPERSEDED == get(1).event && 12 == get(1).input, "an old position is skipped in coalescing mode");
+  CHECK(BT_ANALOG == get(2).event, "and the new one read");
+  GamePad.setCoalescing(false);
+}
+
+static void testRing() {
+  GamePad._clear();
+  BitBusTraceClear();
+  for (int i = 0; i < BITBUS_TRACE_SIZE + 5; i++) {
+    input("A");
+  }
+  CHECK(BITBUS_TRACE_SIZE == BitBusTraceCount(), "a full ring holds BITBUS_TRACE_SIZE records");
+  // A chunk and a message each time, and the first 5 pairs and a bit overwritten
+  BitBusTraceRecord r = get(0);
+  CHECK(BT_CHUNK == r.event, "the oldest record is the start of a pair");
+  r = get(BITBUS_TRACE_SIZE - 1);
+  CHECK(BT_MESSAGE == r.event && MT_BUTTON_A == r.code, "the newest record is last");
+  BitBusTraceRecord none;
+  CHECK(!BitBusTraceGet(BITBUS_TRACE_SIZE, &none), "no record past the newest");
+  bool ordered = true;
+  for (int i = 1; i < BITBUS_TRACE_SIZE; i++) {
+    ordered = ordered && (uint16_t)(get(i).time - get(i - 1).time) < 0x8000;
+  }
+  CHECK(ordered, "records are oldest first");
+  BitBusTraceClear();
+  CHECK(0 == BitBusTraceCount(), "cleared");
+}
+
+static void testDump() {
+  GamePad._clear();
+  BitBusTraceClear();
+  input("L2");
+  input("0R00F00B00X");
+
+  CapturePrint out;
+  BitBusTraceDump(out);
+  CHECK(0 == out.text.compare(0, 10, "4242540107"), "the dump starts with the header");
+
+  uint8_t bytes[BITBUS_TRACE_HEADER_LEN + BITBUS_TRACE_SIZE * BITBUS_TRACE_RECORD_LEN];
+  size_t len = traceFromHex(out.text.c_str(), bytes, sizeof(bytes));
+  BitBusTraceRecord records[BITBUS_TRACE_SIZE];
+  int count = traceDecode(bytes, len, records, BITBUS_TRACE_SIZE);
+  CHECK(count == BitBusTraceCount(), "every record comes back");
+  bool same = count > 0;
+  for (int i = 0; i < count; i++) {
+    BitBusTraceRecord r = get(i);
+    same = same && 0 == memcmp(&r, &records[i], sizeof(r));
+  }
+  CHECK(same, "the records come back as they were");
+  CHECK(-1 == traceDecode(bytes + 1, len - 1, records, BITBUS_TRACE_SIZE), "only a trace dump is decoded");
+
+  unsigned long micros[BITBUS_TRACE_SIZE];
+  traceTimes(records, count, micros);
+  char line[TRACE_LINE_LEN];
+  traceFormat(records[1], micros[1], line, sizeof(line));
+  CHECK(strstr(line, "CHAR") && strstr(line, "IS_START") && strstr(line, "'L'")
+            && strstr(line, "IS_WAITING_FOR_L_DIGIT_1"),
+        "a character is described by state names");
+  traceFormat(records[count - 1], micros[count - 1], line, sizeof(line));
+  CHECK(strstr(line, "MESSAGE") && strstr(line, "MT_BUTTON_X"), "a message by its type");
+  CHECK(0 == strcmp("IS_WAITING_FOR_HEX_R", traceStateName(IS_WAITING_FOR_HEX_R)), "state names");
+  CHECK(0 == strcmp("?", traceStateName(IS_ERROR + 1)), "an unknown state");
+}
+
+int main() {
+  Serial._hostSetEcho(false);
+  testCharacters();
+  testMessages();
+  testRing();
+  testDump();
+
+  return hostTestResult("Trace");
+}
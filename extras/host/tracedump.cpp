@@ -0,0 +1,65 @@
+/*
+ * Prints a parser trace dumped over Serial by BitBusTraceDump(), one record
+ * per line, with the parser states by name.
+ *
+ * Usage: tracedump [dump.txt]
+ *   Reads standard input if no file is given. Lines that aren't all hex
+ *   digits, such as other output from the sketch, are left out.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "TraceDecoder.h"
+
+// Big enough for the largest trace, 128 records
+#define DUMP_MAX (BITBUS_TRACE_HEADER_LEN + 128 * BITBUS_TRACE_RECORD_LEN)
+
+static bool isHexLine(const char *line) {
+  bool any = false;
+  for (; *line && '\n' != *line && '\r' != *line; line++) {
+    if (!isxdigit((unsigned char)*line)) {
+      return false;
+    }
+    any = true;
+  }
+  return any;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2 || (2 == argc && '-' == argv[1][0])) {
+    fprintf(stderr, "Usage: %s [dump.txt]\n", argv[0]);
+    return 2;
+  }
+  FILE *in = 2 == argc ? fopen(argv[1], "r") : stdin;
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  static uint8_t dump[DUMP_MAX];
+  size_t len = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), in)) {
+    if (isHexLine(line)) {
+      len += traceFromHex(line, dump + len, sizeof(dump) - len);
+    }
+  }
+  if (in != stdin) {
+    fclose(in);
+  }
+
+  static BitBusTraceRecord records[128];
+  int count = traceDecode(dump, len, records, 128);
+  if (count < 0) {
+    fprintf(stderr, "not a BitBus trace dump\n");
+    return 1;
+  }
+  static unsigned long micros[128];
+  traceTimes(records, count, micros);
+  for (int i = 0; i < count; i++) {
+    traceFormat(records[i], micros[i], line, sizeof(line));
+    printf("%s\n", line);
+  }
+  return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Test for BitBusUart against the modelled USART0 registers.
+ *
+ * The test plays the part of the USART: it puts a byte in UDR0 and calls the
+ * RX complete interrupt handler, the way the hardware would.
+ */
+#include <stdio.h>
+
+#include "Arduino.h"
+#include "BitBus.h"
+#include "BitBusUart.h"
+#include "GamePad.h"
+#include "HostTest.h"
+
+BITBUS_UART(bbUart, 0)
+
+static void receive(uint8_t c, bool overrun = false) {
+  UDR0 = c;
+  UCSR0A = _BV(RXC0) | (overrun ? _BV(DOR0) : 0);
+  USART_RX_vect();
+}
+
+static void receive(const char *s) {
+  while (*s) {
+    receive(*s++);
+  }
+}
+
+static void testBegin() {
+  bbUart.begin(115200);
+  CHECK(UCSR0A == _BV(U2X0), "115200 uses double speed");
+  CHECK(UBRR0H == 0 && UBRR0L == 16, "115200 baud divisor");
+  CHECK(UCSR0B == (_BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0)), "receiver, transmitter and interrupt enabled");
+  CHECK(UCSR0C == (_BV(UCSZ01) | _BV(UCSZ00)), "8N1");
+
+  bbUart.begin(57600);
+  CHECK(UCSR0A == 0, "57600 uses single speed at 16MHz");
+  CHECK(UBRR0H == 0 && UBRR0L == 16, "57600 baud divisor");
+
+  bbUart.begin(9600);
+  CHECK(UBRR0H == 0 && UBRR0L == 207, "9600 baud divisor");
+
+  bbUart.end();
+  CHECK(UCSR0B == 0, "end disables the USART");
+}
+
+static void testReceive() {
+  bbUart.begin(115200);
+  CHECK(bbUart.available() == 0, "empty after begin");
+  CHECK(bbUart.read() == -1, "read on empty");
+  CHECK(bbUart.peek() == -1, "peek on empty");
+
+  receive("AB");
+  CHECK(bbUart.available() == 2, "two bytes available");
+  CHECK(bbUart.peek() == 'A', "peek");
+  CHECK(bbUart.read() == 'A', "first byte");
+  CHECK(bbUart.read() == 'B', "second byte");
+  CHECK(bbUart.available() == 0, "drained");
+  CHECK(bbUart.getOverflowCount() == 0, "no overflow");
+}
+
+static void testOverflow() {
+  bbUart.begin(115200);
+  for (int i = 0; i < BITBUS_UART_RX_BUFFER_SIZE + 5; i++) {
+    receive((uint8_t)i);
+  }
+  CHECK(bbUart.available() == BITBUS_UART_RX_BUFFER_SIZE, "buffer full");
+  CHECK(bbUart.getOverflowCount() == 5, "bytes beyond the buffer counted");
+  // The oldest bytes are kept
+  CHECK(bbUart.read() == 0, "oldest byte kept");
+
+  receive('x', true);
+  CHECK(bbUart.getOverflowCount() == 6, "hardware overrun counted");
+
+  for (int i = 0; i < 300; i++) {
+    receive('x');
+  }
+  CHECK(bbUart.getOverflowCount() == 255, "overflow count saturates");
+  CHECK(bbUart.overflow(), "overflow reported");
+  CHECK(!bbUart.overflow(), "overflow reported once");
+  receive('x');
+  CHECK(bbUart.overflow(), "overflow still reported after the count saturates");
+
+  bbUart.begin(115200);
+  CHECK(bbUart.getOverflowCount() == 0, "begin resets the overflow count");
+}
+
+static void testBitBus() {
+  bbUart.begin(115200);
+  BitBus.begin(bbUart);
+  GamePad._clear();
+
+  receive("L00R40F00B00A");
+  BitBus.processInput();
+  CHECK(GamePad.isRightPressed(), "right from analog message");
+  CHECK(GamePad.getRightPosition() == 0x40, "right position");
+  CHECK(GamePad.isAPressed(), "A pressed");
+  CHECK(bbUart.available() == 0, "BitBus drained the UART");
+
+  BitBus.processInput();
+  CHECK(!GamePad.isAPressed(), "A cleared on the next call");
+}
+
+int main(int argc, char **argv) {
+  Serial._hostSetEcho(false);
+
+  testBegin();
+  testReceive();
+  testOverflow();
+  testBitBus();
+
+  return hostTestResult("BitBusUart");
+}
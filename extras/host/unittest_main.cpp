@@ -0,0 +1,12 @@
+/*
+ * Runs the GamePadUnitTest sketch once on the host.
+ *
+ * Exits non zero if any assertion failed so it can be used from make and CI.
+ */
+#include "../../examples/GamePadUnitTest/GamePadUnitTest.ino"
+
+int main(int argc, char **argv) {
+  setup();
+  unitTest();
+  return assertionFailures ? 1 : 0;
+}
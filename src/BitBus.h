@@ -4,9 +4,30 @@
  * Author: Eric Z. Ayers <ericzundel@gmail.com>
  * Date: October 5, 2022
  *
- * Currently only SoftwareSerial is supported on pins 2 and 3.
+ * By default, SoftwareSerial is used on pins 2 and 3. Any other Stream can be
+ * passed to begin() instead, e.g. the interrupt driven BitBusUart.
  * Currently, only the Controller/Gamepad is supported in Analog (joystick) mode.
- * 
+ *
+ * To skip the virtual calls through Stream, declare your own BitBusT with the
+ * transport you use instead of using the BitBus singleton:
+ *
+ *   BitBusT<BitBusStreamTransport<HardwareSerial> > bitBus;
+ *   ...
+ *   Serial.begin(9600);
+ *   bitBus.begin(Serial);
+ *
+ * A board with a second Bluetooth module gets a GamePadModule and a BitBusT
+ * per module, and a BitBusRoundRobin to service them all from loop():
+ *
+ *   GamePadModule player2;   // Or player2(events) with a GamePadEventQueue, for readEvent()
+ *   BitBusT<BitBusStreamTransport<HardwareSerial> > bitBus2(player2);
+ *   BitBusRoundRobin<2> buses;
+ *   ...
+ *   buses.add(BitBus);
+ *   buses.add(bitBus2);
+ *   ...
+ *   buses.processInputMicros(2000);
+ *
  * The software interface is meant to be very similar to the Dabble
  * software interface for easy portability, even though the protocols
  * between the App and the microcontroller seem to be very different.
@@ -20,23 +41,314 @@
 
 #include "Arduino.h"
 #include "Stream.h"
+#include "BitBusCapture.h"
+#include "BitBusConfig.h"
+#include "BitBusStats.h"
+#include "BitBusTransport.h"
+#include "GamePad.h"
+
+// Shared by every BitBusT, input is only ever processed from loop()
+extern uint8_t _bitBusInputBuffer[BITBUS_INPUT_BUFFER_SIZE];
 
-class BitBusClass
+/**
+ * Transport is one of the classes in BitBusTransport.h. Its begin()
+ * overloads become BitBusT's begin().
+ */
+template <class Transport>
+class BitBusT : public Transport
 {
 public:
-  BitBusClass();
-  
+  // pad receives everything this instance reads
+  BitBusT(GamePadModule &pad = GamePad) : gamePad(&pad), bytesBeforeGap(-1) {}
+
   // Library Initialization
-  void begin(unsigned long baudRate=9600, int rx=2, int tx=3);
+  using Transport::begin;
   // Processing Incomming Frames
   void processInput();
-  
+
+  /**
+   * Budgeted versions of processInput() for loops with a deadline. They stop
+   * early once maxBytes have been read or maxMicros have passed, checking
+   * between chunks of up to BITBUS_INPUT_BUFFER_SIZE bytes. A message cut
+   * off by the budget is finished on the next call.
+   *
+   * Returns: number of bytes still waiting in the transport
+   */
+  int processInput(unsigned int maxBytes);
+  int processInputMicros(unsigned long maxMicros);
+
+  GamePadModule &getGamePad() { return *this->gamePad; }
+
 private:
-  void init();
-  static bool isInit;
-  Stream * bbSerial;
+  int drain(unsigned int maxBytes, unsigned long maxMicros, bool timed);
+  void processChunk(int len);
+  int detectBaud();
+
+  GamePadModule *gamePad;
+  // In coalescing mode, bytes left to read before the input lost to an overflow, or -1
+  int bytesBeforeGap;
 };
 
+/**
+ * Process incoming input from the serial port
+ *  Note that the GamePadaction buttons are cleared before processing any new input.
+ * Every action button received during this call is then reported.
+ * The up/down/left/right buttons are persistent because we are emulating them
+ * using Analog Mode.
+ *
+ * Input is drained into a buffer and handed to the parser a chunk at a time
+ * so the per call overhead is paid once per chunk rather than once per byte.
+ */
+template <class Transport>
+void BitBusT<Transport>::processInput()
+{
+  drain(~0U, 0, false);
+}
+
+template <class Transport>
+int BitBusT<Transport>::processInput(unsigned int maxBytes)
+{
+  return drain(maxBytes, 0, false);
+}
+
+template <class Transport>
+int BitBusT<Transport>::processInputMicros(unsigned long maxMicros)
+{
+  return drain(~0U, maxMicros, true);
+}
+
+/**
+ * Parse input a chunk at a time until the transport is empty or the budget
+ * runs out.
+ *
+ * Returns: number of bytes still waiting in the transport
+ */
+template <class Transport>
+int BitBusT<Transport>::drain(unsigned int maxBytes, unsigned long maxMicros, bool timed)
+{
+  unsigned long start = 0;
+  if (timed || BITBUS_STATS) {
+    start = micros();
+  }
+  unsigned int drained = 0;
+
+  this->gamePad->_clearActionButtons();
+#if BITBUS_BAUD_DETECT
+  if (_bitBusDetectingBaud(static_cast<Transport &>(*this))) {
+    return detectBaud();
+  }
+#endif
+
+  /* When the transport overflows, bytes are lost after the ones waiting now,
+   * because nothing more can arrive until some are read.
+   */
+  bool coalescing = this->gamePad->isCoalescing();
+  bool overflowed = false;
+  if (!coalescing) {
+    // A gap noted before coalescing was turned off is not skipped to
+    this->bytesBeforeGap = -1;
+  } else if ((overflowed = Transport::overflow())) {
+    this->bytesBeforeGap = Transport::available();
+  }
+
+  int available;
+  while (drained < maxBytes
+         && (!timed || (unsigned long)(micros() - start) < maxMicros)
+         && (available = Transport::available()) > 0) {
+    if (0 == this->bytesBeforeGap) {
+      this->gamePad->_inputLost();
+      this->bytesBeforeGap = -1;
+    }
+    if (available > BITBUS_INPUT_BUFFER_SIZE) {
+      available = BITBUS_INPUT_BUFFER_SIZE;
+    }
+    if ((unsigned int)available > maxBytes - drained) {
+      available = maxBytes - drained;
+    }
+    if (this->bytesBeforeGap > 0 && available > this->bytesBeforeGap) {
+      available = this->bytesBeforeGap;
+    }
+    processChunk(available);
+    drained += available;
+    if (this->bytesBeforeGap > 0) {
+      this->bytesBeforeGap -= available;
+    }
+  }
+
+  if (coalescing) {
+    this->gamePad->_flushCoalesced();
+  }
+  BITBUS_STATS_ONLY(_bitBusStatsCall(drained, micros() - start, coalescing ? overflowed : Transport::overflow()));
+  return Transport::available();
+}
+
+// Read len bytes from the transport and parse them
+template <class Transport>
+void BitBusT<Transport>::processChunk(int len)
+{
+  for (int i = 0; i < len; i++) {
+    _bitBusInputBuffer[i] = Transport::read();
+  }
+#if BITBUS_CAPTURE
+  BitBusCapture::_capture(_bitBusInputBuffer, len);
+#endif
+  /* Just punt processing over the the GamePad module because that
+   * is all the library suports right now.
+   */
+  this->gamePad->_processInput(_bitBusInputBuffer, len);
+}
+
+#if BITBUS_BAUD_DETECT
+/**
+ * While the transport finds its baud rate, a chunk of input per call goes to
+ * it instead of the GamePad. It is called even with no input, so the
+ * transport can give up on a quiet rate. Once the rate is found, the GamePad
+ * starts at the next message, as after lost input.
+ *
+ * Returns: number of bytes still waiting in the transport
+ */
+template <class Transport>
+int BitBusT<Transport>::detectBaud()
+{
+  int available = Transport::available();
+  if (available > BITBUS_INPUT_BUFFER_SIZE) {
+    available = BITBUS_INPUT_BUFFER_SIZE;
+  }
+  for (int i = 0; i < available; i++) {
+    _bitBusInputBuffer[i] = Transport::read();
+  }
+  _bitBusDetectBaud(static_cast<Transport &>(*this), _bitBusInputBuffer, available);
+  if (!_bitBusDetectingBaud(static_cast<Transport &>(*this))) {
+    this->gamePad->_inputLost();
+  }
+  return Transport::available();
+}
+#endif
+
+/**
+ * Services up to N BitBusT instances, whatever their transports, from one
+ * call in loop(). A budget is shared evenly between the instances, and any
+ * part of a share an instance doesn't use is passed on to the ones after it.
+ * The instance that goes first moves along on every call, so none of them is
+ * always left with the remains of the budget.
+ */
+template <uint8_t N>
+class BitBusRoundRobin
+{
+public:
+  BitBusRoundRobin() : count(0), next(0) {}
+
+  // Returns: false if there are already N instances
+  template <class Transport>
+  bool add(BitBusT<Transport> &bus) {
+    if (this->count >= N) {
+      return false;
+    }
+    this->entries[this->count].bus = &bus;
+    this->entries[this->count].available = &available<Transport>;
+    this->entries[this->count].processBytes = &processBytes<Transport>;
+    this->entries[this->count].processMicros = &processMicros<Transport>;
+    this->count++;
+    return true;
+  }
+
+  // Drain every instance completely
+  void processInput() {
+    for (uint8_t i = 0; i < this->count; i++) {
+      this->entries[i].processBytes(this->entries[i].bus, ~0U);
+    }
+  }
+
+  /**
+   * maxBytes and maxMicros are the budget for all of the instances together.
+   * Instances reached after the budget is used up are skipped until a later call.
+   *
+   * Returns: number of bytes still waiting in all of the transports
+   */
+  int processInput(unsigned int maxBytes) {
+    int pending = 0;
+    for (uint8_t i = 0; i < this->count; i++) {
+      Entry &entry = this->entry(i);
+      uint8_t left = this->count - i;
+      unsigned int share = maxBytes / left + (maxBytes % left ? 1 : 0);
+      if (0 == share) {
+        pending += entry.available(entry.bus);
+        continue;
+      }
+      int before = entry.available(entry.bus);
+      int after = entry.processBytes(entry.bus, share);
+      unsigned int used = (before > after) ? before - after : 0;
+      maxBytes -= (used < share) ? used : share;
+      pending += after;
+    }
+    this->rotate();
+    return pending;
+  }
+
+  int processInputMicros(unsigned long maxMicros) {
+    int pending = 0;
+    unsigned long start = micros();
+    for (uint8_t i = 0; i < this->count; i++) {
+      Entry &entry = this->entry(i);
+      unsigned long elapsed = micros() - start;
+      if (elapsed >= maxMicros) {
+        pending += entry.available(entry.bus);
+        continue;
+      }
+      uint8_t left = this->count - i;
+      unsigned long remaining = maxMicros - elapsed;
+      unsigned long share = remaining / left + (remaining % left ? 1 : 0);
+      pending += entry.processMicros(entry.bus, share);
+    }
+    this->rotate();
+    return pending;
+  }
+
+  uint8_t size() { return this->count; }
+
+private:
+  // Calls through plain function pointers, so BitBusT needs no vtable
+  struct Entry {
+    void *bus;
+    int (*available)(void *bus);
+    int (*processBytes)(void *bus, unsigned int maxBytes);
+    int (*processMicros)(void *bus, unsigned long maxMicros);
+  };
+
+  template <class Transport>
+  static int available(void *bus) {
+    return static_cast<BitBusT<Transport> *>(bus)->available();
+  }
+  template <class Transport>
+  static int processBytes(void *bus, unsigned int maxBytes) {
+    return static_cast<BitBusT<Transport> *>(bus)->processInput(maxBytes);
+  }
+  template <class Transport>
+  static int processMicros(void *bus, unsigned long maxMicros) {
+    return static_cast<BitBusT<Transport> *>(bus)->processInputMicros(maxMicros);
+  }
+
+  // Returns: the i'th instance to service on this call
+  Entry &entry(uint8_t i) {
+    i += this->next;
+    return this->entries[i < this->count ? i : i - this->count];
+  }
+
+  void rotate() {
+    if (++this->next >= this->count) {
+      this->next = 0;
+    }
+  }
+
+  Entry entries[N];
+  uint8_t count;
+  uint8_t next;  // The instance that goes first on the next call
+};
+
+// The default instantiation is compiled once, in BitBus.cpp
+extern template class BitBusT<BitBusDefaultTransport>;
+typedef BitBusT<BitBusDefaultTransport> BitBusClass;
+
 // Extern Object
 extern BitBusClass BitBus;
 #endif
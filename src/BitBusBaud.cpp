@@ -0,0 +1,111 @@
+/*
+ * BitBusBaud: Finds the baud rate of the Bluetooth module from what it sends.
+ */
+#include "BitBusBaud.h"
+#include "BitBusPlatform.h"
+
+#if BITBUS_BAUD_DETECT
+
+// The rates HC-05 and HC-06 modules can be set to, most likely first
+static const unsigned long rates[] BITBUS_FLASH = {9600, 38400, 115200, 57600, 19200, 4800, 2400, 1200};
+#define RATE_COUNT (sizeof(rates) / sizeof(rates[0]))
+
+_BitBusBaudDetector::_BitBusBaudDetector()
+{
+  this->start(0);
+}
+
+unsigned long _BitBusBaudDetector::start(unsigned long now)
+{
+  this->locked = false;
+  this->rateIndex = RATE_COUNT - 1;
+  return this->next(now);
+}
+
+unsigned long _BitBusBaudDetector::getRate() const
+{
+  unsigned long rate;
+  return *_bitBusFlashEntry(&rates[this->rateIndex], &rate);
+}
+
+/**
+ * Move on to the next rate, from the last back round to the first.
+ *
+ * Returns: the new rate
+ */
+unsigned long _BitBusBaudDetector::next(unsigned long now)
+{
+  this->rateIndex = (this->rateIndex + 1) % RATE_COUNT;
+  this->since = now;
+  this->goodMessages = 0;
+  this->errors = 0;
+  this->noise = 0;
+  this->synced = false;
+  this->message.clear();
+  return this->getRate();
+}
+
+/**
+ * Count errors at the current rate.
+ *
+ * Returns: true if there have been too many to keep trying it
+ */
+bool _BitBusBaudDetector::addErrors(size_t count)
+{
+  this->goodMessages = 0;
+  if (count >= (size_t)(BITBUS_AUTO_BAUD_ERRORS - this->errors)) {
+    return true;
+  }
+  this->errors += count;
+  return false;
+}
+
+/**
+ * The first bytes at a new rate are usually the tail of a message, so they
+ * are skipped as after lost input. A parse error starts the count of good
+ * messages again and skips to the next message. At the wrong rate most of
+ * what is read can't start a message at all, so each message's worth of
+ * bytes skipped counts as an error too. Too many errors, or too long without
+ * a lock, and the next rate is tried.
+ */
+unsigned long _BitBusBaudDetector::update(const uint8_t *buf, size_t len, unsigned long now)
+{
+  if (this->locked) {
+    return this->getRate();
+  }
+  while (len) {
+    if (!this->synced) {
+      size_t skipped = this->message.skipToMessageStart(buf, len);
+      buf += skipped;
+      len -= skipped;
+      this->synced = (0 != len);
+      skipped += this->noise;
+      this->noise = skipped % ANALOG_DEC_MESSAGE_LEN;
+      if (skipped >= ANALOG_DEC_MESSAGE_LEN && this->addErrors(skipped / ANALOG_DEC_MESSAGE_LEN)) {
+        return this->next(now);
+      }
+      continue;
+    }
+    size_t consumed;
+    int result = this->message.processInput(buf, len, &consumed);
+    buf += consumed;
+    len -= consumed;
+    if (0 == result) {
+      this->message.clear();
+      if (++this->goodMessages >= BITBUS_AUTO_BAUD_MESSAGES) {
+        this->locked = true;
+        return this->getRate();
+      }
+    } else if (1 != result) {
+      this->synced = false;
+      if (this->addErrors(1)) {
+        return this->next(now);
+      }
+    }
+  }
+  if ((unsigned long)(now - this->since) >= BITBUS_AUTO_BAUD_DWELL_MS) {
+    return this->next(now);
+  }
+  return this->getRate();
+}
+#endif
@@ -0,0 +1,71 @@
+/**
+ * BitBusBaud: Finds the baud rate of the Bluetooth module from what it sends.
+ *
+ * HC-05 and HC-06 modules are sold set to 9600 or 38400 baud and can be set
+ * to anything from 1200 to 115200. At the wrong rate the serial port still
+ * reads bytes, but they don't parse. A transport begun with BITBUS_AUTO_BAUD
+ * listens at each of the usual rates in turn and keeps the first one at
+ * which BITBUS_AUTO_BAUD_MESSAGES messages in a row parse without an error.
+ * It moves on after BITBUS_AUTO_BAUD_ERRORS errors, or after
+ * BITBUS_AUTO_BAUD_DWELL_MS if the module is quiet:
+ *
+ *   BitBus.begin(BITBUS_AUTO_BAUD);
+ *
+ * Messages read while the rate is being found are not passed on to the
+ * GamePad. See BitBusTransport.h for the transports that can do this.
+ *
+ * Only with BITBUS_BAUD_DETECT set to 1, see BitBusConfig.h. Otherwise
+ * BITBUS_AUTO_BAUD isn't defined, so a sketch that asks for it doesn't build.
+ */
+#ifndef BitBusBaud_h
+#define BitBusBaud_h
+
+#include "Arduino.h"
+#include "BitBusConfig.h"
+#include "MessageBuffer.h"
+
+#if BITBUS_BAUD_DETECT
+// Pass as the baud rate to a transport's begin() to find it from the input
+#define BITBUS_AUTO_BAUD 0UL
+#endif
+
+class _BitBusBaudDetector
+{
+public:
+  _BitBusBaudDetector();
+
+  /**
+   * Start over from the first rate. now is millis().
+   *
+   * Returns: the rate to listen at
+   */
+  unsigned long start(unsigned long now);
+
+  /**
+   * Check bytes read at the current rate. now is millis(). Call it even when
+   * there is nothing to check, so a quiet rate gets a chance to time out.
+   *
+   * Returns: the rate to listen at from now on
+   */
+  unsigned long update(const uint8_t *buf, size_t len, unsigned long now);
+
+  // Returns: true once a rate has been found
+  bool isLocked() const { return locked; }
+  // Returns: the rate found, or the one being tried
+  unsigned long getRate() const;
+
+private:
+  unsigned long next(unsigned long now);
+  bool addErrors(size_t count);
+
+  _MessageBuffer message;
+  unsigned long since;    // millis() when the current rate was tried
+  uint8_t rateIndex;      // Into the table of rates to try
+  uint8_t goodMessages;   // Parsed in a row at the current rate
+  uint8_t errors;         // At the current rate
+  uint8_t noise;          // Bytes skipped at the current rate, less the ones counted as errors
+  bool synced;            // Past the partial message the current rate started in
+  bool locked;
+};
+
+#endif
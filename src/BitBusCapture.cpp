@@ -0,0 +1,247 @@
+/*
+ * BitBusCapture: Record the bytes the App sends and play them back later.
+ */
+#include "BitBusCapture.h"
+
+const uint8_t _bitBusCaptureHeader[BITBUS_CAPTURE_HEADER_LEN] = {'B', 'B', 'C', 1};
+
+BitBusCapture *BitBusCapture::_active = NULL;
+
+void BitBusCapture::start()
+{
+  this->lastMillis = millis();
+  _active = this;
+}
+
+void BitBusCapture::stop()
+{
+  if (this == _active) {
+    _active = NULL;
+  }
+}
+
+/**
+ * Encode the record header for a chunk of input and store the record. A
+ * record holds up to 255 bytes, so a longer chunk is stored as several, the
+ * later ones 0ms after the first.
+ */
+void BitBusCapture::capture(const uint8_t *buf, size_t len)
+{
+  unsigned long now = millis();
+  unsigned long delta = now - this->lastMillis;
+  this->lastMillis = now;
+
+  do {
+    uint8_t header[BITBUS_CAPTURE_MAX_RECORD_HEADER];
+    uint8_t headerLen = 0;
+    if (delta < 255) {
+      header[headerLen++] = delta;
+    } else {
+      if (delta > 0xFFFF) {
+        delta = 0xFFFF;
+      }
+      header[headerLen++] = 255;
+      header[headerLen++] = delta & 0xFF;
+      header[headerLen++] = delta >> 8;
+    }
+    uint8_t recordLen = len < 255 ? len : 255;
+    header[headerLen++] = recordLen;
+    this->record(header, headerLen, buf, recordLen);
+    buf += recordLen;
+    len -= recordLen;
+    delta = 0;
+  } while (len);
+}
+
+BitBusRamCapture::BitBusRamCapture(uint8_t *buffer, uint16_t size)
+  : buffer(buffer), size(size)
+{
+  this->clear();
+}
+
+void BitBusRamCapture::clear()
+{
+  this->tail = 0;
+  this->used = 0;
+}
+
+uint16_t BitBusRamCapture::length()
+{
+  return BITBUS_CAPTURE_HEADER_LEN + this->used;
+}
+
+// Returns: the byte offset bytes after the start of the oldest record
+uint8_t BitBusRamCapture::byteAt(uint16_t offset)
+{
+  uint16_t index = this->tail + offset;
+  if (index >= this->size) {
+    index -= this->size;
+  }
+  return this->buffer[index];
+}
+
+void BitBusRamCapture::put(const uint8_t *data, uint8_t len)
+{
+  uint16_t index = this->tail + this->used;
+  if (index >= this->size) {
+    index -= this->size;
+  }
+  for (uint8_t i = 0; i < len; i++) {
+    this->buffer[index] = data[i];
+    if (++index == this->size) {
+      index = 0;
+    }
+  }
+  this->used += len;
+}
+
+void BitBusRamCapture::dropOldest()
+{
+  uint16_t headerLen = (255 == this->byteAt(0)) ? 4 : 2;
+  uint16_t recordLen = headerLen + this->byteAt(headerLen - 1);
+  this->tail += recordLen;
+  if (this->tail >= this->size) {
+    this->tail -= this->size;
+  }
+  this->used -= recordLen;
+}
+
+/**
+ * NB: Once old records have been dropped, the delta of the oldest record
+ * left is relative to one that is gone.
+ */
+void BitBusRamCapture::record(const uint8_t *header, uint8_t headerLen, const uint8_t *data, uint8_t len)
+{
+  uint16_t recordLen = headerLen + len;
+  if (recordLen > this->size) {
+    return;
+  }
+  while (this->size - this->used < recordLen) {
+    this->dropOldest();
+  }
+  this->put(header, headerLen);
+  this->put(data, len);
+}
+
+uint16_t BitBusRamCapture::read(uint8_t *dest, uint16_t maxLen)
+{
+  uint16_t count = 0;
+  for (uint8_t i = 0; i < BITBUS_CAPTURE_HEADER_LEN && count < maxLen; i++) {
+    dest[count++] = _bitBusCaptureHeader[i];
+  }
+  for (uint16_t i = 0; i < this->used && count < maxLen; i++) {
+    dest[count++] = this->byteAt(i);
+  }
+  return count;
+}
+
+static void printHexByte(Print &out, uint8_t value)
+{
+  static const char hexChars[] = "0123456789abcdef";
+  out.print(hexChars[value >> 4]);
+  out.print(hexChars[value & 0x0F]);
+}
+
+void BitBusRamCapture::dump(Print &out)
+{
+  uint16_t len = this->length();
+  for (uint16_t i = 0; i < len; i++) {
+    uint8_t value = (i < BITBUS_CAPTURE_HEADER_LEN)
+      ? _bitBusCaptureHeader[i] : this->byteAt(i - BITBUS_CAPTURE_HEADER_LEN);
+    printHexByte(out, value);
+    if (31 == (i & 31) || len - 1 == i) {
+      out.println();
+    }
+  }
+}
+
+BitBusReplay::BitBusReplay()
+{
+  this->begin(NULL, 0);
+}
+
+bool BitBusReplay::begin(const uint8_t *log, size_t len, uint8_t speed)
+{
+  this->log = log;
+  this->len = len;
+  this->pos = len;
+  this->remaining = 0;
+  this->speed = speed;
+  this->dueMillis = 0;
+  this->startMillis = millis();
+
+  if (len < BITBUS_CAPTURE_HEADER_LEN || memcmp(log, _bitBusCaptureHeader, BITBUS_CAPTURE_HEADER_LEN)) {
+    return false;
+  }
+  this->pos = BITBUS_CAPTURE_HEADER_LEN;
+  return true;
+}
+
+/**
+ * Move on to the next record with data in it, if the current one is used up.
+ *
+ * Returns: false at the end of the capture
+ */
+bool BitBusReplay::nextRecord()
+{
+  while (0 == this->remaining) {
+    if (this->pos >= this->len) {
+      return false;
+    }
+    unsigned long delta = this->log[this->pos++];
+    if (255 == delta) {
+      if (this->pos + 2 > this->len) {
+        this->pos = this->len;
+        return false;
+      }
+      delta = this->log[this->pos] | ((uint16_t)this->log[this->pos + 1] << 8);
+      this->pos += 2;
+    }
+    if (this->pos >= this->len) {
+      return false;
+    }
+    this->remaining = this->log[this->pos++];
+    // A capture cut short ends with a short record
+    if (this->remaining > this->len - this->pos) {
+      this->remaining = this->len - this->pos;
+    }
+    this->dueMillis += delta;
+  }
+  return true;
+}
+
+bool BitBusReplay::finished()
+{
+  return !this->nextRecord();
+}
+
+/**
+ * Returns: the rest of the current record once its time has come, otherwise 0
+ */
+int BitBusReplay::available()
+{
+  if (!this->nextRecord()) {
+    return 0;
+  }
+  if (this->speed && (millis() - this->startMillis) * this->speed < this->dueMillis) {
+    return 0;
+  }
+  return this->remaining;
+}
+
+int BitBusReplay::read()
+{
+  if (!this->available()) {
+    return -1;
+  }
+  this->remaining--;
+  return this->log[this->pos++];
+}
+
+int BitBusReplay::peek()
+{
+  if (!this->available()) {
+    return -1;
+  }
+  return this->log[this->pos];
+}
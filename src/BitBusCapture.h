@@ -0,0 +1,141 @@
+/**
+ * BitBusCapture: Record the bytes the App sends and play them back later.
+ *
+ * A capture records every chunk of input BitBus.processInput() reads, with
+ * the time since the previous chunk, so field problems can be reproduced and
+ * real sessions used as benchmarks.
+ *
+ *   static uint8_t captureBuffer[256];
+ *   BitBusRamCapture capture(captureBuffer, sizeof(captureBuffer));
+ *
+ *   capture.start();
+ *   ...
+ *   capture.dump();   // Hex over Serial, turn back into a file with: xxd -r -p
+ *
+ * BitBusReplay is a Stream that plays a capture back, through BitBus.begin()
+ * or a BitBusT, at the original speed or faster.
+ *
+ * Capture format:
+ *   "BBC" 0x01                 header
+ *   records:
+ *     delta                    ms since the previous record, 0 - 254
+ *     [delta16]                if delta is 255: little endian uint16 ms, saturating
+ *     len                      number of data bytes, 0 - 255
+ *     data[len]
+ */
+#ifndef BitBusCapture_h
+#define BitBusCapture_h
+
+#include "Arduino.h"
+#include "Stream.h"
+#include "BitBusConfig.h"
+
+#define BITBUS_CAPTURE_HEADER_LEN 4
+// Longest record header: delta, delta16 and len
+#define BITBUS_CAPTURE_MAX_RECORD_HEADER 4
+
+extern const uint8_t _bitBusCaptureHeader[BITBUS_CAPTURE_HEADER_LEN];
+
+/**
+ * Base class for the places a capture can go. Only one capture is active at a time.
+ */
+class BitBusCapture
+{
+public:
+  BitBusCapture() : lastMillis(0) {}
+
+  // Record every chunk of input from now on
+  void start();
+  void stop();
+  bool isStarted() { return this == _active; }
+
+  // Called by BitBusT for every chunk of input it reads
+  static void _capture(const uint8_t *buf, size_t len) {
+    if (_active) {
+      _active->capture(buf, len);
+    }
+  }
+
+  // The capture that is recording, if any
+  static BitBusCapture *_active;
+
+protected:
+  // Store one record: its header followed by its data
+  virtual void record(const uint8_t *header, uint8_t headerLen, const uint8_t *data, uint8_t len) = 0;
+
+private:
+  void capture(const uint8_t *buf, size_t len);
+
+  unsigned long lastMillis;
+};
+
+/**
+ * Keeps the most recent input in a RAM buffer, dropping the oldest records
+ * when it is full.
+ */
+class BitBusRamCapture : public BitBusCapture
+{
+public:
+  BitBusRamCapture(uint8_t *buffer, uint16_t size);
+
+  void clear();
+  // Returns: size of the capture, including the format header
+  uint16_t length();
+  // Copy up to maxLen bytes of the capture, including the format header. Returns: bytes copied
+  uint16_t read(uint8_t *dest, uint16_t maxLen);
+  // Print the capture in hex, 32 bytes per line, by default over Serial
+  void dump(Print &out = Serial);
+
+protected:
+  virtual void record(const uint8_t *header, uint8_t headerLen, const uint8_t *data, uint8_t len);
+
+private:
+  uint8_t byteAt(uint16_t offset);
+  void put(const uint8_t *data, uint8_t len);
+  void dropOldest();
+
+  uint8_t *buffer;
+  uint16_t size;
+  uint16_t tail;  // Start of the oldest record
+  uint16_t used;
+};
+
+/**
+ * A Stream that plays back a capture.
+ */
+class BitBusReplay : public Stream
+{
+public:
+  BitBusReplay();
+
+  /**
+   * log: a capture, starting with the format header. Not copied.
+   * speed: 1 to replay at the original speed, 2 for twice as fast and so on.
+   *        0 makes every byte available straight away.
+   *
+   * Returns: false if log isn't a capture
+   */
+  bool begin(const uint8_t *log, size_t len, uint8_t speed = 0);
+  // Returns: true once every byte has been read
+  bool finished();
+
+  virtual int available();
+  virtual int read();
+  virtual int peek();
+  // Replays are read only
+  virtual size_t write(uint8_t c) { return 0; }
+  using Print::write;
+
+private:
+  bool nextRecord();
+
+  const uint8_t *log;
+  size_t len;
+  size_t pos;
+  uint8_t remaining;      // Data bytes left in the current record
+  uint8_t speed;
+  unsigned long dueMillis;    // Capture time of the current record
+  unsigned long startMillis;
+};
+
+#endif
@@ -0,0 +1,183 @@
+/**
+ * BitBusConfig: Every compile time option of the library in one place.
+ *
+ * NB: The library is compiled separately from the sketch, so a #define in
+ * the sketch isn't enough. Either change the defaults below or pass the
+ * options to the whole build, e.g. with arduino-cli:
+ *
+ *   arduino-cli compile --build-property "build.extra_flags=-DGAMEPAD_EVENT_QUEUE_SIZE=0" ...
+ *
+ * extras/footprint/footprint.sh reports the flash and RAM each
+ * configuration in extras/footprint/configs.txt costs.
+ */
+#ifndef BitBusConfig_h
+#define BitBusConfig_h
+
+/*
+ * BitBus
+ */
+
+// Input is read from the serial port in chunks of up to this many bytes
+#ifndef BITBUS_INPUT_BUFFER_SIZE
+#define BITBUS_INPUT_BUFFER_SIZE 32
+#endif
+
+// Set to 0 to take the capture check out of processInput()
+#ifndef BITBUS_CAPTURE
+#define BITBUS_CAPTURE 1
+#endif
+
+// Set to 1 to collect the counters in BitBusStats.h
+#ifndef BITBUS_STATS
+#define BITBUS_STATS 0
+#endif
+
+// Number of buckets in each histogram. 20 buckets reach half a second.
+#ifndef BITBUS_STATS_BUCKETS
+#define BITBUS_STATS_BUCKETS 20
+#endif
+
+// Bytes of receive buffer in BitBusUart. Must be a power of two no larger than 128.
+#ifndef BITBUS_UART_RX_BUFFER_SIZE
+#define BITBUS_UART_RX_BUFFER_SIZE 64
+#endif
+
+// Set to 1 for begin(BITBUS_AUTO_BAUD), see BitBusBaud.h. Off by default:
+// every stream and SoftwareSerial transport then carries a baud rate
+// detector with a message buffer of its own, whether it is used or not.
+#ifndef BITBUS_BAUD_DETECT
+#define BITBUS_BAUD_DETECT 0
+#endif
+
+// Messages in a row that have to parse before a baud rate is kept
+#ifndef BITBUS_AUTO_BAUD_MESSAGES
+#define BITBUS_AUTO_BAUD_MESSAGES 3
+#endif
+
+// Parse errors at a baud rate before the next one is tried
+#ifndef BITBUS_AUTO_BAUD_ERRORS
+#define BITBUS_AUTO_BAUD_ERRORS 4
+#endif
+
+// Milliseconds to listen at a baud rate before the next one is tried
+#ifndef BITBUS_AUTO_BAUD_DWELL_MS
+#define BITBUS_AUTO_BAUD_DWELL_MS 500
+#endif
+
+/*
+ * Set to 1 for BITBUS_UART_PARSER(), which parses each byte in the USART
+ * receive interrupt, and GamePadModule::readState() to read the result.
+ */
+#ifndef BITBUS_PARSE_IN_ISR
+#define BITBUS_PARSE_IN_ISR 0
+#endif
+
+/*
+ * Validate analog messages 32 bits at a time on little endian machines
+ * with wide registers. AVR is an 8 bit machine, so it uses the
+ * character table instead.
+ */
+#ifndef BITBUS_WORD_AT_A_TIME
+#if !defined(__AVR__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define BITBUS_WORD_AT_A_TIME 1
+#else
+#define BITBUS_WORD_AT_A_TIME 0
+#endif
+#endif
+
+/*
+ * Copy constant tables out of flash to read them. AVR has to, other boards
+ * read them in place. Setting it to 1 on the host tests the AVR code path.
+ */
+#ifndef BITBUS_FLASH_COPY
+#if defined(__AVR__)
+#define BITBUS_FLASH_COPY 1
+#else
+#define BITBUS_FLASH_COPY 0
+#endif
+#endif
+#if defined(__AVR__) && !BITBUS_FLASH_COPY
+#error "AVR tables have to be copied out of flash, BITBUS_FLASH_COPY must be 1"
+#endif
+
+// Set to 0 on cores without a SoftwareSerial library, e.g. ESP32
+#ifndef BITBUS_SOFTWARE_SERIAL
+#if defined(__AVR__) || defined(ESP8266) || defined(BITBUS_HOST)
+#define BITBUS_SOFTWARE_SERIAL 1
+#else
+#define BITBUS_SOFTWARE_SERIAL 0
+#endif
+#endif
+
+/*
+ * Level of detail to record in the parser trace, see BitBusTrace.h: 0 for
+ * none, 1 for messages and errors, 2 for every character as well.
+ */
+#ifndef BITBUS_TRACE
+#define BITBUS_TRACE 0
+#endif
+
+// Number of records the trace keeps. Must be a power of two no larger than 128.
+#ifndef BITBUS_TRACE_SIZE
+#define BITBUS_TRACE_SIZE 32
+#endif
+
+#if defined(BITBUS_DEBUG) && BITBUS_DEBUG
+#error "BITBUS_DEBUG printed over Serial, which upset the timing. Use BITBUS_TRACE instead, see BitBusTrace.h"
+#endif
+
+// Set to 0 to leave out the functions only examples/GamePadUnitTest uses
+#ifndef BITBUS_TEST_SUPPORT
+#define BITBUS_TEST_SUPPORT 1
+#endif
+
+// Number of regions BENCH_START() and BENCH_STOP() in BitBusUtil.h can time
+#ifndef BITBUS_BENCH_REGIONS
+#define BITBUS_BENCH_REGIONS 8
+#endif
+
+/*
+ * GamePad
+ */
+
+// Number of events GamePad can hold. Must be a power of two, or 0 to leave out the queue.
+#ifndef GAMEPAD_EVENT_QUEUE_SIZE
+#define GAMEPAD_EVENT_QUEUE_SIZE 8
+#endif
+
+// Set to 0 to leave out onButtonPressed(), onAnalogUpdate() and onParseError()
+#ifndef GAMEPAD_CALLBACKS
+#define GAMEPAD_CALLBACKS 1
+#endif
+
+/*
+ * Set to 0 to leave out the Dabble only names: the triangle, circle, cross
+ * and square buttons, isPressed() and the joystick angle, radius and axes.
+ */
+#ifndef GAMEPAD_DABBLE_COMPAT
+#define GAMEPAD_DABBLE_COMPAT 1
+#endif
+
+/*
+ * Analog filter stages, applied in this order to each new joystick position
+ * before it is stored. Each is left out of the build when it is 0.
+ */
+// Exponential smoothing: each reading moves the position 1/2^N of the way, N = 1 - 6
+#ifndef GAMEPAD_SMOOTHING
+#define GAMEPAD_SMOOTHING 0
+#endif
+#if GAMEPAD_SMOOTHING < 0 || GAMEPAD_SMOOTHING > 6
+#error "GAMEPAD_SMOOTHING must be 0 - 6"
+#endif
+
+// Axis values up to this size read as 0
+#ifndef GAMEPAD_DEADZONE
+#define GAMEPAD_DEADZONE 0
+#endif
+
+// The emulated direction button only changes when another axis leads by more than this
+#ifndef GAMEPAD_HYSTERESIS
+#define GAMEPAD_HYSTERESIS 0
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * BitBusPlatform: The few things that differ between the boards BitBus runs on.
+ *
+ * AVR keeps constant tables in flash, a separate address space that has to
+ * be read with pgm_read_byte() or copied out with memcpy_P(). 32 bit boards
+ * and the host map their constants into ordinary memory, where the copy is
+ * pure overhead, so tables declared BITBUS_FLASH are read in place there.
+ * See BITBUS_FLASH_COPY in BitBusConfig.h.
+ *
+ * Strings printed with SerialPrint_P() still use the core's PSTR(), which
+ * every Arduino core provides, and which some of them need.
+ */
+#ifndef BitBusPlatform_h
+#define BitBusPlatform_h
+
+#include "Arduino.h"
+#include "BitBusConfig.h"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#include <new.h>
+#else
+#include <new>
+#include <string.h>
+#endif
+
+// For cores without the AVR flash string macros
+#ifndef PGM_P
+#define PGM_P const char *
+#endif
+#ifndef PSTR
+#define PSTR(s) (s)
+#endif
+#ifndef pgm_read_byte
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#endif
+
+#if BITBUS_FLASH_COPY
+
+// Put a constant table in flash
+#define BITBUS_FLASH PROGMEM
+
+// Returns: the byte at p in a BITBUS_FLASH table
+inline uint8_t _bitBusFlashByte(const uint8_t *p) { return pgm_read_byte(p); }
+
+// Returns: the entry at src in a BITBUS_FLASH table, copied to *buf
+template <class T>
+inline const T *_bitBusFlashEntry(const T *src, T *buf) {
+  memcpy_P(buf, src, sizeof(T));
+  return buf;
+}
+
+#else
+
+#define BITBUS_FLASH
+
+inline uint8_t _bitBusFlashByte(const uint8_t *p) { return *p; }
+
+// Returns: src, the table is read in place
+template <class T>
+inline const T *_bitBusFlashEntry(const T *src, T *buf) { return src; }
+
+#endif
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * BitBusStats: Optional counters for the traffic between the App and BitBus.
+ */
+#include "BitBusStats.h"
+
+#if BITBUS_STATS
+
+#include "BitBusUtil.h"
+
+static BitBusStats stats;
+static unsigned long lastFrameMicros;
+static bool haveFrame;
+
+static void increment(uint16_t *counter) {
+  if (*counter != 0xFFFF) {
+    (*counter)++;
+  }
+}
+
+// Returns: the histogram bucket for a duration, the number of significant bits
+static uint8_t bucketFor(unsigned long elapsedMicros) {
+  uint8_t bucket = 0;
+  while (elapsedMicros && bucket < BITBUS_STATS_BUCKETS - 1) {
+    elapsedMicros >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+const BitBusStats &BitBusGetStats() {
+  return stats;
+}
+
+void BitBusResetStats() {
+  memset(&stats, 0, sizeof(stats));
+  haveFrame = false;
+}
+
+void _bitBusStatsFrame(uint8_t messageType) {
+  unsigned long now = micros();
+  if (messageType < BITBUS_STATS_MESSAGE_TYPES) {
+    increment(&stats.frames[messageType]);
+  }
+  if (haveFrame) {
+    increment(&stats.frameInterval[bucketFor(now - lastFrameMicros)]);
+  }
+  lastFrameMicros = now;
+  haveFrame = true;
+}
+
+void _bitBusStatsSuperseded() {
+  increment(&stats.superseded);
+}
+
+void _bitBusStatsError(uint8_t error) {
+  uint8_t index = error - BITBUS_STATS_ERROR_FIRST;
+  if (index < BITBUS_STATS_ERRORS) {
+    increment(&stats.errors[index]);
+  }
+}
+
+void _bitBusStatsReset() {
+  increment(&stats.resets);
+}
+
+void _bitBusStatsCall(unsigned int bytes, unsigned long elapsedMicros, bool overflow) {
+  stats.bytes += bytes;
+  if (bytes > stats.maxBytesPerCall) {
+    stats.maxBytesPerCall = bytes;
+  }
+  if (overflow) {
+    increment(&stats.overflows);
+  }
+  increment(&stats.callTime[bucketFor(elapsedMicros)]);
+}
+
+static void printCounters(Print &out, PGM_P name, const uint16_t *counters, uint8_t len) {
+  SerialPrint_P(name, out);
+  for (uint8_t i = 0; i < len; i++) {
+    out.print(' ');
+    out.print(counters[i]);
+  }
+  out.println();
+}
+
+/**
+ * One line per counter. The arrays print in index order, e.g. frames by
+ * enum _MESSAGE_TYPE and the histograms from bucket 0 up.
+ */
+void BitBusPrintStats(Print &out) {
+  SerialPrint_P(PSTR("bytes: "), out);
+  out.println(stats.bytes);
+  printCounters(out, PSTR("frames:"), stats.frames, BITBUS_STATS_MESSAGE_TYPES);
+  SerialPrint_P(PSTR("superseded: "), out);
+  out.println(stats.superseded);
+  printCounters(out, PSTR("errors:"), stats.errors, BITBUS_STATS_ERRORS);
+  SerialPrint_P(PSTR("resets: "), out);
+  out.println(stats.resets);
+  SerialPrint_P(PSTR("overflows: "), out);
+  out.println(stats.overflows);
+  SerialPrint_P(PSTR("max bytes/call: "), out);
+  out.println(stats.maxBytesPerCall);
+  printCounters(out, PSTR("frame interval log2(us):"), stats.frameInterval, BITBUS_STATS_BUCKETS);
+  printCounters(out, PSTR("call time log2(us):"), stats.callTime, BITBUS_STATS_BUCKETS);
+}
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * BitBusStats: Optional counters for the traffic between the App and BitBus.
+ *
+ * Compile with BITBUS_STATS defined to 1 to turn them on. When it is 0
+ * (the default) the counters and the code that updates them compile out.
+ * See BitBusConfig.h for how to set it.
+ *
+ *   const BitBusStats &stats = BitBusGetStats();
+ *   if (stats.resets) ...
+ *   BitBusPrintStats();
+ *
+ * The histograms have log2 buckets of microseconds: bucket 0 counts 0us,
+ * bucket n counts 2^(n-1) to 2^n - 1 us, and the last bucket counts
+ * everything larger.
+ */
+#ifndef BitBusStats_h
+#define BitBusStats_h
+
+#include "Arduino.h"
+#include "BitBusConfig.h"
+
+// One more than the largest enum _MESSAGE_TYPE
+#define BITBUS_STATS_MESSAGE_TYPES 12
+// Number of enum GAMEPAD_ERROR codes, starting at 100
+#define BITBUS_STATS_ERROR_FIRST 100
+#define BITBUS_STATS_ERRORS 4
+
+// 16 bit counters stop at 65535 rather than wrapping
+struct BitBusStats {
+  uint32_t bytes;                                // Bytes read from the transport
+  uint16_t frames[BITBUS_STATS_MESSAGE_TYPES];   // Complete messages, by enum _MESSAGE_TYPE
+  uint16_t superseded;                           // Analog messages skipped undecoded in coalescing mode
+  uint16_t errors[BITBUS_STATS_ERRORS];          // Parse errors, by enum GAMEPAD_ERROR - 100
+  uint16_t resets;                               // Partial messages thrown away by an error
+  uint16_t overflows;                            // processInput() calls that found input had been lost
+  uint16_t maxBytesPerCall;                      // Most bytes drained by one processInput() call
+  uint16_t frameInterval[BITBUS_STATS_BUCKETS];  // Time between complete messages
+  uint16_t callTime[BITBUS_STATS_BUCKETS];       // Time spent in each processInput() call
+};
+
+#if BITBUS_STATS
+
+// Returns: the counters collected since startup or the last BitBusResetStats()
+const BitBusStats &BitBusGetStats();
+void BitBusResetStats();
+// Print the counters, by default to Serial
+void BitBusPrintStats(Print &out = Serial);
+
+// Only meant to be called by the library
+void _bitBusStatsFrame(uint8_t messageType);
+void _bitBusStatsSuperseded();
+void _bitBusStatsError(uint8_t error);
+void _bitBusStatsReset();
+void _bitBusStatsCall(unsigned int bytes, unsigned long elapsedMicros, bool overflow);
+
+// Wraps code that only exists to collect statistics
+#define BITBUS_STATS_ONLY(x) x
+
+#else
+
+#define BITBUS_STATS_ONLY(x)
+
+#endif
+
+#endif
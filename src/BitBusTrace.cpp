@@ -0,0 +1,68 @@
+/*
+ * BitBusTrace: A record of what the parser did, kept in RAM.
+ */
+#include "BitBusTrace.h"
+
+#if BITBUS_TRACE
+
+BitBusTraceRecord _bitBusTraceRing[BITBUS_TRACE_SIZE];
+uint8_t _bitBusTraceNext;
+bool _bitBusTraceFull;
+
+static const uint8_t traceHeader[4] = {'B', 'B', 'T', 1};
+
+uint8_t BitBusTraceCount() {
+  return _bitBusTraceFull ? BITBUS_TRACE_SIZE : _bitBusTraceNext;
+}
+
+bool BitBusTraceGet(uint8_t i, BitBusTraceRecord *record) {
+  uint8_t count = BitBusTraceCount();
+  if (i >= count) {
+    return false;
+  }
+  // The oldest record is the next one to be overwritten once the ring is full
+  *record = _bitBusTraceRing[(_bitBusTraceNext - count + i) & (BITBUS_TRACE_SIZE - 1)];
+  return true;
+}
+
+void BitBusTraceClear() {
+  _bitBusTraceNext = 0;
+  _bitBusTraceFull = false;
+}
+
+static void printHexByte(Print &out, uint8_t value, uint16_t *column) {
+  if (value < 0x10) {
+    out.print('0');
+  }
+  out.print(value, HEX);
+  if (0 == (++*column & 31)) {
+    out.println();
+  }
+}
+
+/**
+ * Records are copied out one at a time, so a record being written by an
+ * interrupt handler at the same time may come out mixed with the next one.
+ */
+void BitBusTraceDump(Print &out) {
+  uint16_t column = 0;
+  uint8_t count = BitBusTraceCount();
+  for (uint8_t i = 0; i < sizeof(traceHeader); i++) {
+    printHexByte(out, traceHeader[i], &column);
+  }
+  printHexByte(out, BITBUS_TRACE_RECORD_LEN, &column);
+  printHexByte(out, count, &column);
+  for (uint8_t i = 0; i < count; i++) {
+    const BitBusTraceRecord &r = _bitBusTraceRing[(_bitBusTraceNext - count + i) & (BITBUS_TRACE_SIZE - 1)];
+    const uint8_t bytes[BITBUS_TRACE_RECORD_LEN] = {(uint8_t)r.time, (uint8_t)(r.time >> 8), r.event,
+                                                    r.state, r.input, r.entry, r.code};
+    for (uint8_t j = 0; j < BITBUS_TRACE_RECORD_LEN; j++) {
+      printHexByte(out, bytes[j], &column);
+    }
+  }
+  if (column & 31) {
+    out.println();
+  }
+}
+
+#endif
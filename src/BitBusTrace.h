@@ -0,0 +1,133 @@
+/**
+ * BitBusTrace: A record of what the parser did, kept in RAM.
+ *
+ * Compile with BITBUS_TRACE set to a level to turn it on (see BitBusConfig.h):
+ *
+ *   BITBUS_TRACE_MESSAGES (1)  every chunk of input, message, error and skip
+ *   BITBUS_TRACE_CHARS    (2)  as well as every character through the state machine
+ *
+ * At 0, the default, it compiles out. Recording a step is a handful of
+ * stores into a ring of the last BITBUS_TRACE_SIZE records, so it doesn't
+ * change the timing being looked at the way printing does. Read the ring
+ * back when something has gone wrong:
+ *
+ *   if (error) {
+ *     BitBusTraceDump();   // Hex over Serial
+ *   }
+ *
+ * and decode it on a PC with extras/host/tracedump, which prints the
+ * parser states by name.
+ *
+ * Dump format, in hex, 32 bytes to a line:
+ *   "BBT" 0x01                  header
+ *   size                        bytes per record, 7
+ *   count                       number of records that follow, oldest first
+ *   records[count]              the fields of BitBusTraceRecord in order, time little endian
+ */
+#ifndef BitBusTrace_h
+#define BitBusTrace_h
+
+#include "Arduino.h"
+#include "Print.h"
+#include "BitBusConfig.h"
+
+#define BITBUS_TRACE_MESSAGES 1
+#define BITBUS_TRACE_CHARS    2
+
+#define BITBUS_TRACE_HEADER_LEN 6
+#define BITBUS_TRACE_RECORD_LEN 7
+
+enum BITBUS_TRACE_EVENT {
+  BT_CHAR = 0,     // A character: state before it, input, entry, code 1
+  BT_MESSAGE,      // A character that completed a message: state, input, entry, code the enum _MESSAGE_TYPE
+  BT_ERROR,        // A character the state machine rejected: state, input, entry, code the enum GAMEPAD_ERROR
+  BT_ANALOG,       // A whole analog message read by the fast path: input its length
+  BT_CHUNK,        // A chunk of input handed to the GamePad: state, input its length (up to 255)
+  BT_SKIP,         // Characters skipped to the next message start after lost input: input the count
+  BT_SUPERSEDED,   // An analog message skipped in coalescing mode: input its length
+  BT_UNHANDLED,    // A complete message of no known type: code the enum _MESSAGE_TYPE
+};
+
+struct BitBusTraceRecord {
+  uint16_t time;   // In 4us ticks, wrapping every 262ms
+  uint8_t event;   // enum BITBUS_TRACE_EVENT
+  uint8_t state;   // enum _INPUT_STATE before the event
+  uint8_t input;   // The character, or a count, see enum BITBUS_TRACE_EVENT
+  uint8_t entry;   // The state machine transition: next state in the low 6 bits, action or error above
+  uint8_t code;    // See enum BITBUS_TRACE_EVENT
+};
+
+#if BITBUS_TRACE
+
+#if BITBUS_TRACE_SIZE & (BITBUS_TRACE_SIZE - 1) || BITBUS_TRACE_SIZE > 128
+#error "BITBUS_TRACE_SIZE must be a power of two no larger than 128"
+#endif
+
+// Returns: the number of records held, up to BITBUS_TRACE_SIZE
+uint8_t BitBusTraceCount();
+// Copy record i, counting from the oldest. Returns: false if there is no record i
+bool BitBusTraceGet(uint8_t i, BitBusTraceRecord *record);
+void BitBusTraceClear();
+// Print the records in hex, see the dump format above
+void BitBusTraceDump(Print &out = Serial);
+
+// Only meant to be used by the library
+extern BitBusTraceRecord _bitBusTraceRing[BITBUS_TRACE_SIZE];
+extern uint8_t _bitBusTraceNext;
+extern bool _bitBusTraceFull;
+
+#if defined(__AVR__)
+// Timer 0 ticks every 4us at 16MHz for millis(); its overflow count makes the high byte
+extern "C" volatile unsigned long timer0_overflow_count;
+// Read the two as micros() does in wiring.c: with interrupts off, counting
+// an overflow whose interrupt is still pending.
+inline uint16_t _bitBusTraceTime() {
+  uint8_t oldSREG = SREG;
+  cli();
+  uint8_t m = timer0_overflow_count;
+  uint8_t t = TCNT0;
+#ifdef TIFR0
+  if ((TIFR0 & _BV(TOV0)) && t < 255) {
+#else
+  if ((TIFR & _BV(TOV0)) && t < 255) {
+#endif
+    m++;
+  }
+  SREG = oldSREG;
+  return ((uint16_t)m << 8) | t;
+}
+#else
+inline uint16_t _bitBusTraceTime() { return (uint16_t)(micros() >> 2); }
+#endif
+
+inline void _bitBusTrace(uint8_t event, uint8_t state, uint8_t input, uint8_t entry, uint8_t code) {
+  uint8_t i = _bitBusTraceNext;
+  BitBusTraceRecord *r = &_bitBusTraceRing[i];
+  r->time = _bitBusTraceTime();
+  r->event = event;
+  r->state = state;
+  r->input = input;
+  r->entry = entry;
+  r->code = code;
+  i = (i + 1) & (BITBUS_TRACE_SIZE - 1);
+  _bitBusTraceNext = i;
+  if (0 == i) {
+    _bitBusTraceFull = true;
+  }
+}
+
+#endif
+
+// Record an event at level BITBUS_TRACE_MESSAGES or BITBUS_TRACE_CHARS
+#if BITBUS_TRACE >= BITBUS_TRACE_MESSAGES
+#define BITBUS_TRACE_MESSAGE(event, state, input, entry, code) _bitBusTrace((event), (state), (input), (entry), (code))
+#else
+#define BITBUS_TRACE_MESSAGE(event, state, input, entry, code)
+#endif
+#if BITBUS_TRACE >= BITBUS_TRACE_CHARS
+#define BITBUS_TRACE_CHAR(event, state, input, entry, code) _bitBusTrace((event), (state), (input), (entry), (code))
+#else
+#define BITBUS_TRACE_CHAR(event, state, input, entry, code)
+#endif
+
+#endif
@@ -0,0 +1,294 @@
+/**
+ * BitBusTransport: Byte sources for BitBusT<Transport>.
+ *
+ * A transport is any class with these members:
+ *
+ *   int available();   // Bytes that can be read without waiting
+ *   int read();        // Next byte, or -1 if there is none
+ *
+ *   bool overflow();   // Input was lost since the last call (for BitBusStats)
+ *
+ * plus whatever begin() suits it. The calls go to the concrete class, not
+ * through the Stream vtable, so the compiler can inline them.
+ *
+ * The transports that start the serial port themselves can also find its
+ * baud rate, begun with BITBUS_AUTO_BAUD (see BitBusBaud.h). They overload
+ * _bitBusDetectingBaud() and _bitBusDetectBaud(), and BitBusT hands them its
+ * input until the rate is found.
+ *
+ * None of the transports allocate memory. The one that owns a SoftwareSerial
+ * builds it inside its own storage. It is left out when BITBUS_SOFTWARE_SERIAL
+ * is 0, and the BitBus singleton then reads from the Stream given to begin().
+ */
+#ifndef BitBusTransport_h
+#define BitBusTransport_h
+
+#include "Arduino.h"
+#include "Stream.h"
+#include "BitBusBaud.h"
+#include "BitBusConfig.h"
+#include "BitBusPlatform.h"
+#if BITBUS_SOFTWARE_SERIAL
+#include <SoftwareSerial.h>
+#endif
+
+/**
+ * Returns: true if the serial port lost input since the last call. Overloaded
+ * for the ports that can tell, e.g. BitBusUart.h adds one for BitBusUart.
+ */
+template <class S>
+inline bool _bitBusOverflow(S &serial) { return false; }
+#if BITBUS_SOFTWARE_SERIAL
+inline bool _bitBusOverflow(SoftwareSerial &serial) { return serial.overflow(); }
+#endif
+
+// Returns: true while the transport is finding its baud rate
+template <class T>
+inline bool _bitBusDetectingBaud(T &transport) { return false; }
+// Check input read while the transport is finding its baud rate
+template <class T>
+inline void _bitBusDetectBaud(T &transport, const uint8_t *buf, size_t len) {}
+
+/**
+ * Reads from a serial port the sketch already owns, e.g. Serial or a
+ * BitBusUart: transport.begin(Serial). Or transport.begin(Serial, baudRate)
+ * to start the port as well, where baudRate can be BITBUS_AUTO_BAUD.
+ */
+template <class S>
+class BitBusStreamTransport
+{
+public:
+  BitBusStreamTransport() : serial(NULL) {
+#if BITBUS_BAUD_DETECT
+    detecting = false;
+    baudRate = 0;
+#endif
+  }
+
+  void begin(S &stream) {
+    serial = &stream;
+#if BITBUS_BAUD_DETECT
+    detecting = false;
+    baudRate = 0;
+#endif
+  }
+  int available() { return serial->S::available(); }
+  int read() { return serial->S::read(); }
+  bool overflow() { return _bitBusOverflow(*serial); }
+
+#if BITBUS_BAUD_DETECT
+  void begin(S &stream, unsigned long rate) {
+    serial = &stream;
+    restart = &startPort;
+    detecting = (BITBUS_AUTO_BAUD == rate);
+    baudRate = detecting ? 0 : rate;
+    stream.begin(detecting ? detector.start(millis()) : rate);
+  }
+
+  // Returns: the rate given to begin() or found, 0 while it is being found or if begin() wasn't given one
+  unsigned long getBaudRate() const { return baudRate; }
+
+  bool _detectingBaud() const { return detecting; }
+
+  void _detectBaud(const uint8_t *buf, size_t len) {
+    unsigned long rate = detector.getRate();
+    unsigned long next = detector.update(buf, len, millis());
+    if (detector.isLocked()) {
+      detecting = false;
+      baudRate = next;
+    } else if (next != rate) {
+      restart(serial, next);
+      // Whatever was read at the old rate is no use
+      while (serial->S::available() > 0) {
+        serial->S::read();
+      }
+    }
+  }
+#endif
+
+private:
+#if BITBUS_BAUD_DETECT
+  // Through a pointer set by begin(), so ports without a begin(rate) still compile
+  static void startPort(S *port, unsigned long rate) { port->begin(rate); }
+#endif
+
+  S *serial;
+#if BITBUS_BAUD_DETECT
+  void (*restart)(S *port, unsigned long rate);
+  _BitBusBaudDetector detector;
+  unsigned long baudRate;
+  bool detecting;
+#endif
+};
+
+#if BITBUS_BAUD_DETECT
+template <class S>
+inline bool _bitBusDetectingBaud(BitBusStreamTransport<S> &transport) { return transport._detectingBaud(); }
+template <class S>
+inline void _bitBusDetectBaud(BitBusStreamTransport<S> &transport, const uint8_t *buf, size_t len) {
+  transport._detectBaud(buf, len);
+}
+#endif
+
+/**
+ * Any Stream. The concrete type isn't known, so this one does use virtual
+ * calls, and it can't start the port.
+ */
+template <>
+class BitBusStreamTransport<Stream>
+{
+public:
+  BitBusStreamTransport() : serial(NULL) {}
+
+  void begin(Stream &stream) { serial = &stream; }
+  int available() { return serial->available(); }
+  int read() { return serial->read(); }
+  bool overflow() { return false; }
+
+private:
+  Stream *serial;
+};
+
+#if BITBUS_BAUD_DETECT
+inline bool _bitBusDetectingBaud(BitBusStreamTransport<Stream> &transport) { return false; }
+inline void _bitBusDetectBaud(BitBusStreamTransport<Stream> &transport, const uint8_t *buf, size_t len) {}
+#endif
+
+#if BITBUS_SOFTWARE_SERIAL
+/**
+ * Owns a SoftwareSerial, built in place by begin(baudRate, rx, tx). baudRate
+ * can be BITBUS_AUTO_BAUD.
+ */
+class BitBusSoftwareSerialTransport
+{
+public:
+  BitBusSoftwareSerialTransport() : started(false) {}
+
+  void begin(unsigned long baudRate, int rx, int tx) {
+    end();
+    new (storage) SoftwareSerial(rx, tx);
+    started = true;
+#if BITBUS_BAUD_DETECT
+    stream.begin(*serial(), baudRate);
+#else
+    serial()->begin(baudRate);
+#endif
+  }
+
+  void end() {
+    if (started) {
+      serial()->~SoftwareSerial();
+      started = false;
+    }
+  }
+
+  int available() { return serial()->SoftwareSerial::available(); }
+  int read() { return serial()->SoftwareSerial::read(); }
+  bool overflow() { return serial()->overflow(); }
+
+  bool isStarted() const { return started; }
+
+#if BITBUS_BAUD_DETECT
+  // Returns: the rate given to begin() or found, 0 while it is being found
+  unsigned long getBaudRate() const { return stream.getBaudRate(); }
+  bool _detectingBaud() const { return started && stream._detectingBaud(); }
+  void _detectBaud(const uint8_t *buf, size_t len) { stream._detectBaud(buf, len); }
+#endif
+
+private:
+  SoftwareSerial *serial() { return (SoftwareSerial *)storage; }
+
+  alignas(SoftwareSerial) uint8_t storage[sizeof(SoftwareSerial)];
+  bool started;
+#if BITBUS_BAUD_DETECT
+  // Only to start the port and find its rate, reads go to the SoftwareSerial directly
+  BitBusStreamTransport<SoftwareSerial> stream;
+#endif
+};
+
+#if BITBUS_BAUD_DETECT
+inline bool _bitBusDetectingBaud(BitBusSoftwareSerialTransport &transport) { return transport._detectingBaud(); }
+inline void _bitBusDetectBaud(BitBusSoftwareSerialTransport &transport, const uint8_t *buf, size_t len) {
+  transport._detectBaud(buf, len);
+}
+#endif
+
+#endif
+
+/**
+ * Reads bytes from memory, e.g. a recorded session. Useful for testing.
+ */
+class BitBusMemoryTransport
+{
+public:
+  BitBusMemoryTransport() : data(NULL), len(0), pos(0) {}
+
+  void begin(const uint8_t *buf, size_t bufLen) {
+    data = buf;
+    len = bufLen;
+    pos = 0;
+  }
+  int available() { return len - pos; }
+  int read() { return pos < len ? data[pos++] : -1; }
+  bool overflow() { return false; }
+
+private:
+  const uint8_t *data;
+  size_t len;
+  size_t pos;
+};
+
+/**
+ * The transport behind the BitBus singleton: a SoftwareSerial on pins 2 and
+ * 3 unless begin() is handed some other Stream. begin(BITBUS_AUTO_BAUD)
+ * finds the rate of the module.
+ */
+#if BITBUS_SOFTWARE_SERIAL
+class BitBusDefaultTransport
+{
+public:
+  void begin(unsigned long baudRate=9600, int rx=2, int tx=3) {
+    softwareSerial.begin(baudRate, rx, tx);
+  }
+
+  // Use a transport the sketch has already started
+  void begin(Stream &stream) {
+    softwareSerial.end();
+    other.begin(stream);
+  }
+
+  int available() {
+    return softwareSerial.isStarted() ? softwareSerial.available() : other.available();
+  }
+  int read() {
+    return softwareSerial.isStarted() ? softwareSerial.read() : other.read();
+  }
+  bool overflow() {
+    return softwareSerial.isStarted() ? softwareSerial.overflow() : other.overflow();
+  }
+
+#if BITBUS_BAUD_DETECT
+  // Returns: the rate given to begin() or found, 0 while it is being found or for another Stream
+  unsigned long getBaudRate() const { return softwareSerial.isStarted() ? softwareSerial.getBaudRate() : 0; }
+  bool _detectingBaud() const { return softwareSerial._detectingBaud(); }
+  void _detectBaud(const uint8_t *buf, size_t len) { softwareSerial._detectBaud(buf, len); }
+#endif
+
+private:
+  BitBusSoftwareSerialTransport softwareSerial;
+  BitBusStreamTransport<Stream> other;
+};
+
+#if BITBUS_BAUD_DETECT
+inline bool _bitBusDetectingBaud(BitBusDefaultTransport &transport) { return transport._detectingBaud(); }
+inline void _bitBusDetectBaud(BitBusDefaultTransport &transport, const uint8_t *buf, size_t len) {
+  transport._detectBaud(buf, len);
+}
+#endif
+#else
+class BitBusDefaultTransport : public BitBusStreamTransport<Stream>
+{
+};
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * BitBusUart: Interrupt driven hardware serial transport for the BitBus App.
+ */
+// The USART registers are AVR only. BITBUS_HOST is the native Linux build in extras/host.
+#if defined(__AVR__) || defined(BITBUS_HOST)
+#include "BitBusUart.h"
+#include "GamePad.h"
+
+BitBusUart::BitBusUart(volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
+                       volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
+                       volatile uint8_t *ucsrc, volatile uint8_t *udr)
+  : ubrrh(ubrrh), ubrrl(ubrrl), ucsra(ucsra), ucsrb(ucsrb), ucsrc(ucsrc), udr(udr)
+{
+  overflowCount = 0;
+  overflowed = false;
+}
+
+/**
+ * Baud rate calculation is the same as the Arduino core HardwareSerial so
+ * the two agree on which rates are reachable.
+ */
+void BitBusUart::begin(unsigned long baudRate)
+{
+  // Stop the interrupt handler before touching the buffer
+  end();
+
+  uint16_t baudSetting = (F_CPU / 4 / baudRate - 1) / 2;
+  *ucsra = _BV(U2X0);
+  // NB: 57600 at 16MHz is a special case in the core for old bootloaders
+  if (((F_CPU == 16000000UL) && (baudRate == 57600)) || (baudSetting > 4095)) {
+    *ucsra = 0;
+    baudSetting = (F_CPU / 8 / baudRate - 1) / 2;
+  }
+  *ubrrh = baudSetting >> 8;
+  *ubrrl = baudSetting;
+
+  *ucsrc = _BV(UCSZ01) | _BV(UCSZ00);
+  *ucsrb = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+void BitBusUart::end()
+{
+  *ucsrb &= ~(_BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0));
+  rxQueue.clear();
+  overflowCount = 0;
+  overflowed = false;
+}
+
+int BitBusUart::peek()
+{
+  uint8_t c;
+  if (!rxQueue.peek(&c)) {
+    return -1;
+  }
+  return c;
+}
+
+/**
+ * Transmit is rare (the App doesn't expect replies), so it just waits for
+ * the data register rather than buffering.
+ */
+size_t BitBusUart::write(uint8_t c)
+{
+  while (!(*ucsra & _BV(UDRE0))) {
+  }
+  *udr = c;
+  return 1;
+}
+
+// Count a received byte lost, from the interrupt handler
+void BitBusUart::lost()
+{
+  if (overflowCount < 255) {
+    overflowCount++;
+  }
+  // Unlike the count this never saturates, so overflow() keeps reporting
+  overflowed = true;
+}
+
+void BitBusUart::_rxCompleteIrq()
+{
+  // Status has to be read before the data register
+  bool overrun = *ucsra & _BV(DOR0);
+  uint8_t c = *udr;
+
+  if (overrun) {
+    lost();
+  }
+  if (!rxQueue.push(c)) {
+    lost();
+  }
+}
+
+#if BITBUS_PARSE_IN_ISR
+/**
+ * The receive queue is left out: the byte goes straight to the parser, and
+ * an overrun makes the GamePad drop the message it broke.
+ */
+void BitBusUart::_rxParseIrq(GamePadModule &pad)
+{
+  bool overrun = *ucsra & _BV(DOR0);
+  uint8_t c = *udr;
+
+  if (overrun) {
+    lost();
+  }
+  pad._processInputIsr(c, overrun);
+}
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+/**
+ * BitBusUart: Interrupt driven hardware serial transport for the BitBus App.
+ *
+ * SoftwareSerial keeps interrupts off for about 1 ms for every byte it
+ * receives at 9600 baud, which upsets Servo PWM and encoder timing. BitBusUart
+ * receives with the USART RX complete interrupt instead. The interrupt
+ * handler only moves the byte into a ring buffer, so higher baud rates work
+ * too. Bytes that arrive while the buffer is full are counted, not silently
+ * lost.
+ *
+ * The Arduino core defines the interrupt handler for Serial, so the handler
+ * for BitBusUart is only defined when the sketch asks for it with BITBUS_UART().
+ * Don't use Serial on the same USART.
+ *
+ *   #include <BitBus.h>
+ *   #include <BitBusUart.h>
+ *
+ *   BITBUS_UART(bbUart, 0)    // USART0, pins 0 and 1 on an Uno or Nano
+ *
+ *   void setup() {
+ *     bbUart.begin(115200);
+ *     BitBus.begin(bbUart);
+ *   }
+ *
+ * With BITBUS_PARSE_IN_ISR set, BITBUS_UART_PARSER() goes a step further
+ * and parses each byte in the interrupt handler, straight into a GamePad.
+ * Nothing needs calling from loop() and a message takes effect as soon as
+ * its last byte arrives. Read the state with readState(), which gives a
+ * consistent copy of it without turning interrupts off:
+ *
+ *   BITBUS_UART_PARSER(bbUart, 0, GamePad)
+ *
+ *   void setup() {
+ *     bbUart.begin(115200);
+ *   }
+ *
+ *   void loop() {
+ *     GamePadState state;
+ *     GamePad.readState(&state);
+ *     ...
+ *   }
+ *
+ * Callbacks registered with the GamePad are then called from the interrupt
+ * handler, so keep them short. readEvent() works as usual.
+ */
+#ifndef BitBusUart_h
+#define BitBusUart_h
+
+#include "Arduino.h"
+#include "Stream.h"
+#include "BitBusConfig.h"
+#include "SpscQueue.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+class GamePadModule;
+
+class BitBusUart : public Stream
+{
+public:
+  BitBusUart(volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
+             volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
+             volatile uint8_t *ucsrc, volatile uint8_t *udr);
+
+  // Start receiving with 8 data bits, no parity and 1 stop bit
+  void begin(unsigned long baudRate);
+  void end();
+
+  // Inline so BitBusStreamTransport<BitBusUart> needs no calls at all
+  virtual int available() { return rxQueue.count(); }
+  virtual int read() {
+    uint8_t c;
+    return rxQueue.pop(&c) ? c : -1;
+  }
+  virtual int peek();
+  virtual size_t write(uint8_t c);
+  using Print::write;
+
+  operator bool() { return true; }
+
+  /**
+   * Returns: number of received bytes lost because the buffer was full or
+   * the USART overran. Saturates at 255.
+   */
+  uint8_t getOverflowCount() { return overflowCount; }
+  // Returns: true if bytes were lost since the last call, like SoftwareSerial::overflow()
+  bool overflow() {
+    if (!overflowed) {
+      return false;
+    }
+    // A loss the interrupt handler adds now is reported by this call too
+    overflowed = false;
+    return true;
+  }
+
+  // Called from the RX complete interrupt handler defined by BITBUS_UART()
+  void _rxCompleteIrq();
+#if BITBUS_PARSE_IN_ISR
+  // Called from the RX complete interrupt handler defined by BITBUS_UART_PARSER()
+  void _rxParseIrq(GamePadModule &pad);
+#endif
+
+private:
+  volatile uint8_t * const ubrrh;
+  volatile uint8_t * const ubrrl;
+  volatile uint8_t * const ucsra;
+  volatile uint8_t * const ucsrb;
+  volatile uint8_t * const ucsrc;
+  volatile uint8_t * const udr;
+
+  _SpscQueue<uint8_t, BITBUS_UART_RX_BUFFER_SIZE> rxQueue;
+  void lost();
+
+  volatile uint8_t overflowCount;  // Written by the interrupt handler only
+  volatile bool overflowed;        // Set by the interrupt handler, cleared by overflow()
+};
+
+inline bool _bitBusOverflow(BitBusUart &uart) { return uart.overflow(); }
+
+// The ATmega328P has a single USART with unnumbered interrupt vectors
+#if defined(USART_RX_vect)
+#define _BITBUS_USART0_RX_vect USART_RX_vect
+#else
+#define _BITBUS_USART0_RX_vect USART0_RX_vect
+#endif
+#define _BITBUS_USART1_RX_vect USART1_RX_vect
+#define _BITBUS_USART2_RX_vect USART2_RX_vect
+#define _BITBUS_USART3_RX_vect USART3_RX_vect
+
+/**
+ * Define a BitBusUart named name on USART number n (0-3), along with its
+ * RX complete interrupt handler. Use once, at file scope in the sketch.
+ */
+#define BITBUS_UART(name, n)                                            \
+  BitBusUart name(&UBRR##n##H, &UBRR##n##L, &UCSR##n##A, &UCSR##n##B, \
+                  &UCSR##n##C, &UDR##n);                                \
+  ISR(_BITBUS_USART##n##_RX_vect) { name._rxCompleteIrq(); }
+
+#if BITBUS_PARSE_IN_ISR
+/**
+ * Define a BitBusUart named name on USART number n (0-3) whose RX complete
+ * interrupt handler parses each byte into the GamePadModule pad. Use once,
+ * at file scope in the sketch, instead of BITBUS_UART().
+ */
+#define BITBUS_UART_PARSER(name, n, pad)                                \
+  BitBusUart name(&UBRR##n##H, &UBRR##n##L, &UCSR##n##A, &UCSR##n##B, \
+                  &UCSR##n##C, &UDR##n);                                \
+  ISR(_BITBUS_USART##n##_RX_vect) { name._rxParseIrq(pad); }
+#endif
+
+#endif
@@ -3,10 +3,10 @@
 
 int assertionFailures = 0;
 
-static int _assert(bool assertionValue, PGM_P errorMsg) {
+static int _assert(bool assertionValue, PGM_P errorMsg, Print &out) {
   if (!assertionValue) {
-    SerialPrint_P(PSTR("ASSERTION FAILED: "));
-    SerialPrint_P(errorMsg);
+    SerialPrint_P(PSTR("ASSERTION FAILED: "), out);
+    SerialPrint_P(errorMsg, out);
     assertionFailures++;
     return -1;
   }
@@ -18,10 +18,10 @@ static int _assert(bool assertionValue, PGM_P errorMsg) {
  *
  * Returns: 0 on success, non zero if assertion fails
  */
-int Assert(bool assertionValue, PGM_P errorMsg) {
-  int result = _assert(assertionValue, errorMsg);
+int Assert(bool assertionValue, PGM_P errorMsg, Print &out) {
+  int result = _assert(assertionValue, errorMsg, out);
   if (result) {
-    Serial.println();
+    out.println();
   }
   return result;
 }
@@ -31,11 +31,11 @@ int Assert(bool assertionValue, PGM_P errorMsg) {
  *
  * Returns: 0 on success, non zero if assertion fails
  */
-int Assert(bool assertionValue, PGM_P errorMsg, int value) {
-  int result = _assert(assertionValue, errorMsg);
+int Assert(bool assertionValue, PGM_P errorMsg, int value, Print &out) {
+  int result = _assert(assertionValue, errorMsg, out);
   if (result) {
-    SerialPrint_P(PSTR(" Assertion Value: "));
-    Serial.println(value);
+    SerialPrint_P(PSTR(" Assertion Value: "), out);
+    out.println(value);
   }
   return result;
 }
@@ -45,18 +45,149 @@ int Assert(bool assertionValue, PGM_P errorMsg, int value) {
  * %Print a string in flash memory to the serial port.
  *
  * \param[in] str Pointer to string stored in flash memory.
+ * \param[in] out Where to print it.
  */
-void SerialPrint_P(PGM_P str) {
+void SerialPrint_P(PGM_P str, Print &out) {
   for (uint8_t c; (c = pgm_read_byte(str)); str++)
-    Serial.write(c);
+    out.write(c);
 }
 //------------------------------------------------------------------------------
 /**
  * %Print a string in flash memory followed by a CR/LF.
  *
  * \param[in] str Pointer to string stored in flash memory.
+ * \param[in] out Where to print it.
  */
-void SerialPrintln_P(PGM_P str) {
-  SerialPrint_P(str);
-  Serial.println();
+void SerialPrintln_P(PGM_P str, Print &out) {
+  SerialPrint_P(str, out);
+  out.println();
+}
+
+//------------------------------------------------------------------------------
+volatile uint16_t _benchOverflows;
+static BenchRegion benchRegions[BITBUS_BENCH_REGIONS];
+// Cycles BenchStart() and BenchStop() add to a region
+static uint16_t benchOverhead;
+
+static void benchCalibrate() {
+  benchOverhead = 0;
+  BenchClear();
+  for (uint8_t i = 0; i < 8; i++) {
+    BenchStart(0);
+    BenchStop(0, NULL);
+  }
+  benchOverhead = benchRegions[0].min;
+  BenchClear();
+}
+
+#if defined(__AVR__)
+static uint8_t savedTCCR1A;
+static uint8_t savedTCCR1B;
+static uint8_t savedTIMSK1;
+
+void BenchBegin() {
+  uint8_t sreg = SREG;
+  cli();
+  savedTCCR1A = TCCR1A;
+  savedTCCR1B = TCCR1B;
+  savedTIMSK1 = TIMSK1;
+  // Normal mode, no prescaler
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+  TIMSK1 = _BV(TOIE1);
+  _benchOverflows = 0;
+  SREG = sreg;
+  benchCalibrate();
+}
+
+void BenchEnd() {
+  uint8_t sreg = SREG;
+  cli();
+  TIMSK1 = savedTIMSK1;
+  TCCR1A = savedTCCR1A;
+  TCCR1B = savedTCCR1B;
+  SREG = sreg;
+}
+
+uint32_t BenchCycles() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t count = TCNT1;
+  uint16_t overflows = _benchOverflows;
+  // The timer overflowed but the interrupt hasn't run yet, as in micros()
+  if ((TIFR1 & _BV(TOV1)) && count < 0x8000) {
+    overflows++;
+  }
+  SREG = sreg;
+  return (uint32_t)overflows << 16 | count;
+}
+#else
+static unsigned long benchStartMicros;
+
+void BenchBegin() {
+  benchStartMicros = micros();
+  benchCalibrate();
+}
+
+void BenchEnd() {
+}
+
+uint32_t BenchCycles() {
+  return (micros() - benchStartMicros) * (F_CPU / 1000000UL);
+}
+#endif
+
+void BenchStart(uint8_t region) {
+  if (region < BITBUS_BENCH_REGIONS) {
+    // Read the time last, so less of this call is counted
+    benchRegions[region].start = BenchCycles();
+  }
+}
+
+void BenchStop(uint8_t region, PGM_P label) {
+  uint32_t now = BenchCycles();
+  if (region >= BITBUS_BENCH_REGIONS || 0xFFFF == benchRegions[region].count) {
+    return;
+  }
+  BenchRegion &r = benchRegions[region];
+  uint32_t cycles = now - r.start;
+  cycles = cycles > benchOverhead ? cycles - benchOverhead : 0;
+  r.label = label;
+  if (0 == r.count || cycles < r.min) {
+    r.min = cycles;
+  }
+  if (cycles > r.max) {
+    r.max = cycles;
+  }
+  r.total += cycles;
+  r.count++;
+}
+
+const BenchRegion &BenchGetRegion(uint8_t region) {
+  return benchRegions[region < BITBUS_BENCH_REGIONS ? region : 0];
+}
+
+void BenchClear() {
+  memset(benchRegions, 0, sizeof(benchRegions));
+}
+
+void BenchReport(Print &out) {
+  SerialPrintln_P(PSTR("region: count min/avg/max cycles"), out);
+  for (uint8_t i = 0; i < BITBUS_BENCH_REGIONS; i++) {
+    const BenchRegion &r = benchRegions[i];
+    if (!r.count) {
+      continue;
+    }
+    SerialPrint_P(r.label, out);
+    SerialPrint_P(PSTR(": "), out);
+    out.print(r.count);
+    out.print(' ');
+    out.print(r.min);
+    out.print('/');
+    out.print(r.total / r.count);
+    out.print('/');
+    out.println(r.max);
+  }
 }
@@ -1,6 +1,13 @@
 #ifndef BitBusUtil_h
 #define BitBusUtil_h
-#include <avr/pgmspace.h>
+#include "BitBusPlatform.h"
+
+/*
+ * Output goes to Serial unless another Print is passed. The library's own
+ * code always passes one: a reference to Serial from any library object
+ * links in the core's USART0 interrupt handler, which clashes with
+ * BITBUS_UART(name, 0). The defaults are only evaluated in the sketch.
+ */
 
 /** Compare values For unit testing */
 #define ASSERT(p1, p2)      Assert((p1), PSTR(p2))
@@ -13,12 +20,67 @@
 #define DebugPrintln(x)     SerialPrintln_P(PSTR(x))
 
 
-int Assert(bool assertionValue, PGM_P errorMsg);
-int Assert(bool assertionValue, PGM_P errorMsg, int value);
+int Assert(bool assertionValue, PGM_P errorMsg, Print &out = Serial);
+int Assert(bool assertionValue, PGM_P errorMsg, int value, Print &out = Serial);
 
-void SerialPrint_P(PGM_P str);
-void SerialPrintln_P(PGM_P str);
+void SerialPrint_P(PGM_P str, Print &out = Serial);
+void SerialPrintln_P(PGM_P str, Print &out = Serial);
 
 // TODO(ericzundel): ugly extern, wrap into Assertion class?
 extern int assertionFailures;
+
+/**
+ * Time regions of code in CPU cycles, e.g.:
+ *
+ *   BITBUS_BENCH_TIMER()     // Once, at file scope in the sketch
+ *
+ *   BenchBegin();
+ *   for (uint8_t i = 0; i < len; i++) {
+ *     BENCH_START(0);
+ *     mb.processInput(buf[i]);
+ *     BENCH_STOP(0, "mb.processInput(char)");
+ *   }
+ *   BenchReport();
+ *
+ * On AVR the cycles are counted by Timer 1 running at the CPU clock, with
+ * the overflows counted by the interrupt handler BITBUS_BENCH_TIMER()
+ * defines. This takes Timer 1 from analogWrite() on pins 9 and 10 and from
+ * the Servo library until BenchEnd(). Elsewhere the cycles are worked out
+ * from micros(), which is too coarse for a region this short: those numbers
+ * are placeholders, mostly 0. The cost of timing an empty region is taken
+ * off each result.
+ */
+#define BENCH_START(region)       BenchStart(region)
+#define BENCH_STOP(region, label) BenchStop((region), PSTR(label))
+
+#if defined(__AVR__)
+#define BITBUS_BENCH_TIMER() ISR(TIMER1_OVF_vect) { _benchOverflows++; }
+#else
+#define BITBUS_BENCH_TIMER()
+#endif
+
+struct BenchRegion {
+  PGM_P label;      // In flash, from BENCH_STOP()
+  uint32_t start;   // BenchCycles() at BENCH_START()
+  uint32_t total;
+  uint32_t min;
+  uint32_t max;
+  uint16_t count;   // Stops at 65535, later timings are left out
+};
+
+// Start the timer and clear the regions
+void BenchBegin();
+// Give Timer 1 back to the Arduino core
+void BenchEnd();
+// Returns: the CPU cycles since BenchBegin()
+uint32_t BenchCycles();
+void BenchStart(uint8_t region);
+void BenchStop(uint8_t region, PGM_P label);
+// Returns: what has been timed in region
+const BenchRegion &BenchGetRegion(uint8_t region);
+void BenchClear();
+// Print the count and the min, average and max cycles of each region timed
+void BenchReport(Print &out = Serial);
+
+extern volatile uint16_t _benchOverflows;
 #endif // WaveUtil_h
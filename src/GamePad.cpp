@@ -2,6 +2,10 @@
  * GamePadModule: Implements parsing of message from the BitBus Controller in Analog Mode
  */
 #include "BitBus.h"
+#include "BitBusConfig.h"
+#include "BitBusPlatform.h"
+#include "BitBusStats.h"
+#include "BitBusTrace.h"
 #include "BitBusUtil.h"
 #include "GamePad.h"
 #include "MessageBuffer.h"
@@ -9,17 +13,15 @@
 #include "Arduino.h"
 #include "SoftwareSerial.h"
 
-#define DEBUG 0
-
 // Action Button Bit Reference
 // For member action_button_value
-#define START_BIT 0
-#define SELECT_BIT 1
+#define START_BIT GP_BUTTON_START
+#define SELECT_BIT GP_BUTTON_SELECT
 
-#define BUTTON_A_BIT 2
-#define BUTTON_B_BIT 3
-#define BUTTON_X_BIT 4
-#define BUTTON_Y_BIT 5
+#define BUTTON_A_BIT GP_BUTTON_A
+#define BUTTON_B_BIT GP_BUTTON_B
+#define BUTTON_X_BIT GP_BUTTON_X
+#define BUTTON_Y_BIT GP_BUTTON_Y
 
 // For compatibility with Dabble
 #define TRIANGLE_BIT BUTTON_B_BIT
@@ -27,74 +29,255 @@
 #define CROSS_BIT BUTTON_X_BIT
 #define SQUARE_BIT BUTTON_A_BIT
 
+#if BITBUS_STATS
+static_assert(MT_ANALOG_POSITION + 1 == BITBUS_STATS_MESSAGE_TYPES, "BitBusStats.frames is indexed by _MESSAGE_TYPE");
+static_assert(GP_ERROR_UNEXPECTED_DEC_DIGIT + 1 - BITBUS_STATS_ERROR_FIRST == BITBUS_STATS_ERRORS,
+              "BitBusStats.errors is indexed by GAMEPAD_ERROR");
+#endif
+
 #define UP_BIT 0
 #define DOWN_BIT 1
 #define LEFT_BIT 2
 #define RIGHT_BIT 3
 
 
-/**
- * Defines one entry in the state table.
+/*
+ * Parser tables, generated from the grammar in MessageBuffer.h
+ *
+ * Each input character costs two flash reads:
+ *
+ *   charTable[inputChar] -> character class and digit value
+ *   transitionTable[inputState][character class] -> next state and action
  *
- * The enum values are stored as uint8_t to save space in the table
- * and free up some RAM.
+ * plus one of messageTypeTable or stateFieldTable for the character that
+ * starts a message or finishes a field. No flags, no function pointers.
  *
+ * The tables are filled in by the constexpr functions below when the
+ * library is compiled, so they can't get out of step with the grammar or
+ * with each other. testParserTables() in GamePadUnitTest checks them, and
+ * extras/host/parser_test compares them with the hand written table they
+ * replaced.
  */
-struct state_entry {
-  uint8_t currentState;  // enum _INPUT_STATE: Must match current state
-  uint8_t inputChar;     // Must match current input character. Special values are DIGIT regex ([0-9][A-F]) and ANY_CHAR regex (.)
-  int (_MessageBuffer::*state_func)(int, enum _INPUT_STATE *); // Optional function to call to process this state
-  uint8_t nextState;     // enum _INPUT_STATE: Next state transition
-  uint8_t messageType;   // enum _MESSAGE_TYPE: If anything other than MT_UNKNOWN, sets the message type
-};
+static_assert(ANALOG_DEC_DIGITS == ANALOG_HEX_DIGITS + 1,
+              "The parser tells hex from decimal at the digit after the hex digits");
+static_assert(sizeof(MESSAGE_FIELD_LETTERS) - 1 == ANALOG_FIELDS, "One letter per analog field");
+static_assert(sizeof(MESSAGE_BUTTON_LETTERS) - 1 == MT_BUTTON_Y, "One letter per action button message type");
+
+// Returns: the position of c in str, or -1
+static constexpr int8_t _indexOf(const char *str, char c, int8_t i = 0) {
+  return !str[i] ? -1 : str[i] == c ? i : _indexOf(str, c, i + 1);
+}
 
-// Sentinel values to represent multiple characters
-#define ANY_CHAR (uint8_t)0xFF
-#define DIGIT    (uint8_t)0xFE
-
-// State Table stored in flash memory
-// NB(ericzundel): You must copy an entry out with memcpy_P() to a local buffer
-const struct state_entry stateTable[] PROGMEM = {
-  {IS_START,                      'S',      NULL,                             IS_MESSAGE_READY,              MT_START_BUTTON},
-  {IS_START,                      'C',      NULL,                             IS_MESSAGE_READY,              MT_SELECT},
-  {IS_START,                      'A',      NULL,                             IS_MESSAGE_READY,              MT_BUTTON_A},
-  {IS_START,                      'B',      NULL,                             IS_MESSAGE_READY,              MT_BUTTON_B},
-  {IS_START,                      'X',      NULL,                             IS_MESSAGE_READY,              MT_BUTTON_X},
-  {IS_START,                      'Y',      NULL,                             IS_MESSAGE_READY,              MT_BUTTON_Y},
-  {IS_START,                      'L',      NULL,                             IS_WAITING_FOR_L_DIGIT_1,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_R,              'R',      NULL,                             IS_WAITING_FOR_R_DIGIT_1,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_B,              'B',      NULL,                             IS_WAITING_FOR_B_DIGIT_1,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_F,              'F',      NULL,                             IS_WAITING_FOR_F_DIGIT_1,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_L_DIGIT_1,      DIGIT,    &_MessageBuffer::parseDigit1,     IS_WAITING_FOR_L_DIGIT_2,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_L_DIGIT_2,      DIGIT,    &_MessageBuffer::parseDigit2,     IS_WAITING_FOR_L_DIGIT_3_OR_R, MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_L_DIGIT_3_OR_R, 'R',      &_MessageBuffer::parseLHexDigits, IS_WAITING_FOR_R_DIGIT_1,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_L_DIGIT_3_OR_R, DIGIT,    &_MessageBuffer::parseLDecDigits, IS_WAITING_FOR_R,              MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_R_DIGIT_1,      DIGIT,    &_MessageBuffer::parseDigit1,     IS_WAITING_FOR_R_DIGIT_2,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_R_DIGIT_2,      DIGIT,    &_MessageBuffer::parseDigit2,     IS_WAITING_FOR_R_DIGIT_3_OR_F, MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_R_DIGIT_3_OR_F, 'F',      &_MessageBuffer::parseRDigits,    IS_WAITING_FOR_F_DIGIT_1,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_R_DIGIT_3_OR_F, DIGIT,    &_MessageBuffer::parseRDigits,    IS_WAITING_FOR_F,              MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_F_DIGIT_1,      DIGIT,    &_MessageBuffer::parseDigit1,     IS_WAITING_FOR_F_DIGIT_2,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_F_DIGIT_2,      DIGIT,    &_MessageBuffer::parseDigit2,     IS_WAITING_FOR_F_DIGIT_3_OR_B, MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_F_DIGIT_3_OR_B, 'B',      &_MessageBuffer::parseFDigits,    IS_WAITING_FOR_B_DIGIT_1,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_F_DIGIT_3_OR_B, DIGIT,    &_MessageBuffer::parseFDigits,    IS_WAITING_FOR_B,              MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_B_DIGIT_1,      DIGIT,    &_MessageBuffer::parseDigit1,     IS_WAITING_FOR_B_DIGIT_2,      MT_ANALOG_POSITION},
-  /*
-   * NB(ericzundel) ParseDigit2B is different. It modifies the next state to be IS_MESSAGE_READY if in hex mode.
-   * We could eliminate this snowflake by adding more states.
-   */
-  {IS_WAITING_FOR_B_DIGIT_2,      DIGIT,    &_MessageBuffer::parseDigit2B, IS_WAITING_FOR_B_DIGIT_3,      MT_ANALOG_POSITION},
-  {IS_WAITING_FOR_B_DIGIT_3,      DIGIT,    &_MessageBuffer::parseBDigits, IS_MESSAGE_READY,              MT_ANALOG_POSITION},
+static constexpr bool _inString(const char *str, char c) {
+  return _indexOf(str, c) >= 0;
+}
+
+static constexpr bool _isMessageLetter(char c) {
+  return c >= 'A' && c <= 'Z' && (_inString(MESSAGE_BUTTON_LETTERS, c) || _inString(MESSAGE_FIELD_LETTERS, c));
+}
+
+// Returns: the number of different message letters that come before c in the alphabet
+static constexpr uint8_t _messageLettersBefore(char c) {
+  return c <= 'A' ? 0 : _messageLettersBefore(c - 1) + _isMessageLetter(c - 1);
+}
+
+/*
+ * Character classes. Each message letter gets its own class, in
+ * alphabetical order, so the classes of the hex digits run from CC_DEC to
+ * CC_LAST_HEX. Hex letters that aren't message letters share CC_HEX.
+ */
+#define CC_OTHER 0
+#define CC_DEC   1
+#define CC_HEX   2
+#define CC_LAST_HEX (CC_HEX + _messageLettersBefore('F' + 1))
+#define CC_COUNT    (CC_HEX + 1 + _messageLettersBefore('Z' + 1))
+
+static constexpr uint8_t _letterClass(char c) {
+  return CC_HEX + 1 + _messageLettersBefore(c);
+}
+
+static_assert(CC_COUNT <= 16, "The character class has to fit in 4 bits");
+
+/*
+ * Each charTable entry packs the character class in the high nybble and,
+ * for hex digits, the value of the digit in the low nybble. That lets the
+ * parser and the analog fast path validate and convert a digit with a
+ * single read.
+ */
+#define CHAR_ENTRY(charClass, nybble) (uint8_t)(((charClass) << 4) | (nybble))
+#define CHAR_CLASS(entry)  ((uint8_t)(entry) >> 4)
+#define CHAR_NYBBLE(entry) ((uint8_t)(entry) & 0x0F)
+#define CHAR_IS_HEX(entry) ((uint8_t)(CHAR_CLASS(entry) - CC_DEC) <= (CC_LAST_HEX - CC_DEC))
+#define CHAR_IS_DEC(entry) (CHAR_CLASS(entry) == CC_DEC)
+
+static constexpr uint8_t _charEntryFor(unsigned c) {
+  return (c >= '0' && c <= '9') ? CHAR_ENTRY(CC_DEC, c - '0')
+    : _isMessageLetter(c) ? CHAR_ENTRY(_letterClass(c), c <= 'F' ? c - 'A' + 10 : 0)
+    : (c >= 'A' && c <= 'F') ? CHAR_ENTRY(CC_HEX, c - 'A' + 10)
+    : CHAR_ENTRY(CC_OTHER, 0);
+}
+
+static constexpr uint8_t _fieldClass(uint8_t field) {
+  return _letterClass(MESSAGE_FIELD_LETTERS[field]);
+}
+
+// Returns: the message letter in class charClass, 0 if there is none
+static constexpr char _classLetter(uint8_t charClass, char c = 'A') {
+  return c > 'Z' ? 0 : (_isMessageLetter(c) && _letterClass(c) == charClass) ? c : _classLetter(charClass, c + 1);
+}
+
+static constexpr bool _isHexClass(uint8_t charClass) {
+  return charClass >= CC_DEC && charClass <= CC_LAST_HEX;
+}
+
+static constexpr bool _isHexLetterClass(uint8_t charClass) {
+  return charClass >= CC_HEX && charClass <= CC_LAST_HEX;
+}
+
+// What a transition does with the character, see TRANSITION_ACTION()
+#define PA_NONE      0  // A letter, nothing to store
+#define PA_DIGIT     1  // Add the digit to hexDigits and decDigits
+#define PA_HEX_STORE 2  // PA_DIGIT, then store hexDigits in the field
+#define PA_DEC_STORE 3  // PA_DIGIT, then store decDigits in the field
+
+static_assert(IS_ERROR < 0x40, "The state has to fit in 6 bits");
+static_assert(GP_ERROR_UNEXPECTED_DEC_DIGIT - GP_ERROR_NO_STATE_ENTRY < 4, "The error has to fit in 2 bits");
+
+static constexpr uint8_t _go(uint8_t state, uint8_t action) {
+  return state | (action << 6);
+}
+
+static constexpr uint8_t _fail(uint8_t error) {
+  return _go(IS_ERROR, error - GP_ERROR_NO_STATE_ENTRY);
+}
+
+static constexpr uint8_t _hexFieldDone(uint8_t field) {
+  return field == ANALOG_FIELDS - 1 ? IS_MESSAGE_READY : _hexLetterState(field + 1);
+}
+
+static constexpr uint8_t _decFieldDone(uint8_t field) {
+  return field == ANALOG_FIELDS - 1 ? IS_MESSAGE_READY : _decLetterState(field + 1);
+}
+
+static constexpr uint8_t _startTransition(uint8_t charClass) {
+  return _inString(MESSAGE_BUTTON_LETTERS, _classLetter(charClass)) ? _go(IS_MESSAGE_READY, PA_NONE)
+    : charClass == _fieldClass(0) ? _go(_firstFieldState(1, false), PA_NONE)
+    : _fail(GP_ERROR_NO_STATE_ENTRY);
+}
+
+// First field, waiting for digit p. Neither base is ruled out until a hex letter turns up.
+static constexpr uint8_t _firstFieldTransition(uint8_t p, bool hexSeen, uint8_t charClass) {
+  return p <= ANALOG_HEX_DIGITS
+    // Store the hex value as soon as there is one, a decimal digit overwrites it
+    ? (_isHexClass(charClass)
+         ? _go(_firstFieldState(p + 1, hexSeen || CC_DEC != charClass),
+               p == ANALOG_HEX_DIGITS ? PA_HEX_STORE : PA_DIGIT)
+       : _fail(GP_ERROR_NO_STATE_ENTRY))
+    // The hex digits are done: the next field's letter means hex, another digit decimal
+    : charClass == _fieldClass(1) ? _go(_hexDigitState(1, 1), PA_NONE)
+    : (charClass == CC_DEC && !hexSeen) ? _go(_decFieldDone(0), PA_DEC_STORE)
+    : _isHexClass(charClass) ? _fail(GP_ERROR_INVALID_DEC_DIGIT)
+    : _fail(GP_ERROR_NO_STATE_ENTRY);
+}
+
+// Hex message, field i, step r: waiting for digit r + 1, or for the next letter when r is ANALOG_HEX_DIGITS
+static constexpr uint8_t _hexTransition(uint8_t i, uint8_t r, uint8_t charClass) {
+  return r < ANALOG_HEX_DIGITS
+    ? (_isHexClass(charClass)
+         ? _go(r + 1 < ANALOG_HEX_DIGITS ? _hexDigitState(i, r + 2) : _hexFieldDone(i),
+               r + 1 < ANALOG_HEX_DIGITS ? PA_DIGIT : PA_HEX_STORE)
+       : _fail(GP_ERROR_NO_STATE_ENTRY))
+    : charClass == _fieldClass(i + 1) ? _go(_hexDigitState(i + 1, 1), PA_NONE)
+    : charClass == CC_DEC ? _fail(GP_ERROR_UNEXPECTED_DEC_DIGIT)
+    : _fail(GP_ERROR_NO_STATE_ENTRY);
+}
+
+// Decimal message, field i, step r: waiting for the letter when r is 0, otherwise for digit r
+static constexpr uint8_t _decTransition(uint8_t i, uint8_t r, uint8_t charClass) {
+  return r == 0
+    ? (charClass == _fieldClass(i) ? _go(_decDigitState(i, 1), PA_NONE) : _fail(GP_ERROR_NO_STATE_ENTRY))
+    : charClass == CC_DEC
+      ? _go(r < ANALOG_DEC_DIGITS ? _decDigitState(i, r + 1) : _decFieldDone(i),
+            r < ANALOG_DEC_DIGITS ? PA_DIGIT : PA_DEC_STORE)
+    : _isHexLetterClass(charClass) ? _fail(GP_ERROR_INVALID_DEC_DIGIT)
+    : _fail(GP_ERROR_NO_STATE_ENTRY);
+}
+
+static constexpr uint8_t _transitionFor(uint8_t state, uint8_t charClass) {
+  return state == IS_START ? _startTransition(charClass)
+    : state < _HEX_STATES_START ? _firstFieldTransition(state / 2 + 1, state > 1 && (state & 1), charClass)
+    : state < _DEC_STATES_START
+      ? _hexTransition((state - _HEX_STATES_START) / (ANALOG_HEX_DIGITS + 1) + 1,
+                       (state - _HEX_STATES_START) % (ANALOG_HEX_DIGITS + 1), charClass)
+    : _decTransition((state - _DEC_STATES_START) / (ANALOG_DEC_DIGITS + 1) + 1,
+                     (state - _DEC_STATES_START) % (ANALOG_DEC_DIGITS + 1), charClass);
+}
+
+// Returns: the analog field a state is reading
+static constexpr uint8_t _stateField(uint8_t state) {
+  return state < _HEX_STATES_START ? 0
+    : state < _DEC_STATES_START ? (state - _HEX_STATES_START) / (ANALOG_HEX_DIGITS + 1) + 1
+    : (state - _DEC_STATES_START) / (ANALOG_DEC_DIGITS + 1) + 1;
+}
+
+// Returns: the message type started by a character in charClass
+static constexpr uint8_t _startMessageType(uint8_t charClass) {
+  return _inString(MESSAGE_BUTTON_LETTERS, _classLetter(charClass))
+    ? MT_START_BUTTON + _indexOf(MESSAGE_BUTTON_LETTERS, _classLetter(charClass))
+    : charClass == _fieldClass(0) ? MT_ANALOG_POSITION : MT_UNKNOWN;
+}
+
+/*
+ * Fill a table in flash with Generator(0) ... Generator(N - 1) at compile time:
+ *   _GeneratedTable<Generator, _MakeIndices<N>::type>::data
+ */
+template <unsigned... I> struct _Indices {};
+template <unsigned N, unsigned... I> struct _MakeIndices : _MakeIndices<N - 1, N - 1, I...> {};
+template <unsigned... I> struct _MakeIndices<0, I...> { typedef _Indices<I...> type; };
+
+template <uint8_t (*Generator)(unsigned), class Indices> struct _GeneratedTable;
+template <uint8_t (*Generator)(unsigned), unsigned... I>
+struct _GeneratedTable<Generator, _Indices<I...> > {
+  static constexpr uint8_t data[sizeof...(I)] BITBUS_FLASH = { Generator(I)... };
 };
+template <uint8_t (*Generator)(unsigned), unsigned... I>
+constexpr uint8_t _GeneratedTable<Generator, _Indices<I...> >::data[sizeof...(I)];
+
+static constexpr uint8_t _transitionEntry(unsigned i) {
+  return _transitionFor(i / CC_COUNT, i % CC_COUNT);
+}
+static constexpr uint8_t _stateFieldEntry(unsigned i) {
+  return _stateField(i);
+}
+static constexpr uint8_t _startMessageTypeEntry(unsigned i) {
+  return _startMessageType(i);
+}
+
+// NB(ericzundel): Read the tables with _bitBusFlashByte(), on AVR they are in flash
+#define _GENERATED_TABLE(generator, size) _GeneratedTable<generator, _MakeIndices<size>::type>::data
+
+// Class and digit value of each 7 bit ASCII character. Anything else is CC_OTHER.
+static constexpr const uint8_t (&charTable)[128] = _GENERATED_TABLE(_charEntryFor, 128);
+// Next state and action by state and character class, IS_MESSAGE_READY rows of CC_COUNT
+static constexpr const uint8_t (&transitionTable)[IS_MESSAGE_READY * CC_COUNT] =
+  _GENERATED_TABLE(_transitionEntry, IS_MESSAGE_READY * CC_COUNT);
+// The analog field each state reads
+static constexpr const uint8_t (&stateFieldTable)[IS_MESSAGE_READY] = _GENERATED_TABLE(_stateFieldEntry, IS_MESSAGE_READY);
+// The message type set by the first character of a message
+static constexpr const uint8_t (&messageTypeTable)[CC_COUNT] = _GENERATED_TABLE(_startMessageTypeEntry, CC_COUNT);
 
 
 // Singleton for other libraries to access this module
+#if GAMEPAD_EVENT_QUEUE_SIZE
+static GamePadEventQueue gamePadEvents;
+GamePadModule GamePad(gamePadEvents);
+#else
 GamePadModule GamePad;
-
-// Static data for this module
-static _MessageBuffer message;
+#endif
 
 _MessageBuffer::_MessageBuffer()
 {
+  this->resync = false;
   this->clear();
 }
 
@@ -105,303 +288,507 @@ void _MessageBuffer::clear() {
   messageType = MT_UNKNOWN;
   leftValue = rightValue = upValue = downValue = 0;
   inputState = IS_START;
-  digitBuf[0] = digitBuf[1] = 0;
-  isHex = false;
+  hexDigits = decDigits = 0;
+}
+
+bool _MessageBuffer::_isDecDigit(int inputChar) {
+  return inputChar <= '9' && inputChar >= '0';
+}
+
+bool _MessageBuffer::_isHexDigit(int inputChar) {
+  return _isDecDigit(inputChar) || (inputChar <= 'F' && inputChar >= 'A');
+}
+
+static inline uint8_t _charEntry(unsigned int c) {
+  return (c < sizeof(charTable)) ? _bitBusFlashByte(&charTable[c]) : CHAR_ENTRY(CC_OTHER, 0);
 }
 
 /**
- * Store the first digit in the analog value.
- * Returns: 0 on success, 0xFF on failure
+ * Look up the transition for a state and input character.
+ *
+ * Returns: the transition, see TRANSITION_STATE() and TRANSITION_ACTION().
+ *          IS_ERROR with GP_ERROR_NO_STATE_ENTRY for a state that has no row.
  */
-int _MessageBuffer::parseDigit1(int inputChar, enum _INPUT_STATE *nextStatePtr) {
-#if DEBUG
-  DebugPrintln("In parseDigit1");
-#endif
-  this->digitBuf[0] = inputChar;
-  return 0;
+uint8_t _MessageBuffer::_transition(int inputState, int inputChar) {
+  if ((unsigned int)inputState >= IS_MESSAGE_READY) {
+    return _fail(GP_ERROR_NO_STATE_ENTRY);
+  }
+  return _bitBusFlashByte(&transitionTable[inputState * CC_COUNT + CHAR_CLASS(_charEntry(inputChar))]);
 }
 
+#if BITBUS_TEST_SUPPORT
 /**
- * Store the second digit in the analog value.
- * Returns: 0 on success, 0xFF on failure
+ * For debugging
  */
-
-int _MessageBuffer::parseDigit2(int inputChar, enum _INPUT_STATE *nextStatePtr) {
-#if DEBUG
-  DebugPrintln("In parseDigit2");
-#endif
-  this->digitBuf[1] = inputChar;
+int _MessageBuffer::_printStateTable(Print &out){
+  SerialPrint_P(PSTR("Table Size: "), out);
+  out.print(sizeof(transitionTable) + sizeof(stateFieldTable) + sizeof(messageTypeTable));
+  SerialPrint_P(PSTR(" bytes Character Table Size: "), out);
+  out.print(sizeof(charTable));
+  SerialPrintln_P(PSTR(" bytes"), out);
+  for (unsigned int state = 0; state < IS_MESSAGE_READY; state++) {
+    SerialPrint_P(PSTR("State "), out);
+    out.print(state);
+    SerialPrint_P(PSTR(" Field "), out);
+    out.print(_bitBusFlashByte(&stateFieldTable[state]));
+    SerialPrint_P(PSTR(":"), out);
+    for (unsigned int charClass = 0; charClass < CC_COUNT; charClass++) {
+      uint8_t transition = _bitBusFlashByte(&transitionTable[state * CC_COUNT + charClass]);
+      out.print(' ');
+      out.print(TRANSITION_STATE(transition));
+      out.print('/');
+      out.print(TRANSITION_ACTION(transition));
+    }
+    out.println();
+  }
   return 0;
 }
+#endif
 
 /**
- * Store the second digit in the analog value when parsing the Back (Down) digits.
+ * Process an input character.
  *
- * Since this is the last digit in a hex mode version of the Analog Message,
- * it will force the message ready state to override the decl in the state table.
+ * Data is accumulated until the input state is IS_MESSAGE_READY
  *
- * Returns: 0 on success
+ * In resync mode, a character that breaks a partial message is fed through
+ * again from IS_START if it can start a message, since it is often the start
+ * of the next one. The error is still returned, but the input state reflects
+ * the character, and may even be IS_MESSAGE_READY for a single character
+ * message.
+ *
+ * Returns: 0 when a complete message is received.
+ *          1 when still waiting on a complete message
+ *          any other value is an error
  */
-
-int _MessageBuffer::parseDigit2B(int inputChar, enum _INPUT_STATE *nextStatePtr) {
-#if DEBUG
-  DebugPrintln("In parseDigit2B");
-#endif
-  this->digitBuf[1] = inputChar;
-  if(this->isHex) {
-    // Override the input character to avoid error checking for 3rd decimal digit
-    this->parseBDigits(0xFF, nextStatePtr);
-    *nextStatePtr = IS_MESSAGE_READY;
+int _MessageBuffer::processInput(int inputChar) {
+  bool partial = this->_isPartial();
+  int result = this->_processChar(inputChar);
+  if (result > 1 && this->resync && partial && _canStartMessage(inputChar)) {
+    this->_processChar(inputChar);
   }
-  return 0;
-}
-
-static bool _MessageBuffer::_isDecDigit(int inputChar) {
-  return inputChar <= '9' && inputChar >= '0';
+  return result;
 }
 
-static bool _MessageBuffer::_isHexDigit(int inputChar) {
-  return _isDecDigit(inputChar) || inputChar <= 'F' && inputChar >= 'A';
+/**
+ * Returns: true if part of a message has been received
+ */
+bool _MessageBuffer::_isPartial() {
+  return IS_START != this->inputState && IS_MESSAGE_READY != this->inputState
+    && IS_ERROR != this->inputState;
 }
 
 /**
- * Returns 0-15 on success, 0xFF on failure
+ * Returns: true if inputChar can be the first character of a message
  */
-static uint8_t _MessageBuffer::_asciiToInt(int nybble) {
-  if (nybble <= '9' && nybble >= '0') {
-    return nybble - '0';
-  }
-  if (nybble <= 'F' && nybble >= 'A') {
-    return 10 + nybble - 'A';
+bool _MessageBuffer::_canStartMessage(int inputChar) {
+  return IS_ERROR != TRANSITION_STATE(_transition(IS_START, inputChar));
+}
+
+void _MessageBuffer::_storeField(uint8_t field, uint8_t value) {
+  switch (field) {
+  case 0: this->leftValue = value; break;
+  case 1: this->rightValue = value; break;
+  case 2: this->upValue = value; break;
+  default: this->downValue = value; break;
   }
-  return 0xFF;
 }
 
 /**
- * Parse the digits in the digits[] buffer plus possibly the current character.
- *
- * If in hex mode, assume there are only 2 digits and ignore the input character.
- * If not in hex mode, assume there are 3 digits and use the input character as the ones place.
- *
- * inputChar: current character being processed
- * valuePtr: set to the parsed 2 or 3 digit value on success.
- *
- * Returns: 0 on success, non zero on failure
+ * Run one character through the state machine, see processInput(int).
  */
-int _MessageBuffer::_parseDigits(int inputChar, uint8_t *valuePtr) {
-  if (this->isHex) {
-    if (this->_isDecDigit(inputChar)) {
-#if DEBUG
-      DebugPrintln("ERROR: Unexpected Digit in third place");
-#endif
-      return GP_ERROR_UNEXPECTED_DEC_DIGIT;
+int _MessageBuffer::_processChar(int inputChar) {
+  // Clean up after the last message
+  if (IS_MESSAGE_READY == this->inputState || IS_ERROR == this->inputState) {
+    this->clear();
+  }
+
+  uint8_t entry = _charEntry(inputChar);
+  uint8_t transition = _bitBusFlashByte(&transitionTable[this->inputState * CC_COUNT + CHAR_CLASS(entry)]);
+  uint8_t nextState = TRANSITION_STATE(transition);
+  uint8_t action = TRANSITION_ACTION(transition);
+
+  if (IS_ERROR == nextState) {
+    BITBUS_TRACE_MESSAGE(BT_ERROR, this->inputState, inputChar, transition, GP_ERROR_NO_STATE_ENTRY + action);
+    // This is an error state, reset everything.
+    BITBUS_STATS_ONLY(if (IS_START != this->inputState) _bitBusStatsReset());
+    this->clear();
+    return GP_ERROR_NO_STATE_ENTRY + action;
+  }
+
+  if (IS_START == this->inputState) {
+    this->messageType = (enum _MESSAGE_TYPE)_bitBusFlashByte(&messageTypeTable[CHAR_CLASS(entry)]);
+  } else if (PA_NONE != action) {
+    // Same 8 bit arithmetic as the analog fast path
+    uint8_t digit = CHAR_NYBBLE(entry);
+    this->hexDigits = (uint8_t)(this->hexDigits << 4) | digit;
+    this->decDigits = (uint8_t)(this->decDigits * 10 + digit);
+    if (PA_HEX_STORE == action) {
+      this->_storeField(_bitBusFlashByte(&stateFieldTable[this->inputState]), this->hexDigits);
+    } else if (PA_DEC_STORE == action) {
+      this->_storeField(_bitBusFlashByte(&stateFieldTable[this->inputState]), this->decDigits);
+      this->decDigits = 0;
     }
-    *valuePtr = (uint8_t) (_asciiToInt(this->digitBuf[0]) << 4) + _asciiToInt(this->digitBuf[1]);
+  }
+
+  if (IS_MESSAGE_READY == nextState) {
+    BITBUS_TRACE_MESSAGE(BT_MESSAGE, this->inputState, inputChar, transition, this->messageType);
   } else {
-    uint8_t digit = _asciiToInt(this->digitBuf[0]);
-    if (digit > 9) {
-#if DEBUG
-      DebugPrintln("ERROR: Invalid Decimal in hundreds");
-#endif
-      return GP_ERROR_INVALID_DEC_DIGIT;
-    }
-    *valuePtr = digit * 100;
-    digit = _asciiToInt(this->digitBuf[1]);
-    if (digit > 9) {
-#if DEBUG
-      DebugPrintln("ERROR: Invalid Decimal in tens");
-#endif
-      return GP_ERROR_INVALID_DEC_DIGIT;
-    }
-    *valuePtr = *valuePtr + (digit * 10);
-    digit = _asciiToInt(inputChar);
-    if (digit > 9) {
-#if DEBUG
-      DebugPrintln("ERROR: Invalid Decimal in ones");
-#endif
-      return GP_ERROR_INVALID_DEC_DIGIT;
-    }
-    *valuePtr = *valuePtr + digit;
+    BITBUS_TRACE_CHAR(BT_CHAR, this->inputState, inputChar, transition, 1);
   }
-  return 0;
+  this->inputState = (enum _INPUT_STATE)nextState;
+  return IS_MESSAGE_READY == nextState ? 0 : 1;
 }
 
-int _MessageBuffer::parseLDecDigits(int inputChar, enum _INPUT_STATE *nextStatePtr) {
-#if DEBUG
-  DebugPrintln("In parseLDecDigits");
-#endif
-  // Setting isHex is not necessary, but just to drive the point home we detected decimal mode
-  this->isHex = false;
+/*
+ * Fast path for complete analog messages.
+ *
+ * Nearly all the traffic from the app is analog joystick messages, which
+ * take 12 or 16 trips through the state machine. When a whole message is
+ * already buffered it can be checked and converted in one pass instead.
+ * The decoders accept exactly the messages the state machine would, anything
+ * else is left for the state machine to deal with.
+ */
+#if BITBUS_WORD_AT_A_TIME
 
-  uint8_t value = 0;
-  int result = _parseDigits(inputChar, &value);
-  this->leftValue = value;
-  return result;
-}
+// Repeat a byte value in each byte of a 32 bit word
+#define BYTES(x) ((uint32_t)0x01010101UL * (uint8_t)(x))
 
-int _MessageBuffer::parseLHexDigits(int inputChar, enum _INPUT_STATE *nextStatePtr) {
-#if DEBUG
-  DebugPrintln("In parseLHexDigits");
-#endif
-  this->isHex = true;
-  uint8_t value = 0;
-  int result = _parseDigits(inputChar, &value);
-  this->leftValue = value;
-  return result;
+/*
+ * Sets the high bit of each byte of x that is between m and n (exclusive).
+ * Every byte of x must be less than 0x80.
+ * From "Determine if a word has a byte between m and n", Bit Twiddling Hacks.
+ */
+static inline uint32_t _bytesBetween(uint32_t x, uint8_t m, uint8_t n) {
+  return (BYTES(127 + n) - (x & BYTES(127))) & ~x & ((x & BYTES(127)) + BYTES(127 - m)) & BYTES(128);
 }
 
-int _MessageBuffer::parseRDigits(int inputChar, enum _INPUT_STATE *nextStatePtr) {
-#if DEBUG
-  DebugPrint("In parseRDigits isHex:");
-  Serial.println(this->isHex);
-#endif
-  uint8_t value = 0;
-  int result = _parseDigits(inputChar, &value);
-  this->rightValue = value;
-  return result;
+static inline uint32_t _load32(const uint8_t *buf) {
+  uint32_t word;
+  memcpy(&word, buf, sizeof(word));
+  return word;
 }
 
-int _MessageBuffer::parseFDigits(int inputChar, enum _INPUT_STATE *nextStatePtr) {
-#if DEBUG
-  DebugPrintln("In parseFDigits");
-#endif
-  uint8_t value = 0;
-  int result = _parseDigits(inputChar, &value);
-  this->upValue = value;
-  return result;
-}
+#define DEC_FLAGS(w) _bytesBetween((w), '0' - 1, '9' + 1)
+#define HEX_FLAGS(w) (DEC_FLAGS(w) | _bytesBetween((w), 'A' - 1, 'F' + 1))
+// Value of each hex digit byte: the low nybble, plus 9 for 'A' - 'F'
+#define HEX_NYBBLES(w) (((w) & BYTES(0x0F)) + (((w) >> 6) & BYTES(0x01)) * 9)
 
-int _MessageBuffer::parseBDigits(int inputChar, enum _INPUT_STATE *nextStatePtr) {
-#if DEBUG
-  DebugPrintln("In parseBDigits");
-#endif
-  uint8_t value;
-  int result = _parseDigits(inputChar, &value);
-  this->downValue = value;
-  return result;
+/*
+ * Decode "LhhRhhFhhBhh" into values[]
+ * Returns: true if the message is valid
+ */
+static bool _decodeHexMessage(const uint8_t *buf, uint8_t *values) {
+  // Little endian words: "LhhR" "hhFh" "hBhh"
+  uint32_t w0 = _load32(buf);
+  uint32_t w1 = _load32(buf + 4);
+  uint32_t w2 = _load32(buf + 8);
+
+  if (((w0 | w1 | w2) & BYTES(0x80))
+      || (w0 & 0xFF0000FFUL) != ('L' | (uint32_t)'R' << 24)
+      || (w1 & 0x00FF0000UL) != ((uint32_t)'F' << 16)
+      || (w2 & 0x0000FF00UL) != ((uint32_t)'B' << 8)
+      || (HEX_FLAGS(w0) & 0x00808000UL) != 0x00808000UL
+      || (HEX_FLAGS(w1) & 0x80008080UL) != 0x80008080UL
+      || (HEX_FLAGS(w2) & 0x80800080UL) != 0x80800080UL) {
+    return false;
+  }
+
+  uint32_t n0 = HEX_NYBBLES(w0);
+  uint32_t n1 = HEX_NYBBLES(w1);
+  uint32_t n2 = HEX_NYBBLES(w2);
+  values[0] = ((n0 >> 4) & 0xF0) | ((n0 >> 16) & 0x0F);
+  values[1] = ((n1 << 4) & 0xF0) | ((n1 >> 8) & 0x0F);
+  values[2] = ((n1 >> 20) & 0xF0) | (n2 & 0x0F);
+  values[3] = ((n2 >> 12) & 0xF0) | ((n2 >> 24) & 0x0F);
+  return true;
 }
 
-/**
- * Evaluate this entry in the state table using the optional function and proceed
- * to the next state.
- *
- * Returns: 0 on success, non-zero on failure
- */
-int _MessageBuffer::_processStateEntry(struct state_entry *entry, int inputChar) {
-  enum _INPUT_STATE nextState = entry->nextState;
-  if (entry->state_func) {
-    int result = (this->*entry->state_func)(inputChar, &nextState);
-    if (result) {
-#if DEBUG
-      DebugPrint("ERROR: State Func returned: ");
-      Serial.println(result);
-#endif
-      return result;
+/*
+ * Decode "LdddRdddFdddBddd" into values[]
+ * Returns: true if the message is valid
+ */
+static bool _decodeDecMessage(const uint8_t *buf, uint8_t *values) {
+  static const char letters[] = "LRFB";
+  for (uint8_t field = 0; field < 4; field++, buf += 4) {
+    // Little endian word: "Lddd"
+    uint32_t w = _load32(buf);
+    if ((w & BYTES(0x80))
+        || (w & 0xFF) != (uint8_t)letters[field]
+        || (DEC_FLAGS(w) & 0x80808000UL) != 0x80808000UL) {
+      return false;
     }
+    uint32_t digits = w ^ BYTES('0');
+    // Same 8 bit arithmetic as _parseDigits()
+    values[field] = (uint8_t)(((digits >> 8) & 0xFF) * 100 + ((digits >> 16) & 0xFF) * 10 + (digits >> 24));
   }
-  if (MT_UNKNOWN != entry->messageType) {
-    this->messageType = entry->messageType;
-  }
-  this->inputState = nextState;
-  return 0;
+  return true;
 }
 
-static void printStateEntry(struct state_entry *entryPtr) {
-  DebugPrint(" State: ");
-  Serial.print(entryPtr->currentState);
-  DebugPrint(" Input: ");
-  if (entryPtr->inputChar < 200) {
-    Serial.print((char)entryPtr->inputChar);
-  } else {
-    Serial.print(entryPtr->inputChar);
+#else  // !BITBUS_WORD_AT_A_TIME
+
+/*
+ * Decode "LhhRhhFhhBhh" into values[]
+ * Returns: true if the message is valid
+ */
+static bool _decodeHexMessage(const uint8_t *buf, uint8_t *values) {
+  if (buf[0] != 'L' || buf[3] != 'R' || buf[6] != 'F' || buf[9] != 'B') {
+    return false;
   }
-  DebugPrint(" Next State: ");
-  Serial.println(entryPtr->nextState);
+  for (uint8_t field = 0; field < 4; field++, buf += 3) {
+    uint8_t high = _charEntry(buf[1]);
+    uint8_t low = _charEntry(buf[2]);
+    if (!CHAR_IS_HEX(high) || !CHAR_IS_HEX(low)) {
+      return false;
+    }
+    values[field] = (uint8_t)(CHAR_NYBBLE(high) << 4) | CHAR_NYBBLE(low);
+  }
+  return true;
 }
 
-/**
- * For debugging
+/*
+ * Decode "LdddRdddFdddBddd" into values[]
+ * Returns: true if the message is valid
  */
-int _MessageBuffer::_printStateTable(){
-  Serial.print("Table Size: ");
-  Serial.print(sizeof(stateTable));
-  Serial.println(" bytes");
-  for (int i = 0; i < sizeof(stateTable)/sizeof(struct state_entry); i++) {
-    Serial.print("Entry ");
-    Serial.print(i);
-    struct state_entry entry;
-    memcpy_P(&entry, &stateTable[i], sizeof(struct state_entry));
-    printStateEntry(&entry);
+static bool _decodeDecMessage(const uint8_t *buf, uint8_t *values) {
+  if (buf[0] != 'L' || buf[4] != 'R' || buf[8] != 'F' || buf[12] != 'B') {
+    return false;
   }
+  for (uint8_t field = 0; field < 4; field++, buf += 4) {
+    uint8_t hundreds = _charEntry(buf[1]);
+    uint8_t tens = _charEntry(buf[2]);
+    uint8_t ones = _charEntry(buf[3]);
+    if (!CHAR_IS_DEC(hundreds) || !CHAR_IS_DEC(tens) || !CHAR_IS_DEC(ones)) {
+      return false;
+    }
+    // Same 8 bit arithmetic as _parseDigits()
+    values[field] = CHAR_NYBBLE(hundreds) * 100 + CHAR_NYBBLE(tens) * 10 + CHAR_NYBBLE(ones);
+  }
+  return true;
 }
 
+#endif  // BITBUS_WORD_AT_A_TIME
+
 /**
- * Process an input character.
+ * Decode a complete analog message at the start of buf in one pass.
  *
- * Data is accumulated until the input state is IS_MESSAGE_READY
+ * Only applies at the start of a new message. Leaves the buffer in the same
+ * state as feeding the message through processInput() one character at a time.
  *
- * Returns: 0 when a complete message is received.
- *          1 when still waiting on a complete message
- *          any other value is an error
+ * Returns: the number of characters in the message (ANALOG_HEX_MESSAGE_LEN or ANALOG_DEC_MESSAGE_LEN),
+ *          0 if buf does not start with a complete, valid analog message.
  */
-int _MessageBuffer::processInput(int inputChar) {
-  // Clean up after the last message
+uint8_t _MessageBuffer::processAnalogMessage(const uint8_t *buf, size_t len) {
   if (IS_MESSAGE_READY == this->inputState || IS_ERROR == this->inputState) {
     this->clear();
   }
+  if (IS_START != this->inputState || len < ANALOG_HEX_MESSAGE_LEN || 'L' != buf[0]) {
+    return 0;
+  }
 
-  bool isDigit = _isHexDigit(inputChar);
+  uint8_t values[4];
+  uint8_t messageLen;
+  if ('R' == buf[3]) {
+    if (!_decodeHexMessage(buf, values)) {
+      return 0;
+    }
+    messageLen = ANALOG_HEX_MESSAGE_LEN;
+  } else {
+    if (len < ANALOG_DEC_MESSAGE_LEN || !_decodeDecMessage(buf, values)) {
+      return 0;
+    }
+    messageLen = ANALOG_DEC_MESSAGE_LEN;
+  }
 
-  // Go through the state table to find a matching state
-  bool found = false;
-  int result = 0;
-  for (int i = 0; i < sizeof(stateTable)/sizeof(struct state_entry); i++) {
-    struct state_entry entry;
-    memcpy_P(&entry, &stateTable[i], sizeof(struct state_entry));
+  this->leftValue = values[0];
+  this->rightValue = values[1];
+  this->upValue = values[2];
+  this->downValue = values[3];
+  this->messageType = MT_ANALOG_POSITION;
+  BITBUS_TRACE_MESSAGE(BT_ANALOG, this->inputState, messageLen, 0, MT_ANALOG_POSITION);
+  this->inputState = IS_MESSAGE_READY;
+  return messageLen;
+}
 
-    if ((this->inputState == entry.currentState)
-	&& ((inputChar == entry.inputChar)
-	    || (isDigit && (DIGIT == entry.inputChar)))) {
-#if DEBUG
-      DebugPrint("Found ");
-      Serial.print(i);
-      printStateEntry(&entry);
-#endif
-      found = true;
-      result = _processStateEntry(&entry, inputChar);
+/**
+ * Process characters from a buffer until a message is complete, an error
+ * occurs or the buffer runs out.
+ *
+ * Complete analog messages are decoded with processAnalogMessage(), everything
+ * else goes through the state machine one character at a time.
+ *
+ * In resync mode, a character that breaks a partial message is left in buf
+ * for the next call, which starts from IS_START, if it can start a message.
+ * A character that can't is skipped along with everything after it up to the
+ * next character that can, so a run of noise costs one error instead of one
+ * per character.
+ *
+ * consumedPtr: set to the number of characters used from buf.
+ *
+ * Returns: the same values as processInput(int) for the last character consumed,
+ *          1 if the buffer is empty.
+ */
+int _MessageBuffer::processInput(const uint8_t *buf, size_t len, size_t *consumedPtr) {
+  // Checking for the 'L' first keeps the cost down for action buttons
+  if (len >= ANALOG_HEX_MESSAGE_LEN && 'L' == buf[0]) {
+    uint8_t messageLen = this->processAnalogMessage(buf, len);
+    if (messageLen) {
+      *consumedPtr = messageLen;
+      return 0;
+    }
+  }
+
+  int result = 1;
+  size_t i = 0;
+  while (i < len) {
+    bool partial = this->_isPartial();
+    result = this->_processChar(buf[i++]);
+    if (1 != result) {
+      if (result > 1 && this->resync) {
+        if (partial && _canStartMessage(buf[i - 1])) {
+          i--;
+        } else {
+          while (i < len && !_canStartMessage(buf[i])) {
+            i++;
+          }
+        }
+      }
       break;
     }
   }
+  *consumedPtr = i;
+  return result;
+}
 
-  if (!found) {
-#if DEBUG
-    DebugPrint("ERROR: No state entry found for ");
-    Serial.print(this->inputState);
-    DebugPrint(" Input: ");
-    Serial.print((char)inputChar);
-    DebugPrint(" isDigit: ");
-    Serial.print(isDigit);
-    Serial.println();
-#endif
-    // This is an error state, reset everything.
-    this->clear();
-    return GP_ERROR_NO_STATE_ENTRY;
-  } else if (result) {
-    // This is an error state, reset everything.
-    this->clear();
-    return result;
-  } else if (IS_MESSAGE_READY == this->inputState) {
-    return 0;
+/**
+ * Returns: true if the button letter at buf[i], one of 'A', 'B' and 'C',
+ * is a press rather than a digit or field letter in the tail of an analog
+ * message: no digit or field letter follows it, past any more such letters.
+ */
+bool _MessageBuffer::_isButtonPress(const uint8_t *buf, size_t i, size_t len) {
+  for (i++; i < len; i++) {
+    uint8_t c = buf[i];
+    if (!_canStartMessage(c)) {
+      // A digit, 'R' or 'F' carries on an analog message, anything else is noise
+      return !_isHexDigit(c) && !_inString(MESSAGE_FIELD_LETTERS, c);
+    }
+    if (!_isHexDigit(c)) {
+      return true;
+    }
+    // Another 'A', 'B' or 'C', which is whatever the letter before it is
   }
+  return true;
+}
 
-  return 1;
+/**
+ * Throw away any partial message, then skip to the start of a new one. For
+ * picking up again after input has been lost: 'A', 'B' and 'C' also turn up
+ * as hex digits, and 'B' as a field letter, in the tail of an analog message.
+ * They are only taken for a button when no more of a message follows them.
+ *
+ * Returns: the number of characters to skip
+ */
+size_t _MessageBuffer::skipToMessageStart(const uint8_t *buf, size_t len) {
+  size_t i = 0;
+  this->clear();
+  while (i < len && (!_canStartMessage(buf[i]) || (_isHexDigit(buf[i]) && !_isButtonPress(buf, i, len)))) {
+    i++;
+  }
+  return i;
+}
+
+// Returns: the length of the analog message whose letters start buf, or 0
+static uint8_t _analogMessageLength(const uint8_t *buf, size_t len) {
+  if (len >= ANALOG_HEX_MESSAGE_LEN && 'L' == buf[0] && 'R' == buf[3] && 'F' == buf[6] && 'B' == buf[9]) {
+    return ANALOG_HEX_MESSAGE_LEN;
+  }
+  if (len >= ANALOG_DEC_MESSAGE_LEN && 'L' == buf[0] && 'R' == buf[4] && 'F' == buf[8] && 'B' == buf[12]) {
+    return ANALOG_DEC_MESSAGE_LEN;
+  }
+  return 0;
+}
+
+/**
+ * For coalescing mode: checks whether buf starts with an analog message that
+ * is followed by a whole other one, so it can be skipped without decoding it.
+ * Only the positions of the letters are checked, in both messages: a frame
+ * is never dropped for a next one that may turn out cut short.
+ *
+ * Returns: the length of the message to skip, or 0
+ */
+uint8_t _MessageBuffer::skipSupersededAnalogMessage(const uint8_t *buf, size_t len) {
+  if (IS_START != this->inputState && IS_MESSAGE_READY != this->inputState) {
+    return 0;
+  }
+  uint8_t messageLen = _analogMessageLength(buf, len);
+  if (messageLen && _analogMessageLength(buf + messageLen, len - messageLen)) {
+    return messageLen;
+  }
+  return 0;
 }
 
 // Class Constructor
 GamePadModule::GamePadModule() {
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  this->events = NULL;
+#endif
+  this->_init();
+}
+
+#if GAMEPAD_EVENT_QUEUE_SIZE
+GamePadModule::GamePadModule(GamePadEventQueue &queue) {
+  this->events = &queue;
+  this->_init();
+}
+#endif
+
+void GamePadModule::_init() {
+  this->coalescing = false;
+#if GAMEPAD_CALLBACKS
+  this->buttonCallback = NULL;
+  this->analogCallback = NULL;
+  this->errorCallback = NULL;
+#endif
   this->_clear();
 }
 
+/**
+ * Turn resync mode on or off. In resync mode, the character that breaks a
+ * message is tried again as the start of the next one, so one corrupted or
+ * dropped character costs one message instead of two. See
+ * _MessageBuffer::processInput().
+ */
+void GamePadModule::setResync(bool enable) {
+  this->message.resync = enable;
+}
+
+/**
+ * Turn coalescing mode on or off. Turning it off applies any position
+ * still held back.
+ *
+ * In coalescing mode, each analog message read by _processInput(buf, len)
+ * is decoded and kept until the end of the BitBus.processInput() call,
+ * when only the newest one is applied. The position getters, the analog
+ * update event and callback only see that one. The per character
+ * _processInput() isn't affected.
+ */
+void GamePadModule::setCoalescing(bool enable) {
+  this->coalescing = enable;
+  if (!enable) {
+    this->_flushCoalesced();
+  }
+}
+
+void GamePadModule::_flushCoalesced() {
+  if (this->coalescedPending) {
+    this->coalescedPending = false;
+    this->_applyPosition(this->coalesced[0], this->coalesced[1], this->coalesced[2], this->coalesced[3]);
+  }
+}
+
+void GamePadModule::_inputLost() {
+  this->inputLost = true;
+}
+
 /**
  * Reset the action button state.
  */
@@ -413,8 +800,27 @@ void GamePadModule::_clearActionButtons() {
  * Reset the module state.
  */
 void GamePadModule::_clear() {
+  this->message.clear();
   this->actionButtons = this->positionButtons = 0;
   this->posLeft = this->posRight = this->posUp = this->posDown = 0;
+#if GAMEPAD_DABBLE_COMPAT
+  this->joystickDirty = true;
+#endif
+  this->coalescedPending = this->inputLost = false;
+#if GAMEPAD_SMOOTHING
+  memset(this->smoothed, 0, sizeof(this->smoothed));
+#endif
+#if BITBUS_PARSE_IN_ISR
+  this->stateSequence = 0;
+  memset(this->buttonPresses, 0, sizeof(this->buttonPresses));
+  memset(this->reportedPresses, 0, sizeof(this->reportedPresses));
+#endif
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  if (this->events) {
+    this->events->clear();
+  }
+  this->droppedEvents = 0;
+#endif
 }
 
 /**
@@ -482,6 +888,7 @@ bool GamePadModule::isYPressed()
    return !!(this->actionButtons & (1<<BUTTON_Y_BIT));
 }
 
+#if GAMEPAD_DABBLE_COMPAT
 //Green Button Checker
 bool GamePadModule::isTrianglePressed()
 {
@@ -503,6 +910,7 @@ bool GamePadModule::isSquarePressed()
 {
   return !!(this->actionButtons & (1<<SQUARE_BIT));
 }
+#endif
 
 uint8_t GamePadModule::getLeftPosition() {
   return this->posLeft;
@@ -520,87 +928,585 @@ uint8_t GamePadModule::getDownPosition() {
   return this->posDown;
 }
 
+#if GAMEPAD_DABBLE_COMPAT
+/*
+ * atan(i / 64) in quarter degrees and sqrt(1 + (i / 64)^2) * 128, for i = 0 - 64.
+ * Generated with:
+ *   python3 -c "import math; print([round(math.degrees(math.atan(i/64))*4) for i in range(65)])"
+ *   python3 -c "import math; print([round(math.sqrt(1+(i/64)**2)*128) for i in range(65)])"
+ */
+#define JOYSTICK_TABLE_STEPS 64
+const uint8_t atanTable[JOYSTICK_TABLE_STEPS + 1] BITBUS_FLASH = {
+    0,   4,   7,  11,  14,  18,  21,  25,  29,  32,  36,  39,  42,  46,  49,  53,
+   56,  60,  63,  66,  69,  73,  76,  79,  82,  85,  88,  91,  95,  98, 100, 103,
+  106, 109, 112, 115, 117, 120, 123, 125, 128, 131, 133, 136, 138, 140, 143, 145,
+  147, 150, 152, 154, 156, 159, 161, 163, 165, 167, 169, 171, 173, 175, 176, 178,
+  180,
+};
+const uint8_t hypotTable[JOYSTICK_TABLE_STEPS + 1] BITBUS_FLASH = {
+  128, 128, 128, 128, 128, 128, 129, 129, 129, 129, 130, 130, 130, 131, 131, 131,
+  132, 132, 133, 134, 134, 135, 135, 136, 137, 137, 138, 139, 140, 141, 141, 142,
+  143, 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 158, 159,
+  160, 161, 162, 164, 165, 166, 167, 169, 170, 171, 173, 174, 175, 177, 178, 180,
+  181,
+};
+
+// Returns: table[t / 4], interpolated linearly for t = 0 - 256
+static uint8_t lookupQuarterStep(const uint8_t *table, uint16_t t) {
+  uint8_t index = t >> 2;
+  uint8_t frac = t & 3;
+  uint8_t value = _bitBusFlashByte(&table[index]);
+  if (frac) {
+    uint8_t next = _bitBusFlashByte(&table[index + 1]);
+    value += ((next - value) * frac + 2) >> 2;
+  }
+  return value;
+}
+
+// Returns: n / d rounded to the nearest integer, away from 0 on a tie
+static int8_t divideRounded(int16_t n, int16_t d) {
+  return (n < 0) ? -((-n + d / 2) / d) : (n + d / 2) / d;
+}
+
+/**
+ * Work out the polar form of the joystick position. The ratio of the shorter
+ * side to the longer one picks the table entries, so the angle is found in
+ * the first octant and then mirrored into place.
+ */
+void GamePadModule::_updateJoystick() {
+  int16_t dx = (int16_t)this->posRight - this->posLeft;
+  int16_t dy = (int16_t)this->posUp - this->posDown;
+  uint8_t ax = (dx < 0) ? -dx : dx;
+  uint8_t ay = (dy < 0) ? -dy : dy;
+
+  this->joystickDirty = false;
+  if (0 == ax && 0 == ay) {
+    this->angle = this->radius = this->xAxis = this->yAxis = 0;
+    return;
+  }
+
+  uint8_t big = (ax > ay) ? ax : ay;
+  uint8_t small = (ax > ay) ? ay : ax;
+  // small / big in 256ths
+  uint16_t t = (((uint16_t)small << 8) + big / 2) / big;
+
+  // Quarter degrees, 0 - 1439
+  uint16_t quarters = lookupQuarterStep(atanTable, t);
+  if (ay > ax) {
+    quarters = 360 - quarters;
+  }
+  if (dx < 0) {
+    quarters = 720 - quarters;
+  }
+  if (dy < 0) {
+    quarters = 1440 - quarters;
+  }
+  this->angle = (quarters + 2) >> 2;
+  if (360 == this->angle) {
+    this->angle = 0;
+  }
+
+  uint16_t magnitude = ((uint16_t)big * lookupQuarterStep(hypotTable, t) + 64) >> 7;
+  uint16_t scaled = (magnitude * 7 + 127) / 255;
+  this->radius = (scaled > 7) ? 7 : scaled;
+  this->xAxis = divideRounded(this->radius * dx, magnitude);
+  this->yAxis = divideRounded(this->radius * dy, magnitude);
+}
+
+uint16_t GamePadModule::getAngle() {
+  if (this->joystickDirty) {
+    this->_updateJoystick();
+  }
+  return this->angle;
+}
+
+uint8_t GamePadModule::getRadius() {
+  if (this->joystickDirty) {
+    this->_updateJoystick();
+  }
+  return this->radius;
+}
+
+int8_t GamePadModule::getx_axis() {
+  if (this->joystickDirty) {
+    this->_updateJoystick();
+  }
+  return this->xAxis;
+}
+
+int8_t GamePadModule::gety_axis() {
+  if (this->joystickDirty) {
+    this->_updateJoystick();
+  }
+  return this->yAxis;
+}
+
+int8_t GamePadModule::getXaxisData() {
+  return this->getx_axis();
+}
+
+int8_t GamePadModule::getYaxisData() {
+  return this->gety_axis();
+}
+
+int16_t GamePadModule::getJoystickData(uint8_t b) {
+  switch (b) {
+  case 0:
+    return this->getAngle();
+  case 1:
+    return this->getRadius();
+  case 2:
+    return this->getx_axis();
+  case 3:
+    return this->gety_axis();
+  default:
+    return 0;
+  }
+}
+
+bool GamePadModule::isPressed(uint8_t a) {
+  switch (a) {
+  case 0:
+    return this->isUpPressed();
+  case 1:
+    return this->isDownPressed();
+  case 2:
+    return this->isLeftPressed();
+  case 3:
+    return this->isRightPressed();
+  case 4:
+    return this->isStartPressed();
+  case 5:
+    return this->isSelectPressed();
+  case 6:
+    return this->isTrianglePressed();
+  case 7:
+    return this->isCirclePressed();
+  case 8:
+    return this->isCrossPressed();
+  case 9:
+    return this->isSquarePressed();
+  default:
+    return false;
+  }
+}
+#endif
+
+#if GAMEPAD_SMOOTHING
+// Returns: the new position of one axis, moved 1/2^GAMEPAD_SMOOTHING of the way to value
+static uint8_t smooth(int16_t *smoothed, uint8_t value) {
+  *smoothed += (((int16_t)value << 7) - *smoothed) >> GAMEPAD_SMOOTHING;
+  return (*smoothed + 64) >> 7;
+}
+#endif
+
+#if GAMEPAD_DEADZONE
+static uint8_t deadzone(uint8_t value) {
+  return (value <= GAMEPAD_DEADZONE) ? 0 : value;
+}
+#endif
+
+#if GAMEPAD_SMOOTHING || GAMEPAD_DEADZONE
+/**
+ * Run a new analog position through the filter stages turned on at compile time.
+ */
+void GamePadModule::_filterPosition() {
+#if GAMEPAD_SMOOTHING
+  this->posLeft = smooth(&this->smoothed[0], this->posLeft);
+  this->posRight = smooth(&this->smoothed[1], this->posRight);
+  this->posUp = smooth(&this->smoothed[2], this->posUp);
+  this->posDown = smooth(&this->smoothed[3], this->posDown);
+#endif
+#if GAMEPAD_DEADZONE
+  this->posLeft = deadzone(this->posLeft);
+  this->posRight = deadzone(this->posRight);
+  this->posUp = deadzone(this->posUp);
+  this->posDown = deadzone(this->posDown);
+#endif
+}
+#endif
+
+/**
+ * Store a new analog position and report it.
+ */
+void GamePadModule::_applyPosition(uint8_t left, uint8_t right, uint8_t up, uint8_t down) {
+  this->posLeft = left;
+  this->posRight = right;
+  this->posUp = up;
+  this->posDown = down;
+#if GAMEPAD_DABBLE_COMPAT
+  this->joystickDirty = true;
+#endif
+#if GAMEPAD_SMOOTHING || GAMEPAD_DEADZONE
+  this->_filterPosition();
+#endif
+  this->_updatePositionButtons();
+  this->_postEvent(GP_EVENT_ANALOG_UPDATE, this->positionButtons);
+}
+
+/**
+ * Emulate the digital pushbuttons: the largest axis is the one pressed.
+ */
+void GamePadModule::_updatePositionButtons() {
+  if (0 == this->posUp && 0 == this->posDown && 0 == this->posLeft && 0 == this->posRight) {
+    // Stop position
+    this->positionButtons = 0;
+    return;
+  }
+#if GAMEPAD_HYSTERESIS
+  uint8_t previous = this->positionButtons;
+#endif
+  uint8_t largest = this->posUp;
+  this->positionButtons = 1<<UP_BIT;
+  if (this->posDown > largest) {
+    largest = this->posDown;
+    this->positionButtons = 1<<DOWN_BIT;
+  }
+  if (this->posLeft > largest) {
+    largest = this->posLeft;
+    this->positionButtons = 1<<LEFT_BIT;
+  }
+  if (this->posRight > largest) {
+    largest = this->posRight;
+    this->positionButtons = 1<<RIGHT_BIT;
+  }
+#if GAMEPAD_HYSTERESIS
+  // Near a diagonal, stay with the previous direction instead of flapping
+  if (previous && previous != this->positionButtons) {
+    uint8_t previousValue = (previous & (1<<UP_BIT)) ? this->posUp
+      : (previous & (1<<DOWN_BIT)) ? this->posDown
+      : (previous & (1<<LEFT_BIT)) ? this->posLeft
+      : this->posRight;
+    if (largest <= previousValue + GAMEPAD_HYSTERESIS) {
+      this->positionButtons = previous;
+    }
+  }
+#endif
+}
+
 /**
  * Handle the work of processing GamePad specific input.
  *
+ * The action buttons are cleared before processing the character.
+ *
+ * Returns: GP_OK or a GAMEPAD_ERROR code
  */
+#if BITBUS_TEST_SUPPORT
 int GamePadModule::_processInput(int inputChar)
 {
-#if DEBUG
-  DebugPrint("GPM Input: ");
-  if (inputChar < 128) {
-    Serial.print("'");
-    Serial.print((char)inputChar);
-    Serial.print("'");
-  } else {
-    Serial.print(inputChar);
+  this->actionButtons = 0;
+
+  int result = this->message.processInput(inputChar);
+  if (0 == result) {
+    result = this->_handleMessage();
+  } else if (1 == result) {
+    result = GP_OK;
+  }
+  if (GP_OK != result) {
+    this->_postEvent(GP_EVENT_PARSE_ERROR, result);
+    // In resync mode the character that caused the error may be a whole message
+    if (IS_MESSAGE_READY == this->message.inputState) {
+      this->_handleMessage();
+    }
   }
-  Serial.println();
+  return result;
+}
 #endif
 
+/**
+ * Process a buffer of input characters.
+ *
+ * Unlike _processInput(int), the action buttons are not cleared first, so
+ * every action button message in the buffer is reported.
+ *
+ * Returns: GP_OK, or the last GAMEPAD_ERROR code seen in the buffer
+ */
+int GamePadModule::_processInput(const uint8_t *buf, size_t len)
+{
+  BITBUS_TRACE_MESSAGE(BT_CHUNK, this->message.inputState, len < 255 ? len : 255, 0, this->inputLost);
+
+  int error = GP_OK;
+  if (this->inputLost) {
+    size_t skipped = this->message.skipToMessageStart(buf, len);
+    BITBUS_TRACE_MESSAGE(BT_SKIP, IS_START, skipped < 255 ? skipped : 255, 0, 0);
+    buf += skipped;
+    len -= skipped;
+    // Keep skipping into the next call if nothing here could start a message
+    this->inputLost = (0 == len);
+  }
+  while (len) {
+    size_t consumed;
+    if (this->coalescing && (consumed = this->message.skipSupersededAnalogMessage(buf, len))) {
+      BITBUS_TRACE_MESSAGE(BT_SUPERSEDED, this->message.inputState, consumed, 0, MT_ANALOG_POSITION);
+      BITBUS_STATS_ONLY(_bitBusStatsSuperseded());
+      buf += consumed;
+      len -= consumed;
+      continue;
+    }
+    int result = this->message.processInput(buf, len, &consumed);
+    buf += consumed;
+    len -= consumed;
+    if (0 == result && this->coalescing && MT_ANALOG_POSITION == this->message.messageType) {
+      // Hold the position back, a newer one may follow
+      BITBUS_STATS_ONLY(_bitBusStatsFrame(MT_ANALOG_POSITION));
+      this->coalesced[0] = this->message.leftValue;
+      this->coalesced[1] = this->message.rightValue;
+      this->coalesced[2] = this->message.upValue;
+      this->coalesced[3] = this->message.downValue;
+      this->coalescedPending = true;
+      this->message.clear();
+      continue;
+    }
+    if (0 == result) {
+      result = this->_handleMessage();
+    }
+    if (GP_OK != result && 1 != result) {
+      this->_postEvent(GP_EVENT_PARSE_ERROR, result);
+      error = result;
+    }
+  }
+  return error;
+}
+
+#if BITBUS_PARSE_IN_ISR
+/**
+ * Parse one character from the receive interrupt, as a sequence lock
+ * writer: stateSequence is odd while the state changes, and moves on by two
+ * each time. The action buttons belong to readState() in this mode, so
+ * presses are counted instead of being set in actionButtons.
+ */
+void GamePadModule::_processInputIsr(uint8_t inputChar, bool lost)
+{
+  uint8_t sequence = this->stateSequence;
+  __atomic_store_n(&this->stateSequence, (uint8_t)(sequence + 1), __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  if (lost) {
+    this->inputLost = true;
+  }
+  uint8_t buttons = this->actionButtons;
   this->actionButtons = 0;
+  this->_processInput(&inputChar, 1);
+  // One character completes a message at most, so each button once at most
+  for (uint8_t i = 0; i <= GP_BUTTON_Y; i++) {
+    if (this->actionButtons & (1<<i)) {
+      this->buttonPresses[i]++;
+    }
+  }
+  this->actionButtons = buttons;
 
-  if (!message.processInput(inputChar)) {
-    // Got a new message
-    switch (message.messageType) {
-    case MT_START_BUTTON:
-      this->actionButtons |= 1<<START_BIT;
-      break;
-    case MT_SELECT:
-      this->actionButtons |= 1<<SELECT_BIT;
-      break;
-    case MT_BUTTON_A:
-      this->actionButtons |= 1<<BUTTON_A_BIT;
-      break;
-    case MT_BUTTON_B:
-      this->actionButtons |= 1<<BUTTON_B_BIT;
-      break;
-    case MT_BUTTON_X:
-      this->actionButtons |= 1<<BUTTON_X_BIT;
-      break;
-    case MT_BUTTON_Y:
-      this->actionButtons |= 1<<BUTTON_Y_BIT;
-      break;
-    case MT_ANALOG_POSITION:
-      // Store the analog position
-      this->posLeft = message.leftValue;
-      this->posRight = message.rightValue;
-      this->posUp = message.upValue;
-      this->posDown = message.downValue;
-
-      // Emulate the digital pushbuttons
-      if (0 == this->posUp && 0 == this->posDown && 0 == this->posLeft && 0 == this->posRight) {
-	// Stop position
-	this->positionButtons = 0;
-      } else {
-	uint8_t largest = this->posUp;
-	this->positionButtons = 1<<UP_BIT;
-	if (this->posDown > largest) {
-	  largest = this->posDown;
-	  this->positionButtons = 1<<DOWN_BIT;
-	}
-	if (this->posLeft > largest) {
-	  largest = this->posLeft;
-	  this->positionButtons = 1<<LEFT_BIT;
-	}
-	if (this->posRight > largest) {
-	  largest = this->posRight;
-	  this->positionButtons = 1<<RIGHT_BIT;
-	}
-      }
-      break;
-    case MT_UNKNOWN:
-    default:
-      // Likely indicates an error in coding the state table
-#if DEBUG
-      Serial.print("Error: Unhandled Message Type ");
-      Serial.println(message.messageType);
-#endif
-      return GP_ERROR_UNHANDLED_MESSAGE_TYPE;
-      break;
+  __atomic_store_n(&this->stateSequence, (uint8_t)(sequence + 2), __ATOMIC_RELEASE);
+}
+
+/**
+ * Sequence lock reader: copy the state, then check stateSequence didn't
+ * change and wasn't odd. On AVR the interrupt handler can only run between
+ * two instructions here, so a retry is rare and never needed twice in a row
+ * unless bytes arrive faster than this loop runs. The sequence is one byte,
+ * so AVR reads it in one go; it would only come round to the same value if
+ * 128 bytes were parsed during one pass.
+ */
+void GamePadModule::readState(GamePadState *state)
+{
+  uint8_t presses[GP_BUTTON_Y + 1];
+  uint8_t sequence;
+  do {
+    sequence = __atomic_load_n(&this->stateSequence, __ATOMIC_ACQUIRE);
+    state->positionButtons = this->positionButtons;
+    state->left = this->posLeft;
+    state->right = this->posRight;
+    state->up = this->posUp;
+    state->down = this->posDown;
+    memcpy(presses, this->buttonPresses, sizeof(presses));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((sequence & 1) || sequence != __atomic_load_n(&this->stateSequence, __ATOMIC_RELAXED));
+
+  uint8_t pressed = 0;
+  for (uint8_t i = 0; i <= GP_BUTTON_Y; i++) {
+    if (presses[i] != this->reportedPresses[i]) {
+      pressed |= 1<<i;
+      this->reportedPresses[i] = presses[i];
     }
+  }
+  this->actionButtons = state->actionButtons = pressed;
+}
+#endif
+
+/**
+ * Copy a complete message from the parser into the GamePad state.
+ *
+ * Returns: GP_OK or a GAMEPAD_ERROR code
+ */
+int GamePadModule::_handleMessage()
+{
+  uint8_t button;
+
+  BITBUS_STATS_ONLY(_bitBusStatsFrame(this->message.messageType));
+
+  switch (this->message.messageType) {
+  case MT_START_BUTTON:
+    button = START_BIT;
+    break;
+  case MT_SELECT:
+    button = SELECT_BIT;
+    break;
+  case MT_BUTTON_A:
+    button = BUTTON_A_BIT;
+    break;
+  case MT_BUTTON_B:
+    button = BUTTON_B_BIT;
+    break;
+  case MT_BUTTON_X:
+    button = BUTTON_X_BIT;
+    break;
+  case MT_BUTTON_Y:
+    button = BUTTON_Y_BIT;
+    break;
+  case MT_ANALOG_POSITION:
+    // A position from the per character API is newer than any held back
+    this->coalescedPending = false;
+    this->_applyPosition(this->message.leftValue, this->message.rightValue,
+                         this->message.upValue, this->message.downValue);
 
     // Clear out the message state for parsing the next message
-    message.clear();
+    this->message.clear();
+    return GP_OK;
+  case MT_UNKNOWN:
+  default:
+    // Likely indicates an error in coding the state table
+    BITBUS_TRACE_MESSAGE(BT_UNHANDLED, this->message.inputState, 0, 0, this->message.messageType);
+    return GP_ERROR_UNHANDLED_MESSAGE_TYPE;
   }
+
+  this->actionButtons |= 1<<button;
+  this->_postEvent(GP_EVENT_BUTTON_PRESSED, button);
+
+  // Clear out the message state for parsing the next message
+  this->message.clear();
+  return GP_OK;
+}
+
+/**
+ * Hand an event to the registered callback, then add it to the queue for
+ * readEvent(). Safe to call from an interrupt handler, as long as the
+ * callbacks are.
+ */
+void GamePadModule::_postEvent(uint8_t type, uint8_t code)
+{
+  BITBUS_STATS_ONLY(if (GP_EVENT_PARSE_ERROR == type) _bitBusStatsError(code));
+
+#if GAMEPAD_CALLBACKS
+  switch (type) {
+  case GP_EVENT_BUTTON_PRESSED:
+    if (this->buttonCallback) {
+      this->buttonCallback(code);
+    }
+    break;
+  case GP_EVENT_ANALOG_UPDATE:
+    if (this->analogCallback) {
+      this->analogCallback(this->posLeft, this->posRight, this->posUp, this->posDown);
+    }
+    break;
+  case GP_EVENT_PARSE_ERROR:
+    if (this->errorCallback) {
+      this->errorCallback(code);
+    }
+    break;
+  }
+#endif
+
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  if (!this->events) {
+    return;
+  }
+  /*
+   * Joystick updates arrive continuously and the getters always have the
+   * latest position anyway. Keep half the queue for button presses and
+   * errors in case the sketch falls behind.
+   */
+  bool isFull = (GP_EVENT_ANALOG_UPDATE == type)
+    ? this->events->space() <= GAMEPAD_EVENT_QUEUE_SIZE / 2
+    : this->events->space() == 0;
+
+  if (!isFull) {
+    GamePadEvent event;
+    event.type = type;
+    event.code = code;
+    event.timestamp = (uint16_t)millis();
+    event.left = this->posLeft;
+    event.right = this->posRight;
+    event.up = this->posUp;
+    event.down = this->posDown;
+    isFull = !this->events->push(event);
+  }
+  if (isFull && this->droppedEvents < 255) {
+    this->droppedEvents++;
+  }
+#endif
+}
+
+#if GAMEPAD_CALLBACKS
+/**
+ * Call callback with the enum GAMEPAD_BUTTON of every action button press.
+ * Pass NULL to stop.
+ */
+void GamePadModule::onButtonPressed(GamePadButtonCallback callback)
+{
+  this->buttonCallback = callback;
+}
+
+/**
+ * Call callback with the joystick position every time an analog message arrives.
+ * Pass NULL to stop.
+ */
+void GamePadModule::onAnalogUpdate(GamePadAnalogCallback callback)
+{
+  this->analogCallback = callback;
+}
+
+/**
+ * Call callback with the enum GAMEPAD_ERROR of every parse error. Pass NULL to stop.
+ */
+void GamePadModule::onParseError(GamePadErrorCallback callback)
+{
+  this->errorCallback = callback;
+}
+#endif
+
+/**
+ * Remove the oldest event from the queue.
+ *
+ * Returns: true if an event was copied to *event, false if there are no events waiting
+ */
+bool GamePadModule::readEvent(GamePadEvent *event)
+{
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  return this->events && this->events->pop(event);
+#else
+  return false;
+#endif
+}
+
+/**
+ * Returns: the number of events waiting to be read
+ */
+uint8_t GamePadModule::availableEvents()
+{
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  return this->events ? this->events->count() : 0;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Returns: the number of events that didn't fit in the queue, up to 255
+ */
+uint8_t GamePadModule::getDroppedEvents()
+{
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  return this->droppedEvents;
+#else
+  return 0;
+#endif
 }
@@ -4,12 +4,35 @@
  * General Use:
  * Call BitBus.processInput(), then check the getters to see what has changed.
  *
- * The name GamePad is for compatibility with the Dabble library.
+ * Alternatively, drain the events queued by BitBus.processInput() with
+ * readEvent(). No action button press is lost between calls this way,
+ * as long as the queue doesn't fill up.
+ *
+ * Or register callbacks with onButtonPressed(), onAnalogUpdate() and
+ * onParseError(). They are called from inside BitBus.processInput() as soon
+ * as each message is complete, so don't call processInput() from them.
+ *
+ * The name GamePad is for compatibility with the Dabble library. It is the
+ * instance BitBus feeds. For a second Bluetooth module, declare another
+ * GamePadModule and hand it to a BitBusT of its own (see BitBus.h).
+ *
+ * Each GamePadModule is 39 bytes of RAM on AVR with the default options:
+ * 11 for the message being parsed, 13 for the buttons, position and
+ * coalescing state, 6 for the Dabble joystick cache, 6 for the callbacks
+ * and 3 for the event queue pointer and drop count. The event queue itself,
+ * 66 bytes, is only there when it's asked for: GamePad has one, and another
+ * GamePadModule gets one by being declared with a GamePadEventQueue:
+ *
+ *   GamePadEventQueue player2Events;
+ *   GamePadModule player2(player2Events);
  */
 #ifndef GamePad_h
 #define GamePad_h
 
 #include "Arduino.h"
+#include "BitBusConfig.h"
+#include "MessageBuffer.h"
+#include "SpscQueue.h"
 
 enum GAMEPAD_ERROR {
   GP_OK = 0,
@@ -19,10 +42,64 @@ enum GAMEPAD_ERROR {
   GP_ERROR_UNEXPECTED_DEC_DIGIT = 103,
 };
 
+// Action buttons, as reported in GamePadEvent.code
+enum GAMEPAD_BUTTON {
+  GP_BUTTON_START = 0,
+  GP_BUTTON_SELECT = 1,
+  GP_BUTTON_A = 2,
+  GP_BUTTON_B = 3,
+  GP_BUTTON_X = 4,
+  GP_BUTTON_Y = 5,
+};
+
+enum GAMEPAD_EVENT_TYPE {
+  GP_EVENT_NONE = 0,
+  GP_EVENT_BUTTON_PRESSED,  // code is the enum GAMEPAD_BUTTON
+  GP_EVENT_ANALOG_UPDATE,   // code is the emulated up/down/left/right button bits
+  GP_EVENT_PARSE_ERROR,     // code is the enum GAMEPAD_ERROR
+};
+
+struct GamePadEvent {
+  uint8_t type;        // enum GAMEPAD_EVENT_TYPE
+  uint8_t code;
+  uint16_t timestamp;  // Low 16 bits of millis() when the event was queued
+  // Joystick position when the event was queued
+  uint8_t left;
+  uint8_t right;
+  uint8_t up;
+  uint8_t down;
+};
+
+#if BITBUS_PARSE_IN_ISR
+// One consistent copy of the GamePad state, see GamePadModule::readState()
+struct GamePadState {
+  uint8_t actionButtons;    // Bit per GAMEPAD_BUTTON pressed since the last readState()
+  uint8_t positionButtons;  // Emulated up/down/left/right buttons, as in GP_EVENT_ANALOG_UPDATE
+  uint8_t left;
+  uint8_t right;
+  uint8_t up;
+  uint8_t down;
+};
+#endif
+
+#if GAMEPAD_EVENT_QUEUE_SIZE
+// Storage for the events of a GamePadModule, see GamePadModule(GamePadEventQueue &)
+typedef _SpscQueue<GamePadEvent, GAMEPAD_EVENT_QUEUE_SIZE> GamePadEventQueue;
+#endif
+
+typedef void (*GamePadButtonCallback)(uint8_t button);  // enum GAMEPAD_BUTTON
+typedef void (*GamePadAnalogCallback)(uint8_t left, uint8_t right, uint8_t up, uint8_t down);
+typedef void (*GamePadErrorCallback)(uint8_t error);    // enum GAMEPAD_ERROR
+
 class GamePadModule
 {
  public:
+  // Without an event queue: readEvent() never finds one
   GamePadModule();
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  // Queue events in queue for readEvent()
+  explicit GamePadModule(GamePadEventQueue &queue);
+#endif
 
   // Getter Functions
   bool isStartPressed();
@@ -44,42 +121,150 @@ class GamePadModule
   uint8_t getUpPosition();
   uint8_t getDownPosition();
 
+#if GAMEPAD_DABBLE_COMPAT
   // Dabble Compatibility functions
   bool isTrianglePressed(); // Same as Button B
   bool isCirclePressed();   // Same as Button Y
   bool isCrossPressed();    // Same as Button X
   bool isSquarePressed();   // Same as Button A
+#endif
+
 
+  // Event queue
+  // Returns false if there are no events waiting
+  bool readEvent(GamePadEvent *event);
+  uint8_t availableEvents();
+  // Number of events lost because the queue was full. Stops counting at 255.
+  uint8_t getDroppedEvents();
 
-  // TODO(ericzundel): Unimplemented Dabble compatibility methods
-  // NB(zundel): I'm not very keen on adding in floating point
+  // Recover from corrupted input by retrying the character that broke a message
+  void setResync(bool enable);
 
-  //  uint16_t getAngle();
-  //  uint8_t getRadius();
-  //  bool isPressed(uint8_t a);
+  /*
+   * Latest wins: when BitBus.processInput() finds a backlog, only the newest
+   * joystick position in it is applied. Action buttons are all still
+   * reported. After the transport overflows, the partial message cut off by
+   * the lost input is dropped instead of being parsed with what follows.
+   */
+  void setCoalescing(bool enable);
+  bool isCoalescing() { return this->coalescing; }
 
-  //  float getJoystickData(uint8_t b);
-  //  float getx_axis();
-  //  float gety_axis();
+#if BITBUS_PARSE_IN_ISR
+  /*
+   * For a GamePad fed from the receive interrupt by BITBUS_UART_PARSER(),
+   * instead of BitBus.processInput(). Copies the state without turning
+   * interrupts off, trying again if a byte is parsed part way through. The
+   * action buttons are the ones pressed since the last call, and the action
+   * button getters report the same ones until the next call.
+   */
+  void readState(GamePadState *state);
+#endif
+
+#if GAMEPAD_CALLBACKS
+  // Callbacks, pass NULL to unregister
+  void onButtonPressed(GamePadButtonCallback callback);
+  void onAnalogUpdate(GamePadAnalogCallback callback);
+  void onParseError(GamePadErrorCallback callback);
+#endif
 
-  //  float getXaxisData();
-  //  float getYaxisData();
+#if GAMEPAD_DABBLE_COMPAT
+  /*
+   * Joystick in polar form, for Dabble compatibility. Integer only: the
+   * angle comes from a table in flash rather than atan2(), and the results
+   * are worked out on the first call after a new position arrives.
+   */
+  // Returns: 0 - 359 degrees counterclockwise from right, 0 when centered
+  uint16_t getAngle();
+  // Returns: 0 (centered) - 7 (pushed all the way)
+  uint8_t getRadius();
+  // Returns: -7 (left/down) - 7 (right/up), radius * cos(angle) and radius * sin(angle)
+  int8_t getx_axis();
+  int8_t gety_axis();
+  int8_t getXaxisData();  // Same as getx_axis()
+  int8_t getYaxisData();  // Same as gety_axis()
+  // Returns: 0: getAngle(), 1: getRadius(), 2: getx_axis(), 3: gety_axis()
+  int16_t getJoystickData(uint8_t b);
+
+  /*
+   * Dabble button numbering: 0 up, 1 down, 2 left, 3 right, 4 start,
+   * 5 select, 6 triangle, 7 circle, 8 cross, 9 square.
+   */
+  bool isPressed(uint8_t a);
+#endif
 
+#if BITBUS_TEST_SUPPORT
   // Process an input character. Only meant to be called by tests and the BitBus module.
   int _processInput(int inputChar);
+#endif
+  // Process a buffer of input characters. Only meant to be called by tests and the BitBus module.
+  int _processInput(const uint8_t *buf, size_t len);
   // Clear the state of the action buttons. Only meant to be called by tests and the BitBus module.
   void _clearActionButtons();
   // Clear the state of the entire object. Only meant to be called by tests and the BitBus module.
   void _clear();
+  // Apply the joystick position held back in coalescing mode. Only meant to be called by tests and the BitBus module.
+  void _flushCoalesced();
+  // Input has been lost since the last call to _processInput(). Only meant to be called by tests and the BitBus module.
+  void _inputLost();
+#if BITBUS_PARSE_IN_ISR
+  // Process a character in the receive interrupt, lost if input was lost before it. Only meant to be called by BitBusUart.
+  void _processInputIsr(uint8_t inputChar, bool lost);
+#endif
 
 
  private:
+  void _init();
+  int _handleMessage();
+  void _postEvent(uint8_t type, uint8_t code);
+
+#if GAMEPAD_DABBLE_COMPAT
+  void _updateJoystick();
+#endif
+  void _filterPosition();
+  void _updatePositionButtons();
+  void _applyPosition(uint8_t left, uint8_t right, uint8_t up, uint8_t down);
+
+  _MessageBuffer message;
   uint8_t actionButtons;
   uint8_t positionButtons;
   uint8_t posLeft;
   uint8_t posRight;
   uint8_t posUp;
   uint8_t posDown;
+#if GAMEPAD_SMOOTHING
+  // Smoothed left, right, up and down positions, with 7 fraction bits
+  int16_t smoothed[4];
+#endif
+
+#if GAMEPAD_DABBLE_COMPAT
+  // Polar form of the position, valid unless joystickDirty
+  bool joystickDirty;
+  uint8_t radius;
+  int8_t xAxis;
+  int8_t yAxis;
+  uint16_t angle;
+#endif
+
+  bool coalescing;
+  bool coalescedPending;  // coalesced holds a position not applied yet
+  bool inputLost;         // Skip to the start of a message on the next input
+  uint8_t coalesced[4];   // Newest left, right, up and down position
+
+#if BITBUS_PARSE_IN_ISR
+  uint8_t stateSequence;                     // Odd while the interrupt handler changes the state
+  uint8_t buttonPresses[GP_BUTTON_Y + 1];    // Written by the interrupt handler only
+  uint8_t reportedPresses[GP_BUTTON_Y + 1];  // buttonPresses at the last readState()
+#endif
+
+#if GAMEPAD_EVENT_QUEUE_SIZE
+  GamePadEventQueue *events;  // NULL for none
+  uint8_t droppedEvents;
+#endif
+#if GAMEPAD_CALLBACKS
+  GamePadButtonCallback buttonCallback;
+  GamePadAnalogCallback analogCallback;
+  GamePadErrorCallback errorCallback;
+#endif
 };
 
 extern GamePadModule GamePad;
@@ -6,27 +6,85 @@
 #ifndef MESSAGE_BUFFER_H
 #define MESSAGE_BUFFER_H
 
+#include "Arduino.h"
+#include "BitBusConfig.h"
+
+/*
+ * The messages the app sends. This is the only place the protocol is spelled
+ * out: the parser tables in GamePad.cpp are generated from it when the
+ * library is compiled.
+ *
+ * An action button is a single letter. An analog position is a letter
+ * followed by a value for each field, with every value in the message
+ * written as either ANALOG_HEX_DIGITS hex digits or ANALOG_DEC_DIGITS
+ * decimal digits.
+ */
+#define MESSAGE_BUTTON_LETTERS "SCABXY"  // MT_START_BUTTON - MT_BUTTON_Y
+#define MESSAGE_FIELD_LETTERS  "LRFB"    // leftValue, rightValue, upValue, downValue
+#define ANALOG_FIELDS 4
+#define ANALOG_HEX_DIGITS 2
+#define ANALOG_DEC_DIGITS 3
+
+/*
+ * Layout of the parser states. The hex and decimal forms of an analog
+ * message get states of their own, which the first field can only choose
+ * between at the digit after the hex digits.
+ *
+ * First field, before the base is known: waiting for digit p, where
+ * hexSeen means a hex letter has ruled out decimal.
+ */
+constexpr uint8_t _firstFieldState(uint8_t p, bool hexSeen) {
+  return p == 1 ? 1 : 2 * p - 2 + hexSeen;
+}
+#define _HEX_STATES_START (2 * ANALOG_HEX_DIGITS + 2)
+// Hex message: waiting for digit p of field i
+constexpr uint8_t _hexDigitState(uint8_t i, uint8_t p) {
+  return _HEX_STATES_START + (i - 1) * (ANALOG_HEX_DIGITS + 1) + p - 1;
+}
+// Hex message: waiting for the letter of field i
+constexpr uint8_t _hexLetterState(uint8_t i) {
+  return i == 1 ? _firstFieldState(ANALOG_HEX_DIGITS + 1, true) : _hexDigitState(i - 1, ANALOG_HEX_DIGITS + 1);
+}
+#define _DEC_STATES_START (_HEX_STATES_START + (ANALOG_FIELDS - 1) * (ANALOG_HEX_DIGITS + 1) - 1)
+// Decimal message: waiting for the letter of field i
+constexpr uint8_t _decLetterState(uint8_t i) {
+  return _DEC_STATES_START + (i - 1) * (ANALOG_DEC_DIGITS + 1);
+}
+// Decimal message: waiting for digit p of field i
+constexpr uint8_t _decDigitState(uint8_t i, uint8_t p) {
+  return _decLetterState(i) + p;
+}
+
 // Defines the state machine states for parsing input
 enum _INPUT_STATE {
   IS_START = 0,
-  IS_ERROR = 2,
-  IS_WAITING_FOR_L = 10,
-  IS_WAITING_FOR_L_DIGIT_1 = 11,
-  IS_WAITING_FOR_L_DIGIT_2 = 12,
-  IS_WAITING_FOR_L_DIGIT_3_OR_R = 13,
-  IS_WAITING_FOR_R = 20,
-  IS_WAITING_FOR_R_DIGIT_1 = 21,
-  IS_WAITING_FOR_R_DIGIT_2 = 22,
-  IS_WAITING_FOR_R_DIGIT_3_OR_F = 23,
-  IS_WAITING_FOR_F = 30,
-  IS_WAITING_FOR_F_DIGIT_1 = 31,
-  IS_WAITING_FOR_F_DIGIT_2 = 32,
-  IS_WAITING_FOR_F_DIGIT_3_OR_B = 33,
-  IS_WAITING_FOR_B = 40,
-  IS_WAITING_FOR_B_DIGIT_1 = 41,
-  IS_WAITING_FOR_B_DIGIT_2 = 42,
-  IS_WAITING_FOR_B_DIGIT_3 = 43,
-  IS_MESSAGE_READY = 50,
+  IS_WAITING_FOR_L_DIGIT_1 = _firstFieldState(1, false),
+  IS_WAITING_FOR_L_DIGIT_2 = _firstFieldState(2, false),
+  IS_WAITING_FOR_L_HEX_DIGIT_2 = _firstFieldState(2, true),
+  IS_WAITING_FOR_L_DIGIT_3_OR_R = _firstFieldState(3, false),
+  IS_WAITING_FOR_HEX_R = _hexLetterState(1),
+  IS_WAITING_FOR_HEX_R_DIGIT_1 = _hexDigitState(1, 1),
+  IS_WAITING_FOR_HEX_R_DIGIT_2 = _hexDigitState(1, 2),
+  IS_WAITING_FOR_HEX_F = _hexLetterState(2),
+  IS_WAITING_FOR_HEX_F_DIGIT_1 = _hexDigitState(2, 1),
+  IS_WAITING_FOR_HEX_F_DIGIT_2 = _hexDigitState(2, 2),
+  IS_WAITING_FOR_HEX_B = _hexLetterState(3),
+  IS_WAITING_FOR_HEX_B_DIGIT_1 = _hexDigitState(3, 1),
+  IS_WAITING_FOR_HEX_B_DIGIT_2 = _hexDigitState(3, 2),
+  IS_WAITING_FOR_R = _decLetterState(1),
+  IS_WAITING_FOR_R_DIGIT_1 = _decDigitState(1, 1),
+  IS_WAITING_FOR_R_DIGIT_2 = _decDigitState(1, 2),
+  IS_WAITING_FOR_R_DIGIT_3 = _decDigitState(1, 3),
+  IS_WAITING_FOR_F = _decLetterState(2),
+  IS_WAITING_FOR_F_DIGIT_1 = _decDigitState(2, 1),
+  IS_WAITING_FOR_F_DIGIT_2 = _decDigitState(2, 2),
+  IS_WAITING_FOR_F_DIGIT_3 = _decDigitState(2, 3),
+  IS_WAITING_FOR_B = _decLetterState(3),
+  IS_WAITING_FOR_B_DIGIT_1 = _decDigitState(3, 1),
+  IS_WAITING_FOR_B_DIGIT_2 = _decDigitState(3, 2),
+  IS_WAITING_FOR_B_DIGIT_3 = _decDigitState(3, 3),
+  IS_MESSAGE_READY = _decDigitState(ANALOG_FIELDS - 1, ANALOG_DEC_DIGITS) + 1,
+  IS_ERROR,
 };
 
 
@@ -46,6 +104,18 @@ enum _MESSAGE_TYPE {
 };
 
 
+/*
+ * A parser transition packs the next state in the low 6 bits and what to do
+ * with the character in the high 2 bits. When the next state is IS_ERROR,
+ * the high bits hold the error instead, counting from GP_ERROR_NO_STATE_ENTRY.
+ */
+#define TRANSITION_STATE(t)  ((uint8_t)(t) & 0x3F)
+#define TRANSITION_ACTION(t) ((uint8_t)(t) >> 6)
+
+// Length of the analog position messages: "LhhRhhFhhBhh" and "LdddRdddFdddBddd"
+#define ANALOG_HEX_MESSAGE_LEN (ANALOG_FIELDS * (1 + ANALOG_HEX_DIGITS))
+#define ANALOG_DEC_MESSAGE_LEN (ANALOG_FIELDS * (1 + ANALOG_DEC_DIGITS))
+
 // Internal data structure to read analog joystick position.
 // Data is accumulated here, and then when complete can be
 // copied into the GamePad instance.
@@ -53,16 +123,12 @@ class _MessageBuffer
 {
 public:
   _MessageBuffer();
-  processInput(int inputChar);
-
-  int parseDigit1(int inputChar, enum _INPUT_STATE *nextStatePtr);
-  int parseDigit2(int inputChar, enum _INPUT_STATE *nextStatePtr);
-  int parseDigit2B(int inputchar, enum _INPUT_STATE *nextStatePtr);
-  int parseLDecDigits(int inputChar, enum _INPUT_STATE *nextStatePtr);
-  int parseLHexDigits(int inputChar, enum _INPUT_STATE *nextStatePtr);
-  int parseRDigits(int inputChar, enum _INPUT_STATE *nextStatePtr);
-  int parseBDigits(int inputChar, enum _INPUT_STATE *nextStatePtr);
-  int parseFDigits(int inputChar, enum _INPUT_STATE *nextStatePtr);
+  int processInput(int inputChar);
+  int processInput(const uint8_t *buf, size_t len, size_t *consumedPtr);
+  uint8_t processAnalogMessage(const uint8_t *buf, size_t len);
+  size_t skipToMessageStart(const uint8_t *buf, size_t len);
+  uint8_t skipSupersededAnalogMessage(const uint8_t *buf, size_t len);
+
   void clear();
 
   enum _MESSAGE_TYPE messageType;
@@ -74,24 +140,24 @@ public:
   /* private: */ // NB(ericzundel): I didn't make these private so I could test them.
   static bool _isDecDigit(int inputChar);
   static bool _isHexDigit(int inputChar);
-  static uint8_t _asciiToInt(int inputChar);
-  int _printStateTable();
+  static uint8_t _transition(int inputState, int inputChar);
+#if BITBUS_TEST_SUPPORT
+  int _printStateTable(Print &out = Serial);
+#endif
   enum _INPUT_STATE inputState;
+  // Retry the character that caused an error as the start of a new message
+  bool resync;
 
 private:
-  int _parseDigits(int inputChar, uint8_t *valuePtr);
-  int _processStateEntry(struct state_entry *entry, int inputChar);
-
-
-  char digitBuf[2];
-  /* isHex: hexadecmial mode
-   * true if we are parsing 2 digit hex values
-   * false if we are parsing 3 digit decimal values
-   *
-   * NB(ericzundel): we could do away with this by adding lots more states,
-   *   but that seems like a lot of work when hand writing a parser.
-   */
-  boolean isHex;
+  int _processChar(int inputChar);
+  bool _isPartial();
+  static bool _canStartMessage(int inputChar);
+  static bool _isButtonPress(const uint8_t *buf, size_t i, size_t len);
+  void _storeField(uint8_t field, uint8_t value);
+
+  // The digits of the current field so far, read as hex and as decimal
+  uint8_t hexDigits;
+  uint8_t decDigits;
 };
 
 #endif
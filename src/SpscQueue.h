@@ -0,0 +1,90 @@
+/**
+ * SpscQueue.h - A fixed size, lock free, single producer / single consumer queue.
+ *
+ * Not intended for use outside of the library or unit testing
+ *
+ * Only the producer writes head and only the consumer writes tail, so either
+ * side can run in an interrupt handler without the other side disabling
+ * interrupts. The indexes are single bytes, which AVR reads and writes
+ * atomically.
+ */
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+
+// SIZE must be a power of two no larger than 128
+template <typename T, uint8_t SIZE>
+class _SpscQueue
+{
+  static_assert(SIZE > 0 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0,
+                "_SpscQueue SIZE must be a power of two no larger than 128");
+
+public:
+  _SpscQueue() : head(0), tail(0) {}
+
+  /**
+   * Producer: add an item to the queue.
+   * Returns: false if the queue is full and the item was dropped
+   */
+  bool push(const T &item) {
+    uint8_t h = head;
+    if ((uint8_t)(h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) >= SIZE) {
+      return false;
+    }
+    items[h & (SIZE - 1)] = item;
+    // Publish the item only after it has been written
+    __atomic_store_n(&head, (uint8_t)(h + 1), __ATOMIC_RELEASE);
+    return true;
+  }
+
+  /**
+   * Consumer: remove the oldest item from the queue.
+   * Returns: false if the queue is empty
+   */
+  bool pop(T *item) {
+    uint8_t t = tail;
+    if (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t) {
+      return false;
+    }
+    *item = items[t & (SIZE - 1)];
+    // Free the slot only after it has been read
+    __atomic_store_n(&tail, (uint8_t)(t + 1), __ATOMIC_RELEASE);
+    return true;
+  }
+
+  /**
+   * Consumer: look at the oldest item without removing it.
+   * Returns: false if the queue is empty
+   */
+  bool peek(T *item) const {
+    uint8_t t = tail;
+    if (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t) {
+      return false;
+    }
+    *item = items[t & (SIZE - 1)];
+    return true;
+  }
+
+  // Either side: number of items in the queue
+  uint8_t count() const {
+    return (uint8_t)(__atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE));
+  }
+
+  // Either side: number of items that can be pushed before the queue is full
+  uint8_t space() const {
+    return SIZE - count();
+  }
+
+  // Empty the queue. Only safe when neither side is running.
+  void clear() {
+    head = tail = 0;
+  }
+
+private:
+  uint8_t head;  // Written by the producer only
+  uint8_t tail;  // Written by the consumer only
+  T items[SIZE];
+};
+
+#endif